@@ -0,0 +1,519 @@
+/*
+ * KdTreeBenchmark.cpp
+ * RVO2-3D Library
+ *
+ * Copyright 2008 University of North Carolina at Chapel Hill
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Please send all bug reports to <geom@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Jur van den Berg, Stephen J. Guy, Jamie Snape, Ming C. Lin, Dinesh Manocha
+ * Dept. of Computer Science
+ * 201 S. Columbia St.
+ * Frederick P. Brooks, Jr. Computer Science Bldg.
+ * Chapel Hill, N.C. 27599-3175
+ * United States of America
+ *
+ * <http://gamma.cs.unc.edu/RVO2/>
+ */
+
+/* Benchmark of the agent kd-tree. Agents are distributed uniformly at random in a cube and the time to build the kd-tree with each build method is reported for an increasing number of threads, as well as the time per agent of a nearest neighbor query at the position of every agent. The build and query times of each split policy are also compared on uniform, clustered and layered distributions, and batched nearest agent queries at probe points are timed for an increasing number of threads. A stress test builds and queries the kd-tree over agents that share a few identical positions. */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <RVO.h>
+
+#include "KdTree.h"
+
+/* Returns a random number in [0, 1]. */
+float random01()
+{
+	return static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX);
+}
+
+/* Returns the current time in milliseconds. */
+double now()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void setupUniform(RVO::RVOSimulator *sim, size_t numAgents)
+{
+	/* Keep the density constant so that the neighbor counts are comparable across sizes. */
+	const float size = 2.0f * std::cbrt(static_cast<float>(numAgents));
+
+	sim->setTimeStep(0.125f);
+	sim->setAgentDefaults(15.0f, 10, 10.0f, 0.5f, 2.0f);
+
+	for (size_t i = 0; i < numAgents; ++i) {
+		sim->addAgent(RVO::Vector3(size * random01(), size * random01(), size * random01()));
+	}
+}
+
+/* Places the agents around a few dense clusters. */
+void setupClustered(RVO::RVOSimulator *sim, size_t numAgents)
+{
+	const size_t numClusters = 16;
+	const float size = 2.0f * std::cbrt(static_cast<float>(numAgents));
+	std::vector<RVO::Vector3> centers(numClusters);
+
+	for (size_t i = 0; i < numClusters; ++i) {
+		centers[i] = RVO::Vector3(size * random01(), size * random01(), size * random01());
+	}
+
+	sim->setTimeStep(0.125f);
+	sim->setAgentDefaults(15.0f, 10, 10.0f, 0.5f, 2.0f);
+
+	for (size_t i = 0; i < numAgents; ++i) {
+		/* The sum of three uniform offsets approximates a normal distribution. */
+		RVO::Vector3 offset;
+
+		for (size_t j = 0; j < 3; ++j) {
+			offset += RVO::Vector3(random01() - 0.5f, random01() - 0.5f, random01() - 0.5f);
+		}
+
+		sim->addAgent(centers[i % numClusters] + 4.0f * offset);
+	}
+}
+
+/* Places the agents on a few horizontal layers of equal height, such as the floors of a building. */
+void setupLayered(RVO::RVOSimulator *sim, size_t numAgents)
+{
+	const size_t numLayers = 4;
+	const float size = 2.0f * std::sqrt(static_cast<float>(numAgents / numLayers));
+
+	sim->setTimeStep(0.125f);
+	sim->setAgentDefaults(15.0f, 10, 10.0f, 0.5f, 2.0f);
+
+	for (size_t i = 0; i < numAgents; ++i) {
+		sim->addAgent(RVO::Vector3(size * random01(), size * random01(), 10.0f * static_cast<float>(i % numLayers)));
+	}
+}
+
+/* Places the agents at a few identical positions, such as spawn points or a shared goal. */
+void setupCoincident(RVO::RVOSimulator *sim, size_t numAgents)
+{
+	const size_t numPoints = 5;
+	const float size = 2.0f * std::cbrt(static_cast<float>(numAgents));
+	std::vector<RVO::Vector3> points(numPoints);
+
+	for (size_t i = 0; i < numPoints; ++i) {
+		points[i] = RVO::Vector3(size * random01(), size * random01(), size * random01());
+	}
+
+	sim->setTimeStep(0.125f);
+	sim->setAgentDefaults(15.0f, 10, 10.0f, 0.5f, 2.0f);
+
+	for (size_t i = 0; i < numAgents; ++i) {
+		sim->addAgent(points[i % numPoints]);
+	}
+}
+
+void benchmarkBuild(size_t numAgents, size_t repetitions)
+{
+	RVO::RVOSimulator *sim = new RVO::RVOSimulator();
+	setupUniform(sim, numAgents);
+
+	RVO::KdTree tree(sim);
+
+	const RVO::AgentTreeBuildMethod buildMethods[] = { RVO::RVO_SPLIT_BUILD, RVO::RVO_MORTON_BUILD };
+	const char *names[] = { "split", "morton" };
+
+#ifdef _OPENMP
+	const int maxThreads = omp_get_max_threads();
+#else
+	const int maxThreads = 1;
+#endif
+
+	std::cout << "build agents=" << numAgents << std::endl;
+
+	for (int threads = 1; threads <= maxThreads; threads *= 2) {
+#ifdef _OPENMP
+		omp_set_num_threads(threads);
+#endif
+		std::cout << "  threads=" << threads;
+
+		for (size_t i = 0; i < sizeof(buildMethods) / sizeof(buildMethods[0]); ++i) {
+			tree.setBuildMethod(buildMethods[i]);
+
+			/* Warm up. */
+			tree.build();
+
+			double best = 0.0;
+
+			for (size_t j = 0; j < repetitions; ++j) {
+				const double start = now();
+				tree.build();
+				const double time = now() - start;
+
+				if (j == 0 || time < best) {
+					best = time;
+				}
+			}
+
+			std::cout << " " << names[i] << "_ms=" << best;
+		}
+
+		std::cout << std::endl;
+
+		if (threads < maxThreads && 2 * threads > maxThreads) {
+			threads = maxThreads / 2;
+		}
+	}
+
+#ifdef _OPENMP
+	omp_set_num_threads(maxThreads);
+#endif
+
+	delete sim;
+}
+
+/* Orders points by the cell of a coarse grid that contains them, so that consecutive queries visit nearby nodes. */
+bool lessCoherent(const RVO::Vector3 &point1, const RVO::Vector3 &point2)
+{
+	const float cellSize = 4.0f;
+
+	for (size_t i = 0; i < 2; ++i) {
+		const int cell1 = static_cast<int>(point1[i] / cellSize);
+		const int cell2 = static_cast<int>(point2[i] / cellSize);
+
+		if (cell1 != cell2) {
+			return cell1 < cell2;
+		}
+	}
+
+	return point1.z() < point2.z();
+}
+
+double timeQueries(const RVO::KdTree &tree, const std::vector<RVO::Vector3> &points, size_t repetitions, size_t &numNeighbors)
+{
+	const size_t maxNeighbors = 10;
+	const float rangeSq = 15.0f * 15.0f;
+	std::vector<std::pair<float, const RVO::Agent *> > neighbors(maxNeighbors);
+
+	double best = 0.0;
+
+	for (size_t j = 0; j < repetitions; ++j) {
+		numNeighbors = 0;
+
+		const double start = now();
+
+		for (size_t i = 0; i < points.size(); ++i) {
+			numNeighbors += tree.computeNearestAgents(points[i], rangeSq, maxNeighbors, &neighbors[0]);
+		}
+
+		const double time = now() - start;
+
+		if (j == 0 || time < best) {
+			best = time;
+		}
+	}
+
+	return 1.0e6 * best / static_cast<double>(points.size());
+}
+
+void benchmarkQuery(size_t numAgents, size_t repetitions)
+{
+	RVO::RVOSimulator *sim = new RVO::RVOSimulator();
+	setupUniform(sim, numAgents);
+
+	RVO::KdTree tree(sim);
+	tree.build();
+
+	std::vector<RVO::Vector3> points(numAgents);
+
+	for (size_t i = 0; i < numAgents; ++i) {
+		points[i] = sim->getAgentPosition(i);
+	}
+
+	/* Queries in the order of the agents are dominated by cache misses. Queries in a spatially coherent order, as with agents that are stored by locality, mostly measure the traversal itself. */
+	size_t numNeighbors = 0;
+
+	std::cout << "query agents=" << numAgents;
+	std::cout << " random_ns_per_agent=" << timeQueries(tree, points, repetitions, numNeighbors);
+
+	std::sort(points.begin(), points.end(), lessCoherent);
+
+	std::cout << " coherent_ns_per_agent=" << timeQueries(tree, points, repetitions, numNeighbors);
+	std::cout << " neighbors=" << numNeighbors << std::endl;
+
+	delete sim;
+}
+
+void benchmarkNeighbors(size_t numAgents, size_t repetitions)
+{
+	RVO::RVOSimulator *sim = new RVO::RVOSimulator();
+	setupUniform(sim, numAgents);
+
+	RVO::KdTree tree(sim);
+	tree.setNeighborSearch(RVO::RVO_DUAL_TREE_SEARCH);
+	tree.build();
+
+	std::vector<RVO::Vector3> points(numAgents);
+
+	for (size_t i = 0; i < numAgents; ++i) {
+		points[i] = sim->getAgentPosition(i);
+	}
+
+	/* The simulation queries the agents in the order in which they were added, which is random here. */
+	size_t numNeighbors = 0;
+
+	std::cout << "neighbors agents=" << numAgents;
+	std::cout << " random_ns_per_agent=" << timeQueries(tree, points, repetitions, numNeighbors);
+
+	std::sort(points.begin(), points.end(), lessCoherent);
+
+	std::cout << " coherent_ns_per_agent=" << timeQueries(tree, points, repetitions, numNeighbors);
+
+	double best = 0.0;
+
+	for (size_t j = 0; j < repetitions; ++j) {
+		const double start = now();
+		tree.computeAllAgentNeighbors();
+		const double time = now() - start;
+
+		if (j == 0 || time < best) {
+			best = time;
+		}
+	}
+
+	std::cout << " dual_tree_ns_per_agent=" << 1.0e6 * best / static_cast<double>(numAgents) << " neighbors=" << numNeighbors << std::endl;
+
+	delete sim;
+}
+
+void benchmarkPolicies(size_t numAgents, size_t leafSize, size_t repetitions)
+{
+	void (*const setups[])(RVO::RVOSimulator *, size_t) = { setupUniform, setupClustered, setupLayered };
+	const char *setupNames[] = { "uniform", "clustered", "layered" };
+	const RVO::AgentTreeSplitPolicy splitPolicies[] = { RVO::RVO_MIDPOINT_SPLIT, RVO::RVO_MEDIAN_SPLIT, RVO::RVO_SAH_SPLIT };
+	const char *splitPolicyNames[] = { "midpoint", "median", "sah" };
+
+	for (size_t i = 0; i < sizeof(setups) / sizeof(setups[0]); ++i) {
+		RVO::RVOSimulator *sim = new RVO::RVOSimulator();
+		setups[i](sim, numAgents);
+
+		RVO::KdTree tree(sim);
+		tree.setLeafSize(leafSize);
+
+		std::vector<RVO::Vector3> points(numAgents);
+
+		for (size_t j = 0; j < numAgents; ++j) {
+			points[j] = sim->getAgentPosition(j);
+		}
+
+		std::cout << "policies distribution=" << setupNames[i] << " agents=" << numAgents << " leaf_size=" << leafSize << std::endl;
+
+		/* The last configuration is the Morton build, which does not use a split policy. */
+		for (size_t j = 0; j <= sizeof(splitPolicies) / sizeof(splitPolicies[0]); ++j) {
+			if (j < sizeof(splitPolicies) / sizeof(splitPolicies[0])) {
+				tree.setBuildMethod(RVO::RVO_SPLIT_BUILD);
+				tree.setSplitPolicy(splitPolicies[j]);
+			}
+			else {
+				tree.setBuildMethod(RVO::RVO_MORTON_BUILD);
+			}
+
+			double best = 0.0;
+
+			for (size_t k = 0; k < repetitions; ++k) {
+				const double start = now();
+				tree.build();
+				const double time = now() - start;
+
+				if (k == 0 || time < best) {
+					best = time;
+				}
+			}
+
+			size_t numNeighbors = 0;
+
+			std::cout << "  " << (j < sizeof(splitPolicies) / sizeof(splitPolicies[0]) ? splitPolicyNames[j] : "morton") << " build_ms=" << best << " query_ns_per_agent=" << timeQueries(tree, points, repetitions, numNeighbors) << std::endl;
+		}
+
+		delete sim;
+	}
+}
+
+void benchmarkCoincident(size_t numAgents, size_t leafSize, size_t repetitions)
+{
+	RVO::RVOSimulator *sim = new RVO::RVOSimulator();
+	setupCoincident(sim, numAgents);
+
+	RVO::KdTree tree(sim);
+	tree.setLeafSize(leafSize);
+
+	std::vector<RVO::Vector3> points(numAgents);
+
+	for (size_t i = 0; i < numAgents; ++i) {
+		points[i] = sim->getAgentPosition(i);
+	}
+
+	const RVO::AgentTreeSplitPolicy splitPolicies[] = { RVO::RVO_MIDPOINT_SPLIT, RVO::RVO_MEDIAN_SPLIT, RVO::RVO_SAH_SPLIT };
+	const char *splitPolicyNames[] = { "midpoint", "median", "sah" };
+
+	std::cout << "coincident agents=" << numAgents << " leaf_size=" << leafSize << std::endl;
+
+	/* The last configuration is the Morton build, which does not use a split policy. */
+	for (size_t j = 0; j <= sizeof(splitPolicies) / sizeof(splitPolicies[0]); ++j) {
+		if (j < sizeof(splitPolicies) / sizeof(splitPolicies[0])) {
+			tree.setBuildMethod(RVO::RVO_SPLIT_BUILD);
+			tree.setSplitPolicy(splitPolicies[j]);
+		}
+		else {
+			tree.setBuildMethod(RVO::RVO_MORTON_BUILD);
+		}
+
+		double best = 0.0;
+
+		for (size_t k = 0; k < repetitions; ++k) {
+			const double start = now();
+			tree.build();
+			const double time = now() - start;
+
+			if (k == 0 || time < best) {
+				best = time;
+			}
+		}
+
+		size_t numNeighbors = 0;
+
+		std::cout << "  " << (j < sizeof(splitPolicies) / sizeof(splitPolicies[0]) ? splitPolicyNames[j] : "morton") << " build_ms=" << best << " query_ns_per_agent=" << timeQueries(tree, points, repetitions, numNeighbors) << std::endl;
+	}
+
+	delete sim;
+}
+
+void benchmarkProbes(size_t numAgents, size_t repetitions)
+{
+	RVO::RVOSimulator *sim = new RVO::RVOSimulator();
+	setupUniform(sim, numAgents);
+
+	const size_t numPoints = numAgents / 10;
+	const float size = 2.0f * std::cbrt(static_cast<float>(numAgents));
+
+	std::vector<RVO::Vector3> points(numPoints);
+	std::vector<float> ranges(numPoints, 15.0f);
+	std::vector<size_t> maxAgents(numPoints, 10);
+	std::vector<size_t> agentOffsets(numPoints + 1);
+	std::vector<size_t> agentNos(10 * numPoints);
+
+	for (size_t i = 0; i < numPoints; ++i) {
+		points[i] = RVO::Vector3(size * random01(), size * random01(), size * random01());
+	}
+
+	/* Build the spatial index before timing. */
+	sim->queryNearestAgents(points[0], 15.0f, &agentNos[0], 10);
+
+#ifdef _OPENMP
+	const int maxThreads = omp_get_max_threads();
+#else
+	const int maxThreads = 1;
+#endif
+
+	std::cout << "probes agents=" << numAgents << " points=" << numPoints << std::endl;
+
+	double best = 0.0;
+
+	for (size_t j = 0; j < repetitions; ++j) {
+		const double start = now();
+
+		for (size_t i = 0; i < numPoints; ++i) {
+			sim->queryNearestAgents(points[i], ranges[i], &agentNos[10 * i], maxAgents[i]);
+		}
+
+		const double time = now() - start;
+
+		if (j == 0 || time < best) {
+			best = time;
+		}
+	}
+
+	std::cout << "  single_ms=" << best << std::endl;
+
+	for (int threads = 1; threads <= maxThreads; threads *= 2) {
+#ifdef _OPENMP
+		omp_set_num_threads(threads);
+#endif
+
+		for (size_t j = 0; j < repetitions; ++j) {
+			const double start = now();
+			sim->queryNearestAgents(&points[0], &ranges[0], &maxAgents[0], numPoints, &agentOffsets[0], &agentNos[0]);
+			const double time = now() - start;
+
+			if (j == 0 || time < best) {
+				best = time;
+			}
+		}
+
+		std::cout << "  threads=" << threads << " batch_ms=" << best << " agents_found=" << agentOffsets[numPoints] << std::endl;
+
+		if (threads < maxThreads && 2 * threads > maxThreads) {
+			threads = maxThreads / 2;
+		}
+	}
+
+#ifdef _OPENMP
+	omp_set_num_threads(maxThreads);
+#endif
+
+	delete sim;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *mode = argc > 1 ? argv[1] : "all";
+	const size_t numAgents = argc > 2 ? static_cast<size_t>(std::atol(argv[2])) : 200000;
+	const size_t leafSize = argc > 3 ? static_cast<size_t>(std::atol(argv[3])) : 10;
+	const size_t repetitions = 5;
+
+	std::srand(1);
+
+	if (std::strcmp(mode, "build") == 0 || std::strcmp(mode, "all") == 0) {
+		benchmarkBuild(numAgents, repetitions);
+	}
+
+	if (std::strcmp(mode, "query") == 0 || std::strcmp(mode, "all") == 0) {
+		benchmarkQuery(numAgents, repetitions);
+	}
+
+	if (std::strcmp(mode, "neighbors") == 0 || std::strcmp(mode, "all") == 0) {
+		benchmarkNeighbors(numAgents, repetitions);
+	}
+
+	if (std::strcmp(mode, "policies") == 0 || std::strcmp(mode, "all") == 0) {
+		benchmarkPolicies(numAgents, leafSize, repetitions);
+	}
+
+	if (std::strcmp(mode, "coincident") == 0 || std::strcmp(mode, "all") == 0) {
+		benchmarkCoincident(numAgents, leafSize, repetitions);
+	}
+
+	if (std::strcmp(mode, "probes") == 0 || std::strcmp(mode, "all") == 0) {
+		benchmarkProbes(numAgents, repetitions);
+	}
+
+	return 0;
+}
@@ -0,0 +1,189 @@
+/*
+ * ORCAPlaneBenchmark.cpp
+ * RVO2-3D Library
+ *
+ * Copyright 2008 University of North Carolina at Chapel Hill
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Please send all bug reports to <geom@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Jur van den Berg, Stephen J. Guy, Jamie Snape, Ming C. Lin, Dinesh Manocha
+ * Dept. of Computer Science
+ * 201 S. Columbia St.
+ * Frederick P. Brooks, Jr. Computer Science Bldg.
+ * Chapel Hill, N.C. 27599-3175
+ * United States of America
+ *
+ * <http://gamma.cs.unc.edu/RVO2/>
+ */
+
+/* Benchmark of the construction of ORCA planes. Random relative positions and velocities of neighbors, which exercise the cutoff, cone and collision cases, are turned into planes in groups as many as an agent has neighbors, one plane at a time by computeORCAPlane() and several at a time by computeORCAPlanes(). The time per plane of each is reported, and the planes of the two are compared coordinate by coordinate in units in the last place. */
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <RVO.h>
+
+#include "PlaneBuffer.h"
+
+/* Returns a random number in [0, 1]. */
+float random01()
+{
+	return static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX);
+}
+
+/* Returns the current time in milliseconds. */
+double now()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Returns the distance between two floating point numbers in units in the last place. */
+long long computeUlps(float value0, float value1)
+{
+	int bits0;
+	int bits1;
+	std::memcpy(&bits0, &value0, sizeof(float));
+	std::memcpy(&bits1, &value1, sizeof(float));
+
+	/* Map the bits to integers that are ordered like the floating point numbers. */
+	const long long ordered0 = bits0 < 0 ? -static_cast<long long>(bits0 & 0x7fffffff) : bits0;
+	const long long ordered1 = bits1 < 0 ? -static_cast<long long>(bits1 & 0x7fffffff) : bits1;
+
+	return ordered0 > ordered1 ? ordered0 - ordered1 : ordered1 - ordered0;
+}
+
+int main(int argc, char *argv[])
+{
+	const size_t numNeighbors = argc > 1 ? static_cast<size_t>(std::atol(argv[1])) : 16;
+	const size_t numGroups = argc > 2 ? static_cast<size_t>(std::atol(argv[2])) : 4096;
+	const size_t numRepetitions = argc > 3 ? static_cast<size_t>(std::atol(argv[3])) : 50;
+	const size_t count = numNeighbors * numGroups;
+	const float invTimeHorizon = 1.0f / 10.0f;
+	const float invTimeStep = 1.0f / 0.125f;
+	const RVO::Vector3 velocity(0.5f, -0.25f, 0.125f);
+
+	std::vector<float> relativePositions[3];
+	std::vector<float> relativeVelocities[3];
+	std::vector<float> combinedRadii(count);
+	size_t numCollisions = 0;
+	size_t numCutoffs = 0;
+
+	std::srand(1);
+
+	for (size_t axis = 0; axis < 3; ++axis) {
+		relativePositions[axis].resize(count);
+		relativeVelocities[axis].resize(count);
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		/* Neighbors within ten times the combined radius, a few of them overlapping. */
+		const RVO::Vector3 relativePosition(20.0f * random01() - 10.0f, 20.0f * random01() - 10.0f, 20.0f * random01() - 10.0f);
+		const RVO::Vector3 relativeVelocity(4.0f * random01() - 2.0f, 4.0f * random01() - 2.0f, 4.0f * random01() - 2.0f);
+		const float combinedRadius = 1.0f + 2.0f * random01();
+
+		for (size_t axis = 0; axis < 3; ++axis) {
+			relativePositions[axis][i] = relativePosition[axis];
+			relativeVelocities[axis][i] = relativeVelocity[axis];
+		}
+
+		combinedRadii[i] = combinedRadius;
+
+		const RVO::Vector3 w = relativeVelocity - invTimeHorizon * relativePosition;
+
+		if (RVO::absSq(relativePosition) <= combinedRadius * combinedRadius) {
+			++numCollisions;
+		}
+		else if (w * relativePosition < 0.0f && (w * relativePosition) * (w * relativePosition) > combinedRadius * combinedRadius * RVO::absSq(w)) {
+			++numCutoffs;
+		}
+	}
+
+	std::cout << "planes=" << count << " neighbors=" << numNeighbors << " collisions=" << numCollisions << " cutoffs=" << numCutoffs << " cones=" << count - numCollisions - numCutoffs << std::endl;
+
+	/* One plane at a time. */
+	std::vector<RVO::Plane> scalarPlanes(count);
+	RVO::PlaneBuffer planes;
+	double scalarTime = 0.0;
+
+	for (size_t repetition = 0; repetition < numRepetitions; ++repetition) {
+		const double start = now();
+
+		for (size_t group = 0; group < numGroups; ++group) {
+			planes.clear();
+
+			for (size_t i = group * numNeighbors; i < (group + 1) * numNeighbors; ++i) {
+				planes.push_back(RVO::computeORCAPlane(RVO::Vector3(relativePositions[0][i], relativePositions[1][i], relativePositions[2][i]), RVO::Vector3(relativeVelocities[0][i], relativeVelocities[1][i], relativeVelocities[2][i]), combinedRadii[i], invTimeHorizon, invTimeStep, velocity, 0.5f));
+			}
+
+			if (repetition == 0) {
+				for (size_t i = 0; i < numNeighbors; ++i) {
+					scalarPlanes[group * numNeighbors + i] = planes[i];
+				}
+			}
+		}
+
+		scalarTime += now() - start;
+	}
+
+	/* Several planes at a time. */
+	size_t numIdentical = 0;
+	long long maxUlps = 0;
+	double groupTime = 0.0;
+
+	for (size_t repetition = 0; repetition < numRepetitions; ++repetition) {
+		const double start = now();
+
+		for (size_t group = 0; group < numGroups; ++group) {
+			const size_t begin = group * numNeighbors;
+			const float *const groupPositions[3] = { &relativePositions[0][begin], &relativePositions[1][begin], &relativePositions[2][begin] };
+			const float *const groupVelocities[3] = { &relativeVelocities[0][begin], &relativeVelocities[1][begin], &relativeVelocities[2][begin] };
+
+			planes.clear();
+			RVO::computeORCAPlanes(groupPositions, groupVelocities, &combinedRadii[begin], numNeighbors, invTimeHorizon, invTimeStep, velocity, 0.5f, planes);
+
+			if (repetition == 0) {
+				for (size_t i = 0; i < numNeighbors; ++i) {
+					const RVO::Plane &scalarPlane = scalarPlanes[begin + i];
+					long long ulps = 0;
+
+					for (size_t axis = 0; axis < 3; ++axis) {
+						ulps = std::max(ulps, computeUlps(planes.points(axis)[i], scalarPlane.point[axis]));
+						ulps = std::max(ulps, computeUlps(planes.normals(axis)[i], scalarPlane.normal[axis]));
+					}
+
+					if (ulps == 0) {
+						++numIdentical;
+					}
+
+					maxUlps = std::max(maxUlps, ulps);
+				}
+			}
+		}
+
+		groupTime += now() - start;
+	}
+
+	std::cout << "scalar_ns_per_plane=" << 1.0e6 * scalarTime / (numRepetitions * count) << " grouped_ns_per_plane=" << 1.0e6 * groupTime / (numRepetitions * count) << std::endl;
+	std::cout << "identical=" << numIdentical << "/" << count << " max_ulps=" << maxUlps << std::endl;
+
+	return maxUlps <= 4 ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+/*
+ * SphereBenchmark.cpp
+ * RVO2-3D Library
+ *
+ * Copyright 2008 University of North Carolina at Chapel Hill
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Please send all bug reports to <geom@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Jur van den Berg, Stephen J. Guy, Jamie Snape, Ming C. Lin, Dinesh Manocha
+ * Dept. of Computer Science
+ * 201 S. Columbia St.
+ * Frederick P. Brooks, Jr. Computer Science Bldg.
+ * Chapel Hill, N.C. 27599-3175
+ * United States of America
+ *
+ * <http://gamma.cs.unc.edu/RVO2/>
+ */
+
+/* Benchmark of a simulation step in the scenario of the Sphere example, in which agents initially positioned evenly distributed on a sphere move to the antipodal position. The scale multiplies the radius of the sphere, so that the number of agents grows with its square. The simulation is run with each kind of spatial index and with neighbor lists with a skin distance, and the agent neighbors computed by each are compared. A smaller scenario is then run through the crossing at the center with approximate agent neighbors. */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <RVO.h>
+
+#include "KdTree.h"
+
+#ifndef M_PI
+const float M_PI = 3.14159265358979323846f;
+#endif
+
+/* Returns the current time in milliseconds. */
+double now()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void setupScenario(RVO::RVOSimulator *sim, std::vector<RVO::Vector3> &goals, float scale)
+{
+	sim->setTimeStep(0.125f);
+	sim->setAgentDefaults(15.0f, 10, 10.0f, 1.5f, 2.0f);
+
+	for (float a = 0; a < M_PI; a += 0.1f / scale) {
+		const float z = 100.0f * scale * std::cos(a);
+		const float r = 100.0f * scale * std::sin(a);
+
+		for (size_t i = 0; i < r / 2.5f; ++i) {
+			const float x = r * std::cos(i * 2.0f * M_PI / (r / 2.5f));
+			const float y = r * std::sin(i * 2.0f * M_PI / (r / 2.5f));
+
+			sim->addAgent(RVO::Vector3(x, y, z));
+			goals.push_back(-sim->getAgentPosition(sim->getNumAgents() - 1));
+		}
+	}
+}
+
+void setPreferredVelocities(RVO::RVOSimulator *sim, const std::vector<RVO::Vector3> &goals)
+{
+	for (size_t i = 0; i < sim->getNumAgents(); ++i) {
+		RVO::Vector3 goalVector = goals[i] - sim->getAgentPosition(i);
+
+		if (RVO::absSq(goalVector) > 1.0f) {
+			goalVector = RVO::normalize(goalVector);
+		}
+
+		sim->setAgentPrefVelocity(i, goalVector);
+	}
+}
+
+/* Returns the sorted agent neighbors of an agent. */
+std::vector<size_t> getNeighbors(const RVO::RVOSimulator *sim, size_t agentNo)
+{
+	std::vector<size_t> neighbors;
+
+	for (size_t i = 0; i < sim->getAgentNumAgentNeighbors(agentNo); ++i) {
+		neighbors.push_back(sim->getAgentAgentNeighbor(agentNo, i));
+	}
+
+	std::sort(neighbors.begin(), neighbors.end());
+
+	return neighbors;
+}
+
+/* Runs the scenario until the agents have passed the center with several relative errors of the agent neighbors, and reports the nodes of the agent kd-tree visited per query of the agent neighbors and the number of pairs of overlapping agents summed over all steps. */
+void benchmarkApproximation(float scale)
+{
+	const float epsilons[] = { 0.0f, 0.1f, 0.25f, 0.5f, 1.0f };
+	const size_t numSteps = static_cast<size_t>(1000.0f * scale);
+
+	for (size_t i = 0; i < sizeof(epsilons) / sizeof(epsilons[0]); ++i) {
+		RVO::RVOSimulator *sim = new RVO::RVOSimulator();
+		std::vector<RVO::Vector3> goals;
+		setupScenario(sim, goals, scale);
+		sim->setAgentNeighborApproximation(epsilons[i]);
+
+		if (i == 0) {
+			std::cout << "approximation agents=" << sim->getNumAgents() << " steps=" << numSteps << std::endl;
+		}
+
+		RVO::KdTree tree(sim);
+		std::vector<std::pair<float, const RVO::Agent *> > neighbors(sim->getAgentMaxNeighbors(0));
+		std::vector<size_t> agentNos(sim->getNumAgents());
+		size_t numNodes = 0;
+		size_t numOverlaps = 0;
+		double time = 0.0;
+
+		for (size_t step = 0; step < numSteps; ++step) {
+			setPreferredVelocities(sim, goals);
+
+			/* Count the nodes visited by the same queries as the simulation step makes. */
+			tree.build();
+
+			for (size_t j = 0; j < sim->getNumAgents(); ++j) {
+				size_t queryNodes = 0;
+				tree.computeApproximateNearestAgents(sim->getAgentPosition(j), sim->getAgentNeighborDist(j) * sim->getAgentNeighborDist(j), neighbors.size(), epsilons[i], &neighbors[0], queryNodes);
+				numNodes += queryNodes;
+			}
+
+			const double start = now();
+			sim->doStep();
+			time += now() - start;
+
+			for (size_t j = 0; j < sim->getNumAgents(); ++j) {
+				const size_t numAgents = std::min(agentNos.size(), sim->queryAgentsInRange(sim->getAgentPosition(j), 2.0f * sim->getAgentRadius(j), &agentNos[0], agentNos.size()));
+
+				for (size_t k = 0; k < numAgents; ++k) {
+					if (agentNos[k] > j && RVO::abs(sim->getAgentPosition(agentNos[k]) - sim->getAgentPosition(j)) < sim->getAgentRadius(j) + sim->getAgentRadius(agentNos[k])) {
+						++numOverlaps;
+					}
+				}
+			}
+		}
+
+		std::cout << "  epsilon=" << epsilons[i] << " step_ms=" << time / numSteps << " nodes_per_query=" << static_cast<double>(numNodes) / static_cast<double>(numSteps * sim->getNumAgents()) << " overlaps=" << numOverlaps << std::endl;
+
+		delete sim;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const float scale = argc > 1 ? static_cast<float>(std::atof(argv[1])) : 4.0f;
+	const size_t numSteps = argc > 2 ? static_cast<size_t>(std::atol(argv[2])) : 100;
+	const float skin = argc > 3 ? static_cast<float>(std::atof(argv[3])) : 1.0f;
+	const float approximationScale = argc > 4 ? static_cast<float>(std::atof(argv[4])) : 1.0f;
+
+	const RVO::SpatialIndexType spatialIndices[] = { RVO::RVO_KD_TREE, RVO::RVO_HASH_GRID, RVO::RVO_KD_TREE, RVO::RVO_HASH_GRID };
+	const float skins[] = { 0.0f, 0.0f, skin, skin };
+	const char *names[] = { "kdtree", "hashgrid", "kdtree_skin", "hashgrid_skin" };
+	const size_t numSpatialIndices = sizeof(spatialIndices) / sizeof(spatialIndices[0]);
+
+	std::vector<RVO::RVOSimulator *> sims;
+	std::vector<RVO::Vector3> goals;
+	std::vector<double> times(numSpatialIndices, 0.0);
+
+	for (size_t i = 0; i < numSpatialIndices; ++i) {
+		goals.clear();
+		sims.push_back(new RVO::RVOSimulator());
+		setupScenario(sims[i], goals, scale);
+		sims[i]->setSpatialIndex(spatialIndices[i]);
+		sims[i]->setNeighborListSkin(skins[i]);
+	}
+
+	std::cout << "agents=" << sims[0]->getNumAgents() << " steps=" << numSteps << " skin=" << skin << std::endl;
+
+	size_t mismatches = 0;
+
+	for (size_t step = 0; step < numSteps; ++step) {
+		for (size_t i = 0; i < numSpatialIndices; ++i) {
+			setPreferredVelocities(sims[i], goals);
+
+			const double start = now();
+			sims[i]->doStep();
+			times[i] += now() - start;
+		}
+
+		for (size_t i = 1; i < numSpatialIndices; ++i) {
+			for (size_t j = 0; j < sims[0]->getNumAgents(); ++j) {
+				if (getNeighbors(sims[0], j) != getNeighbors(sims[i], j)) {
+					++mismatches;
+				}
+			}
+		}
+	}
+
+	for (size_t i = 0; i < numSpatialIndices; ++i) {
+		std::cout << "  " << names[i] << " step_ms=" << times[i] / numSteps << std::endl;
+		delete sims[i];
+	}
+
+	std::cout << "  neighbor_mismatches=" << mismatches << std::endl;
+
+	if (approximationScale > 0.0f) {
+		benchmarkApproximation(approximationScale);
+	}
+
+	return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+/*
+ * StepBenchmark.cpp
+ * RVO2-3D Library
+ *
+ * Copyright 2008 University of North Carolina at Chapel Hill
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Please send all bug reports to <geom@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Jur van den Berg, Stephen J. Guy, Jamie Snape, Ming C. Lin, Dinesh Manocha
+ * Dept. of Computer Science
+ * 201 S. Columbia St.
+ * Frederick P. Brooks, Jr. Computer Science Bldg.
+ * Chapel Hill, N.C. 27599-3175
+ * United States of America
+ *
+ * <http://gamma.cs.unc.edu/RVO2/>
+ */
+
+/* Benchmark of a simulation step with growing numbers of agents at a constant density, each moving with its own constant preferred velocity. About 65 agents lie within the neighbor distance of each, of which the maximum number of neighbors are taken. The time of a step grows with the number of agents, and its growth beyond linear shows the cost of the memory accesses once the state of the agents no longer fits in the caches. The heap allocations per step are counted as well, which should be none once the buffers of the agents have grown. */
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#include <RVO.h>
+
+/* The number of heap allocations so far, counted by the replaced global operator new. */
+std::atomic<size_t> numAllocations(0);
+
+void *operator new(std::size_t size)
+{
+	++numAllocations;
+
+	void *const pointer = std::malloc(size > 0 ? size : 1);
+
+	if (pointer == NULL) {
+		throw std::bad_alloc();
+	}
+
+	return pointer;
+}
+
+void operator delete(void *pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept
+{
+	operator delete(pointer);
+}
+
+/* Returns the current time in milliseconds. */
+double now()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Returns a random number in [0, 1]. */
+float random01()
+{
+	return static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX);
+}
+
+/* Runs a number of steps with uniformly distributed agents and reports the time and the number of heap allocations per step. */
+void benchmarkSteps(size_t numAgents, size_t numSteps, size_t maxNeighbors)
+{
+	RVO::RVOSimulator *sim = new RVO::RVOSimulator();
+	sim->setTimeStep(0.125f);
+	sim->setAgentDefaults(5.0f, maxNeighbors, 5.0f, 0.5f, 2.0f);
+
+	/* A cube with a volume of eight per agent. */
+	const float size = 2.0f * std::pow(static_cast<float>(numAgents), 1.0f / 3.0f);
+	std::srand(1);
+
+	for (size_t i = 0; i < numAgents; ++i) {
+		sim->addAgent(RVO::Vector3(size * random01(), size * random01(), size * random01()));
+		sim->setAgentPrefVelocity(i, RVO::Vector3(random01() - 0.5f, random01() - 0.5f, random01() - 0.5f));
+	}
+
+	/* The first step builds the spatial index for the first time. */
+	sim->doStep();
+
+	const size_t startAllocations = numAllocations;
+	const double start = now();
+
+	for (size_t step = 0; step < numSteps; ++step) {
+		sim->doStep();
+	}
+
+	const double time = now() - start;
+	const size_t allocations = numAllocations - startAllocations;
+
+	std::cout << "agents=" << numAgents << " steps=" << numSteps << " step_ms=" << time / numSteps << " agent_ns=" << 1.0e6 * time / (numSteps * numAgents) << " allocs_per_step=" << static_cast<double>(allocations) / numSteps << std::endl;
+
+	delete sim;
+}
+
+int main(int argc, char *argv[])
+{
+	const size_t numSteps = argc > 1 ? static_cast<size_t>(std::atol(argv[1])) : 10;
+	const size_t maxAgents = argc > 2 ? static_cast<size_t>(std::atol(argv[2])) : 1000000;
+	const size_t maxNeighbors = argc > 3 ? static_cast<size_t>(std::atol(argv[3])) : 10;
+
+	for (size_t numAgents = 10000; numAgents <= maxAgents; numAgents *= 10) {
+		benchmarkSteps(numAgents, numSteps, maxNeighbors);
+	}
+
+	return 0;
+}
@@ -56,7 +56,7 @@ else:
               libraries=['RVO'],
               library_dirs=['build/RVO23D/src'],
               extra_compile_args=['-fPIC'],
-	      extra_link_args=[]),
+	      extra_link_args=['-fopenmp']),
 ]
 
 setup(
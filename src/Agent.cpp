@@ -35,14 +35,18 @@
 #include <cmath>
 #include <algorithm>
 
+#include "AgentStore.h"
 #include "Definitions.h"
-#include "KdTree.h"
+#include "Obstacle.h"
+#include "ObstacleTree.h"
+#include "PlaneBuffer.h"
+#include "SpatialIndex.h"
 
 namespace RVO {
 	/**
-	 * \brief   A sufficiently small positive number.
+	 * \brief   The number of agent neighbors gathered at a time to compute their ORCA planes together.
 	 */
-	const float RVO_EPSILON = 0.00001f;
+	const size_t RVO_PLANE_GROUP_SIZE = 16;
 
 	/**
 	 * \brief   Defines a directed line.
@@ -71,7 +75,7 @@ namespace RVO {
 	 * \param   result        A reference to the result of the linear program.
 	 * \return  True if successful.
 	 */
-	bool linearProgram1(const std::vector<Plane> &planes, size_t planeNo, const Line &line, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result);
+	bool linearProgram1(const PlaneBuffer &planes, size_t planeNo, const Line &line, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result);
 
 	/**
 	 * \brief   Solves a two-dimensional linear program on a specified plane subject to linear constraints defined by planes and a spherical constraint.
@@ -83,7 +87,7 @@ namespace RVO {
 	 * \param   result        A reference to the result of the linear program.
 	 * \return  True if successful.
 	 */
-	bool linearProgram2(const std::vector<Plane> &planes, size_t planeNo, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result);
+	bool linearProgram2(const PlaneBuffer &planes, size_t planeNo, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result);
 
 	/**
 	 * \brief   Solves a three-dimensional linear program subject to linear constraints defined by planes and a spherical constraint.
@@ -94,136 +98,203 @@ namespace RVO {
 	 * \param   result        A reference to the result of the linear program.
 	 * \return  The number of the plane it fails on, and the number of planes if successful.
 	 */
-	size_t linearProgram3(const std::vector<Plane> &planes, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result);
+	size_t linearProgram3(const PlaneBuffer &planes, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result);
 
 	/**
 	 * \brief   Solves a four-dimensional linear program subject to linear constraints defined by planes and a spherical constraint.
-	 * \param   planes     Planes defining the linear constraints.
-	 * \param   beginPlane The plane on which the 3-d linear program failed.
-	 * \param   radius     The radius of the spherical constraint.
-	 * \param   result     A reference to the result of the linear program.
+	 * \param   planes         Planes defining the linear constraints.
+	 * \param   numObstPlanes  Count of obstacle planes, which precede the agent planes and are never relaxed.
+	 * \param   beginPlane     The plane on which the 3-d linear program failed.
+	 * \param   radius         The radius of the spherical constraint.
+	 * \param   projPlanes     A reference to a buffer for the projected planes, so that no planes are allocated.
+	 * \param   result         A reference to the result of the linear program.
 	 */
-	void linearProgram4(const std::vector<Plane> &planes, size_t beginPlane, float radius, Vector3 &result);
+	void linearProgram4(const PlaneBuffer &planes, size_t numObstPlanes, size_t beginPlane, float radius, PlaneBuffer &projPlanes, Vector3 &result);
 
-	Agent::Agent(RVOSimulator *sim) : sim_(sim), id_(0), maxNeighbors_(0), maxSpeed_(0.0f), neighborDist_(0.0f), radius_(0.0f), timeHorizon_(0.0f), maxAcceleration_(10.0f), maxDeceleration_(15.0f), maxHorizontalSpeed_(5.0f), maxVerticalUpSpeed_(3.0f), maxVerticalDownSpeed_(3.0f), useDirectionalSpeedLimits_(false), consecutiveLowMotionSteps_(0) { }
+	Agent::Agent(RVOSimulator *sim) : sim_(sim), id_(0), maxNeighbors_(0), slot_(0), neighborDist_(0.0f), verticalNeighborDist_(0.0f), timeHorizon_(0.0f), maxAcceleration_(10.0f), maxDeceleration_(15.0f), maxHorizontalSpeed_(5.0f), maxVerticalUpSpeed_(3.0f), maxVerticalDownSpeed_(3.0f), useDirectionalSpeedLimits_(false), consecutiveLowMotionSteps_(0), candidateDisplacement_(0.0), candidateEpoch_(0) { }
 
 	void Agent::computeNeighbors()
 	{
 		agentNeighbors_.clear();
+		agentNeighbors_.reserve(maxNeighbors_);
 
 		if (maxNeighbors_ > 0) {
-			sim_->kdTree_->computeAgentNeighbors(this, neighborDist_ * neighborDist_);
+			if (sim_->neighborSkin_ > 0.0f) {
+				/* An agent now within the neighbor distance was within the neighbor distance plus the skin distance at the last query, unless this agent and it together have moved farther than the skin distance since. */
+				const std::vector<Vector3> &positions = sim_->agentStore_->positions_;
+				const Vector3 &position = positions[slot_];
+
+				if (candidateEpoch_ != sim_->neighborListEpoch_ || abs(position - candidatePosition_) + static_cast<float>(sim_->neighborDisplacement_ - candidateDisplacement_) > sim_->neighborSkin_) {
+					neighborCandidates_.clear();
+					sim_->spatialIndex_->computeAgentNeighborCandidates(this, sqr(std::max(neighborDist_, verticalNeighborDist_) + sim_->neighborSkin_));
+					candidatePosition_ = position;
+					candidateDisplacement_ = sim_->neighborDisplacement_;
+					candidateEpoch_ = sim_->neighborListEpoch_;
+				}
+
+				float rangeSq = neighborDist_ * neighborDist_;
+				const float verticalWeight = computeNeighborVerticalWeight();
+
+				for (size_t i = 0; i < neighborCandidates_.size(); ++i) {
+					insertAgentNeighbor(neighborCandidates_[i], absSqWeighted(position - positions[neighborCandidates_[i]->slot_], verticalWeight), rangeSq);
+				}
+			}
+			else {
+				sim_->spatialIndex_->computeAgentNeighbors(this, neighborDist_ * neighborDist_);
+			}
 		}
 	}
 
-	void Agent::computeNewVelocity()
+	void Agent::computeNewVelocity(PlaneBuffer &projPlanes)
 	{
+		AgentStore &store = *sim_->agentStore_;
+		const Vector3 &position = store.positions_[slot_];
+		const Vector3 &velocity = store.velocities_[slot_];
+		const float radius = store.radii_[slot_];
+		const float maxSpeed = store.maxSpeeds_[slot_];
+
 		orcaPlanes_.clear();
 		const float invTimeHorizon = 1.0f / timeHorizon_;
+		const float invTimeStep = 1.0f / sim_->timeStep_;
 
-		/* Create agent ORCA planes. */
-		for (size_t i = 0; i < agentNeighbors_.size(); ++i) {
-			const Agent *const other = agentNeighbors_[i].second;
-			const Vector3 relativePosition = other->position_ - position_;
-			const Vector3 relativeVelocity = velocity_ - other->velocity_;
-			const float distSq = absSq(relativePosition);
-			const float combinedRadius = radius_ + other->radius_;
-			const float combinedRadiusSq = sqr(combinedRadius);
+		/* Create obstacle ORCA planes while querying the static obstacles, which are computed here rather than in computeNeighbors() so that the planes can cull the query. */
+		obstacleNeighbors_.clear();
+		obstacleThresholds_.clear();
 
-			Plane plane;
-			Vector3 u;
+		if (sim_->obstacleTree_ != NULL) {
+			sim_->obstacleTree_->computeObstacleNeighbors(this, sqr(timeHorizon_ * maxSpeed + radius));
+		}
 
-			if (distSq > combinedRadiusSq) {
-				/* No collision. */
-				const Vector3 w = relativeVelocity - invTimeHorizon * relativePosition;
-				/* Vector from cutoff center to relative velocity. */
-				const float wLengthSq = absSq(w);
+		const size_t numObstPlanes = orcaPlanes_.size();
+		orcaPlanes_.reserve(numObstPlanes + maxNeighbors_);
 
-				const float dotProduct = w * relativePosition;
+		/* Create agent ORCA planes, gathering the relative positions and velocities of a group of neighbors at a time into arrays per axis. */
+		float relativePositions[3][RVO_PLANE_GROUP_SIZE];
+		float relativeVelocities[3][RVO_PLANE_GROUP_SIZE];
+		float combinedRadii[RVO_PLANE_GROUP_SIZE];
+		const float *const groupPositions[3] = { relativePositions[0], relativePositions[1], relativePositions[2] };
+		const float *const groupVelocities[3] = { relativeVelocities[0], relativeVelocities[1], relativeVelocities[2] };
 
-				if (dotProduct < 0.0f && sqr(dotProduct) > combinedRadiusSq * wLengthSq) {
-					/* Project on cut-off circle. */
-					const float wLength = std::sqrt(wLengthSq);
-					const Vector3 unitW = w / wLength;
+		for (size_t i = 0; i < agentNeighbors_.size(); i += RVO_PLANE_GROUP_SIZE) {
+			const size_t count = std::min(RVO_PLANE_GROUP_SIZE, agentNeighbors_.size() - i);
 
-					plane.normal = unitW;
-					u = (combinedRadius * invTimeHorizon - wLength) * unitW;
-				}
-				else {
-					/* Project on cone. */
-					const float a = distSq;
-					const float b = relativePosition * relativeVelocity;
-					const float c = absSq(relativeVelocity) - absSq(cross(relativePosition, relativeVelocity)) / (distSq - combinedRadiusSq);
-					const float t = (b + std::sqrt(sqr(b) - a * c)) / a;
-					const Vector3 w = relativeVelocity - t * relativePosition;
-					const float wLength = abs(w);
-					const Vector3 unitW = w / wLength;
-
-					plane.normal = unitW;
-					u = (combinedRadius * t - wLength) * unitW;
+			for (size_t j = 0; j < count; ++j) {
+				const size_t other = agentNeighbors_[i + j].slot;
+				const Vector3 relativePosition = store.positions_[other] - position;
+				const Vector3 relativeVelocity = velocity - store.velocities_[other];
+
+				for (size_t axis = 0; axis < 3; ++axis) {
+					relativePositions[axis][j] = relativePosition[axis];
+					relativeVelocities[axis][j] = relativeVelocity[axis];
 				}
-			}
-			else {
-				/* Collision. */
-				const float invTimeStep = 1.0f / sim_->timeStep_;
-				const Vector3 w = relativeVelocity - invTimeStep * relativePosition;
-				const float wLength = abs(w);
-				const Vector3 unitW = w / wLength;
-
-				plane.normal = unitW;
-				u = (combinedRadius * invTimeStep - wLength) * unitW;
+
+				combinedRadii[j] = radius + store.radii_[other];
 			}
 
-			plane.point = velocity_ + 0.5f * u;
-			orcaPlanes_.push_back(plane);
+			computeORCAPlanes(groupPositions, groupVelocities, combinedRadii, count, invTimeHorizon, invTimeStep, velocity, 0.5f, orcaPlanes_);
 		}
 
 		// 適応的加速度制限: 目標近傍での動きを改善
 		Vector3 adaptivePrefVelocity = getAdaptivePrefVelocity();
 
-		const size_t planeFail = linearProgram3(orcaPlanes_, maxSpeed_, adaptivePrefVelocity, false, newVelocity_);
+		Vector3 &newVelocity = store.newVelocities_[slot_];
+		const size_t planeFail = linearProgram3(orcaPlanes_, maxSpeed, adaptivePrefVelocity, false, newVelocity);
 
 		if (planeFail < orcaPlanes_.size()) {
-			linearProgram4(orcaPlanes_, planeFail, maxSpeed_, newVelocity_);
+			linearProgram4(orcaPlanes_, numObstPlanes, planeFail, maxSpeed, projPlanes, newVelocity);
 		}
 
 		// 低速状態での積極的補正を適用
 		applyAggressiveMotionCorrection();
 	}
 
-	void Agent::insertAgentNeighbor(const Agent *agent, float &rangeSq)
+	void Agent::insertAgentNeighbor(const Agent *agent, float distSq, float &rangeSq)
 	{
 		if (this != agent) {
-			const float distSq = absSq(position_ - agent->position_);
+			if (distSq < rangeSq && !(sim_->neighborCulling_ && isAgentNeighborCulled(agent))) {
+				AgentNeighbor neighbor;
+				neighbor.distSq = distSq;
+				neighbor.slot = static_cast<uint32_t>(agent->slot_);
 
-			if (distSq < rangeSq) {
 				if (agentNeighbors_.size() < maxNeighbors_) {
-					agentNeighbors_.push_back(std::make_pair(distSq, agent));
+					agentNeighbors_.push_back(neighbor);
 				}
 
 				size_t i = agentNeighbors_.size() - 1;
 
-				while (i != 0 && distSq < agentNeighbors_[i - 1].first) {
+				while (i != 0 && distSq < agentNeighbors_[i - 1].distSq) {
 					agentNeighbors_[i] = agentNeighbors_[i - 1];
 					--i;
 				}
 
-				agentNeighbors_[i] = std::make_pair(distSq, agent);
+				agentNeighbors_[i] = neighbor;
 
 				if (agentNeighbors_.size() == maxNeighbors_) {
-					rangeSq = agentNeighbors_.back().first;
+					rangeSq = agentNeighbors_.back().distSq;
 				}
 			}
 		}
 	}
 
+	void Agent::insertObstacleNeighbor(const Obstacle *obstacle, const Vector3 &point, float distSq)
+	{
+		const AgentStore &store = *sim_->agentStore_;
+		const Vector3 &position = store.positions_[slot_];
+		const Vector3 &velocity = store.velocities_[slot_];
+		const float radius = store.radii_[slot_];
+		const Vector3 relativePosition = point - position;
+		const float pointCoord[3] = { point.x(), point.y(), point.z() };
+
+		if (!isObstacleCovered(pointCoord, pointCoord)) {
+			Plane plane;
+
+			if (distSq > 0.0f) {
+				plane = computeORCAPlane(relativePosition, velocity, radius, 1.0f / timeHorizon_, 1.0f / sim_->timeStep_, velocity, 1.0f);
+			}
+			else {
+				/* The center of this agent lies on the triangle, so that the nearest point gives no direction and computeORCAPlane() would divide by zero if this agent is at rest. As in the collision case of computeORCAPlane(), whose planes tend to this one as the agent nears the triangle, the agent must move its radius away from the triangle within one time step, along the normal of the triangle on the side toward which it moves. The speed of leaving is kept below the maximum speed, since linearProgram4() keeps obstacle planes as hard constraints and could not satisfy a plane beyond it. */
+				Vector3 normal = normalize(cross(obstacle->vertices_[1] - obstacle->vertices_[0], obstacle->vertices_[2] - obstacle->vertices_[0]));
+
+				if (normal * velocity < 0.0f) {
+					normal = -normal;
+				}
+
+				const float speed = std::min(radius / sim_->timeStep_, (1.0f - RVO_EPSILON) * store.maxSpeeds_[slot_]);
+				plane.normal = normal;
+				plane.point = velocity + (speed - velocity * normal) * normal;
+			}
+
+			orcaPlanes_.push_back(plane);
+			obstacleNeighbors_.push_back(std::make_pair(distSq, obstacle));
+
+			/* The velocity obstacle of a static point at relativePosition is the union of the spheres of radius radius / t centered at relativePosition / t for t up to timeHorizon_. It lies on the forbidden side of the plane if the sphere for t = timeHorizon_ does and relativePosition * normal + radius is not positive. */
+			obstacleThresholds_.push_back(std::min(0.0f, timeHorizon_ * (plane.point * plane.normal) + RVO_EPSILON) - radius + position * plane.normal);
+		}
+	}
+
+	bool Agent::isObstacleCovered(const float *minCoord, const float *maxCoord) const
+	{
+		const float *const normalsX = orcaPlanes_.normals(0);
+		const float *const normalsY = orcaPlanes_.normals(1);
+		const float *const normalsZ = orcaPlanes_.normals(2);
+
+		for (size_t i = 0; i < obstacleThresholds_.size(); ++i) {
+			if ((normalsX[i] > 0.0f ? maxCoord[0] : minCoord[0]) * normalsX[i] + (normalsY[i] > 0.0f ? maxCoord[1] : minCoord[1]) * normalsY[i] + (normalsZ[i] > 0.0f ? maxCoord[2] : minCoord[2]) * normalsZ[i] <= obstacleThresholds_[i]) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
 	Vector3 Agent::applyDirectionalSpeedLimits(const Vector3 &velocity)
 	{
 		if (!useDirectionalSpeedLimits_) {
 			// 従来の球体制限を使用
+			const float maxSpeed = sim_->agentStore_->maxSpeeds_[slot_];
 			const float speedSq = absSq(velocity);
-			if (speedSq > sqr(maxSpeed_)) {
-				return normalize(velocity) * maxSpeed_;
+			if (speedSq > sqr(maxSpeed)) {
+				return normalize(velocity) * maxSpeed;
 			}
 			return velocity;
 		}
@@ -253,11 +324,38 @@ namespace RVO {
 		return result;
 	}
 
+	float Agent::computeNeighborVerticalWeight() const
+	{
+		return verticalNeighborDist_ > 0.0f ? sqr(neighborDist_ / verticalNeighborDist_) : 1.0f;
+	}
+
+	bool Agent::isAgentNeighborCulled(const Agent *agent) const
+	{
+		const AgentStore &store = *sim_->agentStore_;
+		const Vector3 &velocity = store.velocities_[slot_];
+		const Vector3 relativePosition = store.positions_[agent->slot_] - store.positions_[slot_];
+		const float distSq = absSq(relativePosition);
+		const float combinedRadius = store.radii_[slot_] + store.radii_[agent->slot_];
+
+		if (distSq <= sqr(combinedRadius)) {
+			return false;
+		}
+
+		/*
+		 * The velocity obstacle lies beyond (dist - combinedRadius) / timeHorizon_ along the relative position, which bounds the distance |u| from the relative velocity to it from below. The ORCA plane passes through velocity + u / 2 with its normal opposite to u, so it excludes no velocity up to the maximum speed if |u| / 2 >= maximum speed + abs(velocity).
+		 */
+		const float dist = std::sqrt(distSq);
+
+		return dist - combinedRadius - timeHorizon_ * ((velocity - store.velocities_[agent->slot_]) * relativePosition) / dist > 2.0f * timeHorizon_ * (store.maxSpeeds_[slot_] + abs(velocity));
+	}
+
 	Vector3 Agent::getAdaptivePrefVelocity()
 	{
+		const Vector3 &prefVelocity = sim_->agentStore_->prefVelocities_[slot_];
+
 		// シンプルな適応制御: 優先速度をそのまま使用
 		// 目標到達時の収束を優先し、不必要な速度強制を排除
-		const float prefSpeed = abs(prefVelocity_);
+		const float prefSpeed = abs(prefVelocity);
 		
 		// 優先速度がほぼゼロの場合は収束状態として尊重
 		if (prefSpeed <= RVO_EPSILON) {
@@ -265,18 +363,22 @@ namespace RVO {
 		}
 		
 		// 優先速度をそのまま返す（RVOアルゴリズムに任せる）
-		return prefVelocity_;
+		return prefVelocity;
 	}
 
 	void Agent::applyAggressiveMotionCorrection()
 	{
-		const float newSpeed = abs(newVelocity_);
-		const float prefSpeed = abs(prefVelocity_);
-		const float currentSpeed = abs(velocity_);
+		AgentStore &store = *sim_->agentStore_;
+		Vector3 &newVelocity = store.newVelocities_[slot_];
+		const Vector3 &prefVelocity = store.prefVelocities_[slot_];
+		const Vector3 &velocity = store.velocities_[slot_];
+		const float newSpeed = abs(newVelocity);
+		const float prefSpeed = abs(prefVelocity);
+		const float currentSpeed = abs(velocity);
 		
 		// 【シンプル収束1】目標近傍での確実な停止
 		if (prefSpeed <= 0.05f) { // 5cm/s以下は目標到達
-			newVelocity_ = Vector3(0.0f, 0.0f, 0.0f);
+			newVelocity = Vector3(0.0f, 0.0f, 0.0f);
 			consecutiveLowMotionSteps_ = 0;
 			return;
 		}
@@ -287,7 +389,7 @@ namespace RVO {
 		if (currentSpeed < microMotionThreshold && newSpeed < microMotionThreshold) {
 			consecutiveLowMotionSteps_++;
 			if (consecutiveLowMotionSteps_ >= 5) { // 5ステップ連続で停止
-				newVelocity_ = Vector3(0.0f, 0.0f, 0.0f);
+				newVelocity = Vector3(0.0f, 0.0f, 0.0f);
 				consecutiveLowMotionSteps_ = 0;
 				return;
 			}
@@ -297,7 +399,7 @@ namespace RVO {
 		
 		// 【シンプル収束3】極小速度の完全停止
 		if (newSpeed < 0.02f) { // 2cm/s以下
-			newVelocity_ = Vector3(0.0f, 0.0f, 0.0f);
+			newVelocity = Vector3(0.0f, 0.0f, 0.0f);
 			consecutiveLowMotionSteps_ = 0;
 		}
 		
@@ -312,9 +414,14 @@ namespace RVO {
 			// timeStepが0以下の場合は位置のみ更新
 			return;
 		}
+
+		AgentStore &store = *sim_->agentStore_;
+		Vector3 &position = store.positions_[slot_];
+		Vector3 &velocity = store.velocities_[slot_];
+		const Vector3 &newVelocity = store.newVelocities_[slot_];
 		
 		// 速度変化量（加速度ベクトル * timeStep）を計算
-		Vector3 velocityChange = newVelocity_ - velocity_;
+		Vector3 velocityChange = newVelocity - velocity;
 		Vector3 acceleration = velocityChange / sim_->timeStep_;
 		
 		const float accelerationMagnitudeSq = absSq(acceleration);
@@ -324,7 +431,7 @@ namespace RVO {
 			const float accelerationMagnitude = std::sqrt(accelerationMagnitudeSq);
 			
 			// 加速・減速の判定（現在速度との内積で判断）
-			const float velocityDotChange = velocity_ * velocityChange;
+			const float velocityDotChange = velocity * velocityChange;
 			const float maxAccelLimit = (velocityDotChange >= 0.0f) ? 
 									   maxAcceleration_ : maxDeceleration_;
 			
@@ -332,24 +439,24 @@ namespace RVO {
 				// 加速度を制限
 				const Vector3 limitedAcceleration = 
 					(acceleration / accelerationMagnitude) * maxAccelLimit;
-				velocity_ = velocity_ + limitedAcceleration * sim_->timeStep_;
+				velocity = velocity + limitedAcceleration * sim_->timeStep_;
 			} else {
 				// 制限内なのでそのまま適用
-				velocity_ = newVelocity_;
+				velocity = newVelocity;
 			}
 		} else {
 			// 加速度がほぼゼロの場合はそのまま適用
-			velocity_ = newVelocity_;
+			velocity = newVelocity;
 		}
 		
 		// 方向別速度制限を適用
-		velocity_ = applyDirectionalSpeedLimits(velocity_);
+		velocity = applyDirectionalSpeedLimits(velocity);
 		
 		// 位置更新
-		position_ += velocity_ * sim_->timeStep_;
+		position += velocity * sim_->timeStep_;
 	}
 
-	bool linearProgram1(const std::vector<Plane> &planes, size_t planeNo, const Line &line, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result)
+	bool linearProgram1(const PlaneBuffer &planes, size_t planeNo, const Line &line, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result)
 	{
 		const float dotProduct = line.point * line.direction;
 		const float discriminant = sqr(dotProduct) + sqr(radius) - absSq(line.point);
@@ -363,34 +470,8 @@ namespace RVO {
 		float tLeft = -dotProduct - sqrtDiscriminant;
 		float tRight = -dotProduct + sqrtDiscriminant;
 
-		for (size_t i = 0; i < planeNo; ++i) {
-			const float numerator = (planes[i].point - line.point) * planes[i].normal;
-			const float denominator = line.direction * planes[i].normal;
-
-			if (sqr(denominator) <= RVO_EPSILON) {
-				/* Lines line is (almost) parallel to plane i. */
-				if (numerator > 0.0f) {
-					return false;
-				}
-				else {
-					continue;
-				}
-			}
-
-			const float t = numerator / denominator;
-
-			if (denominator >= 0.0f) {
-				/* Plane i bounds line on the left. */
-				tLeft = std::max(tLeft, t);
-			}
-			else {
-				/* Plane i bounds line on the right. */
-				tRight = std::min(tRight, t);
-			}
-
-			if (tLeft > tRight) {
-				return false;
-			}
+		if (!boundLine(planes, planeNo, line.point, line.direction, tLeft, tRight)) {
+			return false;
 		}
 
 		if (directionOpt) {
@@ -422,7 +503,7 @@ namespace RVO {
 		return true;
 	}
 
-	bool linearProgram2(const std::vector<Plane> &planes, size_t planeNo, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result)
+	bool linearProgram2(const PlaneBuffer &planes, size_t planeNo, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result)
 	{
 		const float planeDist = planes[planeNo].point * planes[planeNo].normal;
 		const float planeDistSq = sqr(planeDist);
@@ -461,32 +542,30 @@ namespace RVO {
 			}
 		}
 
-		for (size_t i = 0; i < planeNo; ++i) {
-			if (planes[i].normal * (planes[i].point - result) > 0.0f) {
-				/* Result does not satisfy constraint i. Compute new optimal result. */
-				/* Compute intersection line of plane i and plane planeNo. */
-				Vector3 crossProduct = cross(planes[i].normal, planes[planeNo].normal);
+		for (size_t i = findViolatedPlane(planes, 0, planeNo, result, 0.0f); i < planeNo; i = findViolatedPlane(planes, i + 1, planeNo, result, 0.0f)) {
+			/* Result does not satisfy constraint i. Compute new optimal result. */
+			/* Compute intersection line of plane i and plane planeNo. */
+			Vector3 crossProduct = cross(planes[i].normal, planes[planeNo].normal);
 
-				if (absSq(crossProduct) <= RVO_EPSILON) {
-					/* Planes planeNo and i are (almost) parallel, and plane i fully invalidates plane planeNo. */
-					return false;
-				}
+			if (absSq(crossProduct) <= RVO_EPSILON) {
+				/* Planes planeNo and i are (almost) parallel, and plane i fully invalidates plane planeNo. */
+				return false;
+			}
 
-				Line line;
-				line.direction = normalize(crossProduct);
-				const Vector3 lineNormal = cross(line.direction, planes[planeNo].normal);
-				line.point = planes[planeNo].point + (((planes[i].point - planes[planeNo].point) * planes[i].normal) / (lineNormal * planes[i].normal)) * lineNormal;
+			Line line;
+			line.direction = normalize(crossProduct);
+			const Vector3 lineNormal = cross(line.direction, planes[planeNo].normal);
+			line.point = planes[planeNo].point + (((planes[i].point - planes[planeNo].point) * planes[i].normal) / (lineNormal * planes[i].normal)) * lineNormal;
 
-				if (!linearProgram1(planes, i, line, radius, optVelocity, directionOpt, result)) {
-					return false;
-				}
+			if (!linearProgram1(planes, i, line, radius, optVelocity, directionOpt, result)) {
+				return false;
 			}
 		}
 
 		return true;
 	}
 
-	size_t linearProgram3(const std::vector<Plane> &planes, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result)
+	size_t linearProgram3(const PlaneBuffer &planes, float radius, const Vector3 &optVelocity, bool directionOpt, Vector3 &result)
 	{
 		if (directionOpt) {
 			/* Optimize direction. Note that the optimization velocity is of unit length in this case. */
@@ -501,65 +580,65 @@ namespace RVO {
 			result = optVelocity;
 		}
 
-		for (size_t i = 0; i < planes.size(); ++i) {
-			if (planes[i].normal * (planes[i].point - result) > 0.0f) {
-				/* Result does not satisfy constraint i. Compute new optimal result. */
-				const Vector3 tempResult = result;
+		for (size_t i = findViolatedPlane(planes, 0, planes.size(), result, 0.0f); i < planes.size(); i = findViolatedPlane(planes, i + 1, planes.size(), result, 0.0f)) {
+			/* Result does not satisfy constraint i. Compute new optimal result. */
+			const Vector3 tempResult = result;
 
-				if (!linearProgram2(planes, i, radius, optVelocity, directionOpt, result)) {
-					result = tempResult;
-					return i;
-				}
+			if (!linearProgram2(planes, i, radius, optVelocity, directionOpt, result)) {
+				result = tempResult;
+				return i;
 			}
 		}
 
 		return planes.size();
 	}
 
-	void linearProgram4(const std::vector<Plane> &planes, size_t beginPlane, float radius, Vector3 &result)
+	void linearProgram4(const PlaneBuffer &planes, size_t numObstPlanes, size_t beginPlane, float radius, PlaneBuffer &projPlanes, Vector3 &result)
 	{
 		float distance = 0.0f;
 
-		for (size_t i = beginPlane; i < planes.size(); ++i) {
-			if (planes[i].normal * (planes[i].point - result) > distance) {
-				/* Result does not satisfy constraint of plane i. */
-				std::vector<Plane> projPlanes;
-
-				for (size_t j = 0; j < i; ++j) {
-					Plane plane;
-
-					const Vector3 crossProduct = cross(planes[j].normal, planes[i].normal);
-
-					if (absSq(crossProduct) <= RVO_EPSILON) {
-						/* Plane i and plane j are (almost) parallel. */
-						if (planes[i].normal * planes[j].normal > 0.0f) {
-							/* Plane i and plane j point in the same direction. */
-							continue;
-						}
-						else {
-							/* Plane i and plane j point in opposite direction. */
-							plane.point = 0.5f * (planes[i].point + planes[j].point);
-						}
+		for (size_t i = findViolatedPlane(planes, beginPlane, planes.size(), result, distance); i < planes.size(); i = findViolatedPlane(planes, i + 1, planes.size(), result, distance)) {
+			/* Result does not satisfy constraint of plane i. */
+			projPlanes.clear();
+
+			for (size_t j = 0; j < numObstPlanes; ++j) {
+				projPlanes.push_back(planes[j]);
+			}
+
+			for (size_t j = numObstPlanes; j < i; ++j) {
+				Plane plane;
+
+				const Vector3 crossProduct = cross(planes[j].normal, planes[i].normal);
+
+				if (absSq(crossProduct) <= RVO_EPSILON) {
+					/* Plane i and plane j are (almost) parallel. */
+					if (planes[i].normal * planes[j].normal > 0.0f) {
+						/* Plane i and plane j point in the same direction. */
+						continue;
 					}
 					else {
-						/* Plane.point is point on line of intersection between plane i and plane j. */
-						const Vector3 lineNormal = cross(crossProduct, planes[i].normal);
-						plane.point = planes[i].point + (((planes[j].point - planes[i].point) * planes[j].normal) / (lineNormal * planes[j].normal)) * lineNormal;
+						/* Plane i and plane j point in opposite direction. */
+						plane.point = 0.5f * (planes[i].point + planes[j].point);
 					}
-
-					plane.normal = normalize(planes[j].normal - planes[i].normal);
-					projPlanes.push_back(plane);
+				}
+				else {
+					/* Plane.point is point on line of intersection between plane i and plane j. */
+					const Vector3 lineNormal = cross(crossProduct, planes[i].normal);
+					plane.point = planes[i].point + (((planes[j].point - planes[i].point) * planes[j].normal) / (lineNormal * planes[j].normal)) * lineNormal;
 				}
 
-				const Vector3 tempResult = result;
+				plane.normal = normalize(planes[j].normal - planes[i].normal);
+				projPlanes.push_back(plane);
+			}
 
-				if (linearProgram3(projPlanes, radius, planes[i].normal, true, result) < projPlanes.size()) {
-					/* This should in principle not happen.  The result is by definition already in the feasible region of this linear program. If it fails, it is due to small floating point error, and the current result is kept. */
-					result = tempResult;
-				}
+			const Vector3 tempResult = result;
 
-				distance = planes[i].normal * (planes[i].point - result);
+			if (linearProgram3(projPlanes, radius, planes[i].normal, true, result) < projPlanes.size()) {
+				/* This should in principle not happen.  The result is by definition already in the feasible region of this linear program. If it fails, it is due to small floating point error, and the current result is kept. */
+				result = tempResult;
 			}
+
+			distance = planes[i].normal * (planes[i].point - result);
 		}
 	}
 }
@@ -43,10 +43,14 @@
 #include <utility>
 #include <vector>
 
+#include "AgentNeighborBuffer.h"
+#include "PlaneBuffer.h"
 #include "RVOSimulator.h"
 #include "Vector3.h"
 
 namespace RVO {
+	class Obstacle;
+
 	/**
 	 * \brief   Defines an agent in the simulation.
 	 */
@@ -65,15 +69,33 @@ namespace RVO {
 
 		/**
 		 * \brief   Computes the new velocity of this agent.
+		 * \param   projPlanes  A reference to a buffer for the planes projected by the four-dimensional linear program, which the calling thread reuses.
 		 */
-		void computeNewVelocity();
+		void computeNewVelocity(PlaneBuffer &projPlanes);
 
 		/**
 		 * \brief   Inserts an agent neighbor into the set of neighbors of this agent.
 		 * \param   agent    A pointer to the agent to be inserted.
+		 * \param   distSq   The squared distance between this agent and the agent to be inserted.
 		 * \param   rangeSq  The squared range around this agent.
 		 */
-		void insertAgentNeighbor(const Agent *agent, float &rangeSq);
+		void insertAgentNeighbor(const Agent *agent, float distSq, float &rangeSq);
+
+		/**
+		 * \brief   Inserts a static obstacle neighbor into the set of neighbors of this agent and creates its ORCA plane, unless its velocity obstacle is covered by the obstacle ORCA planes created before.
+		 * \param   obstacle  A pointer to the static obstacle triangle to be inserted.
+		 * \param   point     The point of the static obstacle triangle nearest to this agent.
+		 * \param   distSq    The squared distance between this agent and the static obstacle triangle.
+		 */
+		void insertObstacleNeighbor(const Obstacle *obstacle, const Vector3 &point, float distSq);
+
+		/**
+		 * \brief   Returns whether the velocity obstacles of all static points within a bounding box lie on the forbidden side of one of the ORCA planes of this agent, so that the points need not be avoided.
+		 * \param   minCoord  The minimum coordinates of the bounding box.
+		 * \param   maxCoord  The maximum coordinates of the bounding box.
+		 * \return  True if the bounding box is covered.
+		 */
+		bool isObstacleCovered(const float *minCoord, const float *maxCoord) const;
 
 		/**
 		 * \brief   Updates the three-dimensional position and three-dimensional velocity of this agent.
@@ -87,6 +109,19 @@ namespace RVO {
 		 */
 		Vector3 applyDirectionalSpeedLimits(const Vector3 &velocity);
 
+		/**
+		 * \brief   Returns the factor by which squared vertical distances are scaled in the neighbor metric of this agent.
+		 * \return  The squared ratio of the neighbor distance to the vertical neighbor distance, or one if the vertical neighbor distance is zero.
+		 */
+		float computeNeighborVerticalWeight() const;
+
+		/**
+		 * \brief   Returns whether the ORCA plane of an agent neighbor cannot constrain the new velocity of this agent.
+		 * \param   agent  A pointer to the agent neighbor.
+		 * \return  True if every velocity up to the maximum speed of this agent lies in the half-space permitted by the ORCA plane.
+		 */
+		bool isAgentNeighborCulled(const Agent *agent) const;
+
 		/**
 		 * \brief   Computes adaptive preferred velocity for goal proximity situations.
 		 * \return  The adaptive preferred velocity vector.
@@ -98,16 +133,13 @@ namespace RVO {
 		 */
 		void applyAggressiveMotionCorrection();
 
-		Vector3 newVelocity_;
-		Vector3 position_;
-		Vector3 prefVelocity_;
-		Vector3 velocity_;
+		Vector3 candidatePosition_;
 		RVOSimulator *sim_;
 		size_t id_;
 		size_t maxNeighbors_;
-		float maxSpeed_;
+		size_t slot_;
 		float neighborDist_;
-		float radius_;
+		float verticalNeighborDist_;
 		float timeHorizon_;
 		float maxAcceleration_;
 		float maxDeceleration_;
@@ -120,10 +152,18 @@ namespace RVO {
 		
 		// 収束改善用のインスタンス変数
 		int consecutiveLowMotionSteps_;    // 低速状態の連続ステップ数（各エージェント独立）
-		std::vector<std::pair<float, const Agent *> > agentNeighbors_;
-		std::vector<Plane> orcaPlanes_;
+		double candidateDisplacement_;
+		size_t candidateEpoch_;
+		std::vector<const Agent *> neighborCandidates_;
+		AgentNeighborBuffer agentNeighbors_;
+		std::vector<std::pair<float, const Obstacle *> > obstacleNeighbors_;
+		std::vector<float> obstacleThresholds_;
+		PlaneBuffer orcaPlanes_;
 
+		friend class AgentStore;
+		friend class HashGrid;
 		friend class KdTree;
+		friend class ObstacleTree;
 		friend class RVOSimulator;
 	};
 }
@@ -0,0 +1,195 @@
+/*
+ * AgentNeighborBuffer.h
+ * RVO2-3D Library
+ *
+ * Copyright 2008 University of North Carolina at Chapel Hill
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Please send all bug reports to <geom@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Jur van den Berg, Stephen J. Guy, Jamie Snape, Ming C. Lin, Dinesh Manocha
+ * Dept. of Computer Science
+ * 201 S. Columbia St.
+ * Frederick P. Brooks, Jr. Computer Science Bldg.
+ * Chapel Hill, N.C. 27599-3175
+ * United States of America
+ *
+ * <http://gamma.cs.unc.edu/RVO2/>
+ */
+/**
+ * \file    AgentNeighborBuffer.h
+ * \brief   Contains the AgentNeighbor and AgentNeighborBuffer classes.
+ */
+#ifndef RVO_AGENT_NEIGHBOR_BUFFER_H_
+#define RVO_AGENT_NEIGHBOR_BUFFER_H_
+
+#include "API.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <stdint.h>
+
+namespace RVO {
+	/**
+	 * \brief   The number of agent neighbors that an agent neighbor buffer holds without a heap allocation.
+	 */
+	const size_t RVO_INLINE_AGENT_NEIGHBORS = 16;
+
+	/**
+	 * \brief   Defines an agent neighbor of an agent.
+	 */
+	class AgentNeighbor {
+	public:
+		/**
+		 * \brief   The squared distance between the agent and the agent neighbor.
+		 */
+		float distSq;
+
+		/**
+		 * \brief   The slot of the agent neighbor in the agent store.
+		 */
+		uint32_t slot;
+	};
+
+	/**
+	 * \brief   Defines a sequence of agent neighbors with a fixed capacity, which is stored within the buffer up to a small number of agent neighbors.
+	 */
+	class AgentNeighborBuffer {
+	public:
+		/**
+		 * \brief   Constructs an empty agent neighbor buffer instance.
+		 */
+		AgentNeighborBuffer() : neighbors_(inlineNeighbors_), capacity_(RVO_INLINE_AGENT_NEIGHBORS), size_(0) { }
+
+		/**
+		 * \brief   Destroys this agent neighbor buffer instance.
+		 */
+		~AgentNeighborBuffer()
+		{
+			if (neighbors_ != inlineNeighbors_) {
+				delete[] neighbors_;
+			}
+		}
+
+		/**
+		 * \brief   Returns the agent neighbor at the specified position.
+		 * \param   neighborNo  The position of the agent neighbor.
+		 * \return  A reference to the agent neighbor.
+		 */
+		inline AgentNeighbor &operator[](size_t neighborNo)
+		{
+			return neighbors_[neighborNo];
+		}
+
+		/**
+		 * \brief   Returns the agent neighbor at the specified position.
+		 * \param   neighborNo  The position of the agent neighbor.
+		 * \return  A reference to the agent neighbor.
+		 */
+		inline const AgentNeighbor &operator[](size_t neighborNo) const
+		{
+			return neighbors_[neighborNo];
+		}
+
+		/**
+		 * \brief   Replaces the agent neighbors with a sequence of agent neighbors, which must fit into the capacity.
+		 * \param   begin  A pointer to the first agent neighbor of the sequence.
+		 * \param   end    A pointer past the last agent neighbor of the sequence.
+		 */
+		inline void assign(const AgentNeighbor *begin, const AgentNeighbor *end)
+		{
+			std::copy(begin, end, neighbors_);
+			size_ = static_cast<size_t>(end - begin);
+		}
+
+		/**
+		 * \brief   Returns the last agent neighbor.
+		 * \return  A reference to the last agent neighbor.
+		 */
+		inline const AgentNeighbor &back() const
+		{
+			return neighbors_[size_ - 1];
+		}
+
+		/**
+		 * \brief   Removes all agent neighbors.
+		 */
+		inline void clear()
+		{
+			size_ = 0;
+		}
+
+		/**
+		 * \brief   Appends an agent neighbor, which must fit into the capacity.
+		 * \param   neighbor  The agent neighbor.
+		 */
+		inline void push_back(const AgentNeighbor &neighbor)
+		{
+			neighbors_[size_++] = neighbor;
+		}
+
+		/**
+		 * \brief   Ensures that the capacity is at least the specified number of agent neighbors, keeping the agent neighbors.
+		 * \param   capacity  The number of agent neighbors.
+		 */
+		inline void reserve(size_t capacity)
+		{
+			if (capacity > capacity_) {
+				AgentNeighbor *const neighbors = new AgentNeighbor[capacity];
+				std::copy(neighbors_, neighbors_ + size_, neighbors);
+
+				if (neighbors_ != inlineNeighbors_) {
+					delete[] neighbors_;
+				}
+
+				neighbors_ = neighbors;
+				capacity_ = capacity;
+			}
+		}
+
+		/**
+		 * \brief   Removes the agent neighbors past the specified number of agent neighbors, which must not exceed the number of agent neighbors.
+		 * \param   size  The number of agent neighbors.
+		 */
+		inline void resize(size_t size)
+		{
+			size_ = size;
+		}
+
+		/**
+		 * \brief   Returns the number of agent neighbors.
+		 * \return  The number of agent neighbors.
+		 */
+		inline size_t size() const
+		{
+			return size_;
+		}
+
+	private:
+		/* Not implemented. */
+		AgentNeighborBuffer(const AgentNeighborBuffer &other);
+
+		/* Not implemented. */
+		AgentNeighborBuffer &operator=(const AgentNeighborBuffer &other);
+
+		AgentNeighbor *neighbors_;
+		size_t capacity_;
+		size_t size_;
+		AgentNeighbor inlineNeighbors_[RVO_INLINE_AGENT_NEIGHBORS];
+	};
+}
+
+#endif /* RVO_AGENT_NEIGHBOR_BUFFER_H_ */
@@ -0,0 +1,140 @@
+/*
+ * AgentStore.cpp
+ * RVO2-3D Library
+ *
+ * Copyright 2008 University of North Carolina at Chapel Hill
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Please send all bug reports to <geom@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Jur van den Berg, Stephen J. Guy, Jamie Snape, Ming C. Lin, Dinesh Manocha
+ * Dept. of Computer Science
+ * 201 S. Columbia St.
+ * Frederick P. Brooks, Jr. Computer Science Bldg.
+ * Chapel Hill, N.C. 27599-3175
+ * United States of America
+ *
+ * <http://gamma.cs.unc.edu/RVO2/>
+ */
+
+#include "AgentStore.h"
+
+#include "Agent.h"
+
+namespace RVO {
+	AgentStore::AgentStore() { }
+
+	void AgentStore::addAgent(Agent *agent, const Vector3 &position, const Vector3 &velocity, float radius, float maxSpeed)
+	{
+		agent->slot_ = agents_.size();
+
+		agents_.push_back(agent);
+		newVelocities_.push_back(Vector3());
+		positions_.push_back(position);
+		prefVelocities_.push_back(Vector3());
+		velocities_.push_back(velocity);
+		maxSpeeds_.push_back(maxSpeed);
+		radii_.push_back(radius);
+	}
+
+	void AgentStore::removeAgent(const Agent *agent)
+	{
+		const size_t slot = agent->slot_;
+		const size_t last = agents_.size() - 1;
+
+		/* The agent neighbors refer to their slots, so the neighbors in the removed slot are dropped and those in the last slot follow it into the removed slot. */
+		for (size_t i = 0; i < agents_.size(); ++i) {
+			if (i != slot) {
+				AgentNeighborBuffer &neighbors = agents_[i]->agentNeighbors_;
+				size_t numNeighbors = 0;
+
+				for (size_t j = 0; j < neighbors.size(); ++j) {
+					if (neighbors[j].slot != slot) {
+						neighbors[numNeighbors] = neighbors[j];
+
+						if (neighbors[numNeighbors].slot == last) {
+							neighbors[numNeighbors].slot = static_cast<uint32_t>(slot);
+						}
+
+						++numNeighbors;
+					}
+				}
+
+				neighbors.resize(numNeighbors);
+			}
+		}
+
+		agents_[slot] = agents_[last];
+		agents_[slot]->slot_ = slot;
+		newVelocities_[slot] = newVelocities_[last];
+		positions_[slot] = positions_[last];
+		prefVelocities_[slot] = prefVelocities_[last];
+		velocities_[slot] = velocities_[last];
+		maxSpeeds_[slot] = maxSpeeds_[last];
+		radii_[slot] = radii_[last];
+
+		agents_.pop_back();
+		newVelocities_.pop_back();
+		positions_.pop_back();
+		prefVelocities_.pop_back();
+		velocities_.pop_back();
+		maxSpeeds_.pop_back();
+		radii_.pop_back();
+	}
+
+	void AgentStore::reorderAgents(const std::vector<Agent *> &agents)
+	{
+		/* The agent neighbors refer to their slots, which are translated to the new order, so that the neighbors found in the last simulation step remain valid. */
+		slotBuffer_.resize(agents.size());
+
+		for (size_t i = 0; i < agents.size(); ++i) {
+			slotBuffer_[agents[i]->slot_] = static_cast<uint32_t>(i);
+		}
+
+		for (size_t i = 0; i < agents.size(); ++i) {
+			AgentNeighborBuffer &neighbors = agents[i]->agentNeighbors_;
+
+			for (size_t j = 0; j < neighbors.size(); ++j) {
+				neighbors[j].slot = slotBuffer_[neighbors[j].slot];
+			}
+		}
+
+		reorderValues(newVelocities_, agents, vectorBuffer_);
+		reorderValues(positions_, agents, vectorBuffer_);
+		reorderValues(prefVelocities_, agents, vectorBuffer_);
+		reorderValues(velocities_, agents, vectorBuffer_);
+		reorderValues(maxSpeeds_, agents, floatBuffer_);
+		reorderValues(radii_, agents, floatBuffer_);
+
+		agents_ = agents;
+
+		for (size_t i = 0; i < agents_.size(); ++i) {
+			agents_[i]->slot_ = i;
+		}
+	}
+
+	template <typename T>
+	void AgentStore::reorderValues(std::vector<T> &values, const std::vector<Agent *> &agents, std::vector<T> &buffer)
+	{
+		buffer.resize(values.size());
+
+		for (size_t i = 0; i < agents.size(); ++i) {
+			buffer[i] = values[agents[i]->slot_];
+		}
+
+		values.swap(buffer);
+	}
+}
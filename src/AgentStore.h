@@ -0,0 +1,112 @@
+/*
+ * AgentStore.h
+ * RVO2-3D Library
+ *
+ * Copyright 2008 University of North Carolina at Chapel Hill
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Please send all bug reports to <geom@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Jur van den Berg, Stephen J. Guy, Jamie Snape, Ming C. Lin, Dinesh Manocha
+ * Dept. of Computer Science
+ * 201 S. Columbia St.
+ * Frederick P. Brooks, Jr. Computer Science Bldg.
+ * Chapel Hill, N.C. 27599-3175
+ * United States of America
+ *
+ * <http://gamma.cs.unc.edu/RVO2/>
+ */
+/**
+ * \file    AgentStore.h
+ * \brief   Contains the AgentStore class.
+ */
+#ifndef RVO_AGENT_STORE_H_
+#define RVO_AGENT_STORE_H_
+
+#include "API.h"
+
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+#include "Vector3.h"
+
+namespace RVO {
+	class Agent;
+
+	/**
+	 * \brief   Defines the storage of the state of the agents in the simulation that each simulation step reads and writes.
+	 *
+	 * The state of each agent lives at the slot of the agent in one contiguous array per quantity. The slots are kept in the order of the leaves of the agent <i>k</i>d-tree, so that agents near each other in space are also near each other in memory, and a simulation step that visits the agents in the order of their slots streams through the arrays.
+	 */
+	class AgentStore {
+	private:
+		/**
+		 * \brief   Constructs an agent store instance.
+		 */
+		AgentStore();
+
+		/**
+		 * \brief   Adds an agent to the end of the agent store and sets its slot.
+		 * \param   agent     A pointer to the agent.
+		 * \param   position  The position of the agent.
+		 * \param   velocity  The velocity of the agent.
+		 * \param   radius    The radius of the agent.
+		 * \param   maxSpeed  The maximum speed of the agent.
+		 */
+		void addAgent(Agent *agent, const Vector3 &position, const Vector3 &velocity, float radius, float maxSpeed);
+
+		/**
+		 * \brief   Removes an agent from the agent store by moving the agent in the last slot into its slot, and drops it from the agent neighbors of the other agents.
+		 * \param   agent  A pointer to the agent.
+		 */
+		void removeAgent(const Agent *agent);
+
+		/**
+		 * \brief   Permutes the slots of the agent store into the order of a sequence of all its agents and updates the slots of the agents.
+		 * \param   agents  The agents of the agent store in their new order.
+		 */
+		void reorderAgents(const std::vector<Agent *> &agents);
+
+		/**
+		 * \brief   Permutes an array of the agent store into the order of a sequence of its agents.
+		 * \param   values  A reference to the array.
+		 * \param   agents  The agents in their new order.
+		 * \param   buffer  A reference to a buffer that receives the old array.
+		 */
+		template <typename T>
+		static void reorderValues(std::vector<T> &values, const std::vector<Agent *> &agents, std::vector<T> &buffer);
+
+		std::vector<Agent *> agents_;
+		std::vector<Vector3> newVelocities_;
+		std::vector<Vector3> positions_;
+		std::vector<Vector3> prefVelocities_;
+		std::vector<Vector3> velocities_;
+		std::vector<float> maxSpeeds_;
+		std::vector<float> radii_;
+		std::vector<Vector3> vectorBuffer_;
+		std::vector<float> floatBuffer_;
+		std::vector<uint32_t> slotBuffer_;
+
+		friend class Agent;
+		friend class HashGrid;
+		friend class KdTree;
+		friend class ObstacleTree;
+		friend class RVOSimulator;
+	};
+}
+
+#endif /* RVO_AGENT_STORE_H_ */
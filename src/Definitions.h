@@ -40,7 +40,14 @@
 
 #include "API.h"
 
+#include "Vector3.h"
+
 namespace RVO {
+	/**
+	 * \brief   A sufficiently small positive number.
+	 */
+	const float RVO_EPSILON = 0.00001f;
+
 	/**
 	 * \brief   Computes the square of a float.
 	 * \param   scalar  The float to be squared.
@@ -50,6 +57,17 @@ namespace RVO {
 	{
 		return scalar * scalar;
 	}
+
+	/**
+	 * \brief   Computes the squared length of a three-dimensional vector whose vertical component is weighted, as in the neighbor metric of an agent.
+	 * \param   vector          The three-dimensional vector.
+	 * \param   verticalWeight  The factor by which the square of the vertical component is scaled.
+	 * \return  The weighted squared length, which is the squared length for a weight of one.
+	 */
+	inline float absSqWeighted(const Vector3 &vector, float verticalWeight)
+	{
+		return vector.x() * vector.x() + vector.y() * vector.y() + verticalWeight * (vector.z() * vector.z());
+	}
 }
 
 #endif /* RVO_DEFINITIONS_H_ */
@@ -0,0 +1,287 @@
+/*
+ * HashGrid.cpp
+ * RVO2-3D Library
+ *
+ * Copyright 2008 University of North Carolina at Chapel Hill
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Please send all bug reports to <geom@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Jur van den Berg, Stephen J. Guy, Jamie Snape, Ming C. Lin, Dinesh Manocha
+ * Dept. of Computer Science
+ * 201 S. Columbia St.
+ * Frederick P. Brooks, Jr. Computer Science Bldg.
+ * Chapel Hill, N.C. 27599-3175
+ * United States of America
+ *
+ * <http://gamma.cs.unc.edu/RVO2/>
+ */
+
+#include "HashGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Agent.h"
+#include "AgentStore.h"
+#include "Definitions.h"
+#include "RVOSimulator.h"
+
+namespace RVO {
+	/**
+	 * \brief   The maximum number of grid cells a neighbor query visits one by one. Queries covering more cells test all agents.
+	 */
+	const size_t RVO_MAX_QUERY_CELLS = 64;
+
+	/**
+	 * \brief   Returns whether a point lies within an axis-aligned box.
+	 * \param   point     The point.
+	 * \param   minCoord  The minimum coordinates of the box.
+	 * \param   maxCoord  The maximum coordinates of the box.
+	 * \return  True if the point lies within the box.
+	 */
+	inline bool isInBox(const Vector3 &point, const Vector3 &minCoord, const Vector3 &maxCoord)
+	{
+		return point.x() >= minCoord.x() && point.x() <= maxCoord.x() && point.y() >= minCoord.y() && point.y() <= maxCoord.y() && point.z() >= minCoord.z() && point.z() <= maxCoord.z();
+	}
+
+	HashGrid::HashGrid(RVOSimulator *sim) : invCellSize_(1.0f), maxAgentRadius_(0.0f), sim_(sim) { }
+
+	void HashGrid::build()
+	{
+		const AgentStore &store = *sim_->agentStore_;
+		const std::vector<Agent *> &agents = sim_->agents_;
+
+		float cellSize = 0.0f;
+		maxAgentRadius_ = 0.0f;
+
+		for (size_t i = 0; i < agents.size(); ++i) {
+			cellSize = std::max(cellSize, agents[i]->neighborDist_);
+			maxAgentRadius_ = std::max(maxAgentRadius_, store.radii_[agents[i]->slot_]);
+		}
+
+		/* Neighbor lists with a skin query beyond the neighbor distance. */
+		cellSize += sim_->neighborSkin_;
+
+		invCellSize_ = cellSize > 0.0f ? 1.0f / cellSize : 1.0f;
+
+		size_t numBuckets = 1;
+
+		while (numBuckets < agents.size()) {
+			numBuckets *= 2;
+		}
+
+		bucketBegins_.assign(numBuckets + 1, 0);
+		agentBuckets_.resize(agents.size());
+		agents_.resize(agents.size());
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+		for (int i = 0; i < static_cast<int>(agents.size()); ++i) {
+			const Vector3 &position = store.positions_[agents[i]->slot_];
+			agentBuckets_[i] = computeBucket(computeCellCoord(position.x()), computeCellCoord(position.y()), computeCellCoord(position.z()));
+		}
+
+		/* Counting sort of the agents by bucket. */
+		for (size_t i = 0; i < agents.size(); ++i) {
+			++bucketBegins_[agentBuckets_[i]];
+		}
+
+		size_t begin = 0;
+
+		for (size_t i = 0; i < numBuckets; ++i) {
+			const size_t count = bucketBegins_[i];
+			bucketBegins_[i] = begin;
+			begin += count;
+		}
+
+		for (size_t i = 0; i < agents.size(); ++i) {
+			agents_[bucketBegins_[agentBuckets_[i]]++] = agents[i];
+		}
+
+		/* Each bucket beginning has advanced to the beginning of the next bucket. */
+		for (size_t i = numBuckets; i > 0; --i) {
+			bucketBegins_[i] = bucketBegins_[i - 1];
+		}
+
+		bucketBegins_[0] = 0;
+	}
+
+	void HashGrid::computeAgentNeighbors(Agent *agent, float rangeSq) const
+	{
+		queryAgents(sim_->agentStore_->positions_[agent->slot_], rangeSq, *agent, agent->computeNeighborVerticalWeight());
+	}
+
+	void HashGrid::computeAgentNeighborCandidates(Agent *agent, float rangeSq) const
+	{
+		AgentRangeCollector collector(agent, agent->neighborCandidates_);
+		queryAgents(sim_->agentStore_->positions_[agent->slot_], rangeSq, collector, 1.0f);
+	}
+
+	void HashGrid::computeAgentsInRange(const Vector3 &point, float rangeSq, std::vector<const Agent *> &agents) const
+	{
+		AgentRangeCollector collector(NULL, agents);
+		queryAgents(point, rangeSq, collector, 1.0f);
+	}
+
+	void HashGrid::computeAgentsInBox(const Vector3 &minCoord, const Vector3 &maxCoord, std::vector<const Agent *> &agents) const
+	{
+		const AgentStore &store = *sim_->agentStore_;
+		size_t buckets[RVO_MAX_QUERY_CELLS];
+		const size_t numBuckets = computeBuckets(minCoord, maxCoord, buckets);
+
+		if (numBuckets == RVO_ERROR) {
+			for (size_t i = 0; i < agents_.size(); ++i) {
+				if (isInBox(store.positions_[agents_[i]->slot_], minCoord, maxCoord)) {
+					agents.push_back(agents_[i]);
+				}
+			}
+
+			return;
+		}
+
+		for (size_t i = 0; i < numBuckets; ++i) {
+			for (size_t j = bucketBegins_[buckets[i]]; j < bucketBegins_[buckets[i] + 1]; ++j) {
+				if (isInBox(store.positions_[agents_[j]->slot_], minCoord, maxCoord)) {
+					agents.push_back(agents_[j]);
+				}
+			}
+		}
+	}
+
+	size_t HashGrid::computeNearestAgents(const Vector3 &point, float rangeSq, size_t maxAgents, std::pair<float, const Agent *> *neighbors) const
+	{
+		if (maxAgents == 0) {
+			return 0;
+		}
+
+		NearestAgentCollector collector(maxAgents, neighbors);
+		queryAgents(point, rangeSq, collector, 1.0f);
+
+		return collector.numNeighbors;
+	}
+
+	bool HashGrid::queryVisibility(const Vector3 &point1, const Vector3 &point2, float radius) const
+	{
+		const AgentStore &store = *sim_->agentStore_;
+		const float padding = radius + maxAgentRadius_;
+		const Vector3 minCoord(std::min(point1.x(), point2.x()) - padding, std::min(point1.y(), point2.y()) - padding, std::min(point1.z(), point2.z()) - padding);
+		const Vector3 maxCoord(std::max(point1.x(), point2.x()) + padding, std::max(point1.y(), point2.y()) + padding, std::max(point1.z(), point2.z()) + padding);
+
+		size_t buckets[RVO_MAX_QUERY_CELLS];
+		const size_t numBuckets = computeBuckets(minCoord, maxCoord, buckets);
+
+		if (numBuckets == RVO_ERROR) {
+			for (size_t i = 0; i < agents_.size(); ++i) {
+				if (blocksVisibility(point1, point2, radius, store.positions_[agents_[i]->slot_], store.radii_[agents_[i]->slot_])) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		for (size_t i = 0; i < numBuckets; ++i) {
+			for (size_t j = bucketBegins_[buckets[i]]; j < bucketBegins_[buckets[i] + 1]; ++j) {
+				if (blocksVisibility(point1, point2, radius, store.positions_[agents_[j]->slot_], store.radii_[agents_[j]->slot_])) {
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	template <typename Collector>
+	void HashGrid::queryAgents(const Vector3 &point, float &rangeSq, Collector &collector, float verticalWeight) const
+	{
+		const AgentStore &store = *sim_->agentStore_;
+		const float range = std::sqrt(rangeSq);
+		const float verticalRange = range / std::sqrt(verticalWeight);
+
+		size_t buckets[RVO_MAX_QUERY_CELLS];
+		const size_t numBuckets = computeBuckets(point - Vector3(range, range, verticalRange), point + Vector3(range, range, verticalRange), buckets);
+
+		if (numBuckets == RVO_ERROR) {
+			for (size_t i = 0; i < agents_.size(); ++i) {
+				collector.insertAgentNeighbor(agents_[i], absSqWeighted(point - store.positions_[agents_[i]->slot_], verticalWeight), rangeSq);
+			}
+
+			return;
+		}
+
+		for (size_t i = 0; i < numBuckets; ++i) {
+			for (size_t j = bucketBegins_[buckets[i]]; j < bucketBegins_[buckets[i] + 1]; ++j) {
+				collector.insertAgentNeighbor(agents_[j], absSqWeighted(point - store.positions_[agents_[j]->slot_], verticalWeight), rangeSq);
+			}
+		}
+	}
+
+	size_t HashGrid::computeBuckets(const Vector3 &minCoord, const Vector3 &maxCoord, size_t *buckets) const
+	{
+		int minCell[3];
+		int maxCell[3];
+		size_t numCells = 1;
+
+		for (size_t i = 0; i < 3; ++i) {
+			/* Reject large boxes before their grid coordinates can overflow. */
+			if ((maxCoord[i] - minCoord[i]) * invCellSize_ > static_cast<float>(RVO_MAX_QUERY_CELLS)) {
+				return RVO_ERROR;
+			}
+
+			minCell[i] = computeCellCoord(minCoord[i]);
+			maxCell[i] = computeCellCoord(maxCoord[i]);
+
+			if (maxCell[i] < minCell[i]) {
+				return 0;
+			}
+
+			numCells *= static_cast<size_t>(maxCell[i] - minCell[i] + 1);
+
+			if (numCells > RVO_MAX_QUERY_CELLS) {
+				return RVO_ERROR;
+			}
+		}
+
+		/* Distinct cells may share a bucket, which must be visited only once. */
+		size_t numBuckets = 0;
+
+		for (int x = minCell[0]; x <= maxCell[0]; ++x) {
+			for (int y = minCell[1]; y <= maxCell[1]; ++y) {
+				for (int z = minCell[2]; z <= maxCell[2]; ++z) {
+					buckets[numBuckets++] = computeBucket(x, y, z);
+				}
+			}
+		}
+
+		std::sort(buckets, buckets + numBuckets);
+
+		return static_cast<size_t>(std::unique(buckets, buckets + numBuckets) - buckets);
+	}
+
+	int HashGrid::computeCellCoord(float coord) const
+	{
+		return static_cast<int>(std::floor(coord * invCellSize_));
+	}
+
+	size_t HashGrid::computeBucket(int x, int y, int z) const
+	{
+		const unsigned int hash = (static_cast<unsigned int>(x) * 73856093u) ^ (static_cast<unsigned int>(y) * 19349663u) ^ (static_cast<unsigned int>(z) * 83492791u);
+
+		return static_cast<size_t>(hash) & (bucketBegins_.size() - 2);
+	}
+}
@@ -0,0 +1,164 @@
+/*
+ * HashGrid.h
+ * RVO2-3D Library
+ *
+ * Copyright 2008 University of North Carolina at Chapel Hill
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Please send all bug reports to <geom@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Jur van den Berg, Stephen J. Guy, Jamie Snape, Ming C. Lin, Dinesh Manocha
+ * Dept. of Computer Science
+ * 201 S. Columbia St.
+ * Frederick P. Brooks, Jr. Computer Science Bldg.
+ * Chapel Hill, N.C. 27599-3175
+ * United States of America
+ *
+ * <http://gamma.cs.unc.edu/RVO2/>
+ */
+/**
+ * \file    HashGrid.h
+ * \brief   Contains the HashGrid class.
+ */
+#ifndef RVO_HASH_GRID_H_
+#define RVO_HASH_GRID_H_
+
+#include "API.h"
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "SpatialIndex.h"
+#include "Vector3.h"
+
+namespace RVO {
+	class Agent;
+	class RVOSimulator;
+
+	/**
+	 * \brief   Defines uniform hash grids for agents in the simulation.
+	 *
+	 * The agents are bucketed by the cell of a uniform grid that contains them, with the cells mapped onto a hash table. The cell size is the largest neighbor distance of the agents, so that a neighbor query visits at most 27 cells.
+	 */
+	class HashGrid : public SpatialIndex {
+	public:
+		/**
+		 * \brief   Constructs a hash grid instance.
+		 * \param   sim  The simulator instance.
+		 */
+		explicit HashGrid(RVOSimulator *sim);
+
+		/**
+		 * \brief   Builds an agent hash grid.
+		 */
+		virtual void build();
+
+		/**
+		 * \brief   Computes the agent neighbors of the specified agent.
+		 * \param   agent    A pointer to the agent for which agent neighbors are to be computed.
+		 * \param   rangeSq  The squared range around the agent, in the neighbor metric of the agent.
+		 */
+		virtual void computeAgentNeighbors(Agent *agent, float rangeSq) const;
+
+		/**
+		 * \brief   Computes all agents within range of the specified agent as the candidates for its agent neighbors.
+		 * \param   agent    A pointer to the agent for which the candidates are to be computed.
+		 * \param   rangeSq  The squared range around the agent.
+		 */
+		virtual void computeAgentNeighborCandidates(Agent *agent, float rangeSq) const;
+
+		/**
+		 * \brief   Computes all agents within range of a point.
+		 * \param   point    The point.
+		 * \param   rangeSq  The squared range around the point.
+		 * \param   agents   A reference to the vector to which the agents within range are appended in no particular order.
+		 */
+		virtual void computeAgentsInRange(const Vector3 &point, float rangeSq, std::vector<const Agent *> &agents) const;
+
+		/**
+		 * \brief   Computes all agents within an axis-aligned box.
+		 * \param   minCoord  The minimum coordinates of the box.
+		 * \param   maxCoord  The maximum coordinates of the box.
+		 * \param   agents    A reference to the vector to which the agents within the box are appended in no particular order.
+		 */
+		virtual void computeAgentsInBox(const Vector3 &minCoord, const Vector3 &maxCoord, std::vector<const Agent *> &agents) const;
+
+		/**
+		 * \brief   Computes the agents nearest to a point.
+		 * \param   point      The point.
+		 * \param   rangeSq    The squared range around the point.
+		 * \param   maxAgents  The maximum number of agents to be computed.
+		 * \param   neighbors  An array of at least maxAgents elements that receives the squared distances to and pointers to the nearest agents in order of increasing distance.
+		 * \return  The number of agents computed.
+		 */
+		virtual size_t computeNearestAgents(const Vector3 &point, float rangeSq, size_t maxAgents, std::pair<float, const Agent *> *neighbors) const;
+
+		/**
+		 * \brief   Returns whether a sphere swept along a segment is clear of agents.
+		 * \param   point1  The first point of the segment.
+		 * \param   point2  The second point of the segment.
+		 * \param   radius  The radius of the sphere swept along the segment.
+		 * \return  True if no agent blocks the visibility along the segment, as defined by blocksVisibility().
+		 */
+		virtual bool queryVisibility(const Vector3 &point1, const Vector3 &point2, float radius) const;
+
+	private:
+		/**
+		 * \brief   Passes the agents in the grid cells within range of a point to a collector.
+		 * \param   point           The point.
+		 * \param   rangeSq         The squared range around the point.
+		 * \param   collector       The collector, which provides insertAgentNeighbor(const Agent *agent, float distSq, float &rangeSq).
+		 * \param   verticalWeight  The factor by which squared vertical distances are scaled, which is one for a spherical range.
+		 */
+		template <typename Collector>
+		void queryAgents(const Vector3 &point, float &rangeSq, Collector &collector, float verticalWeight) const;
+
+		/**
+		 * \brief   Computes the distinct buckets of the grid cells that overlap an axis-aligned box.
+		 * \param   minCoord  The minimum coordinates of the box.
+		 * \param   maxCoord  The maximum coordinates of the box.
+		 * \param   buckets   An array of at least RVO_MAX_QUERY_CELLS elements that receives the numbers of the buckets.
+		 * \return  The number of buckets, or RVO_ERROR if the box overlaps too many grid cells to visit them one by one.
+		 */
+		size_t computeBuckets(const Vector3 &minCoord, const Vector3 &maxCoord, size_t *buckets) const;
+
+		/**
+		 * \brief   Computes the grid coordinate of a coordinate.
+		 * \param   coord  The coordinate.
+		 * \return  The grid coordinate.
+		 */
+		int computeCellCoord(float coord) const;
+
+		/**
+		 * \brief   Computes the bucket of a grid cell.
+		 * \param   x  The x-coordinate of the grid cell.
+		 * \param   y  The y-coordinate of the grid cell.
+		 * \param   z  The z-coordinate of the grid cell.
+		 * \return  The number of the bucket.
+		 */
+		size_t computeBucket(int x, int y, int z) const;
+
+		std::vector<Agent *> agents_;
+		std::vector<size_t> agentBuckets_;
+		std::vector<size_t> bucketBegins_;
+		float invCellSize_;
+		float maxAgentRadius_;
+		RVOSimulator *sim_;
+	};
+}
+
+#endif /* RVO_HASH_GRID_H_ */
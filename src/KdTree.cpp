@@ -33,129 +33,1686 @@
 #include "KdTree.h"
 
 #include <algorithm>
+#include <cmath>
+#include <limits>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define RVO_USE_SSE
+#endif
 
 #include "Agent.h"
+#include "AgentStore.h"
 #include "Definitions.h"
 #include "RVOSimulator.h"
 
 namespace RVO {
-	const size_t RVO_MAX_LEAF_SIZE = 10;
+	/**
+	 * \brief   The default maximum number of agents in a leaf node.
+	 */
+	const size_t RVO_DEFAULT_LEAF_SIZE = 10;
+
+	/**
+	 * \brief   The largest configurable maximum number of agents in a leaf node.
+	 */
+	const size_t RVO_MAX_LEAF_SIZE = 64;
+
+	/**
+	 * \brief   The number of agents sampled to estimate the median of a node.
+	 */
+	const size_t RVO_MEDIAN_SAMPLE_SIZE = 33;
+
+	/**
+	 * \brief   The number of bins per axis over which the surface area heuristic of a node is estimated.
+	 */
+	const size_t RVO_SAH_NUM_BINS = 16;
+
+	/**
+	 * \brief   The maximum number of agents of a node binned to estimate its surface area heuristic. Larger nodes are sampled with a constant stride.
+	 */
+	const size_t RVO_SAH_SAMPLE_SIZE = 256;
+
+	/**
+	 * \brief   The minimum number of agents in a subtree for its construction to be deferred to a separate task.
+	 */
+	const size_t RVO_MIN_TASK_SIZE = 1024;
+
+	/**
+	 * \brief   The minimum number of agents in a node for its bounding box and partition to be computed by several tasks.
+	 */
+	const size_t RVO_MIN_PARALLEL_SIZE = 65536;
 
-	KdTree::KdTree(RVOSimulator *sim) : sim_(sim) { }
+	/**
+	 * \brief   The minimum number of nodes in a subtree for its refit to be deferred to a separate task.
+	 */
+	const size_t RVO_MIN_TASK_NODES = 256;
 
-	void KdTree::buildAgentTree()
+	/**
+	 * \brief   The maximum number of deferred nodes of a query of the agent <i>k</i>d-tree before it falls back to recursion.
+	 */
+	const size_t RVO_MAX_QUERY_STACK_SIZE = 64;
+
+	/**
+	 * \brief   The number of subtrees per thread into which the agent <i>k</i>d-tree is divided for the dual-tree search of all agent neighbors.
+	 */
+	const size_t RVO_DUAL_TREE_TASKS_PER_THREAD = 16;
+
+	/**
+	 * \brief   Computes the surface area of a bounding box.
+	 * \param   minCoord  The minimum coordinates.
+	 * \param   maxCoord  The maximum coordinates.
+	 * \return  The surface area of the bounding box.
+	 */
+	inline float surfaceArea(const float *minCoord, const float *maxCoord)
 	{
-		agents_ = sim_->agents_;
+		const float extentX = maxCoord[0] - minCoord[0];
+		const float extentY = maxCoord[1] - minCoord[1];
+		const float extentZ = maxCoord[2] - minCoord[2];
 
-		if (!agents_.empty()) {
-			agentTree_.resize(2 * agents_.size() - 1);
-			buildAgentTreeRecursive(0, agents_.size(), 0);
+		return 2.0f * (extentX * extentY + extentY * extentZ + extentZ * extentX);
+	}
+
+	/**
+	 * \brief   Returns whether work on the specified number of agents should start a parallel region.
+	 * \param   numAgents  The number of agents.
+	 * \return  True if a parallel region should be started.
+	 */
+	inline bool startParallelRegion(size_t numAgents)
+	{
+#ifdef _OPENMP
+		return numAgents > RVO_MIN_TASK_SIZE && omp_get_max_threads() > 1 && !omp_in_parallel();
+#else
+		return false;
+#endif
+	}
+
+	/**
+	 * \brief   Spreads the lower 21 bits of an integer such that two zero bits separate consecutive bits.
+	 * \param   value  The integer.
+	 * \return  The spread integer.
+	 */
+	inline uint64_t spreadBits(uint64_t value)
+	{
+		value &= 0x1fffff;
+		value = (value | value << 32) & 0x1f00000000ffffULL;
+		value = (value | value << 16) & 0x1f0000ff0000ffULL;
+		value = (value | value << 8) & 0x100f00f00f00f00fULL;
+		value = (value | value << 4) & 0x10c30c30c30c30c3ULL;
+		value = (value | value << 2) & 0x1249249249249249ULL;
+
+		return value;
+	}
+
+	/**
+	 * \brief   Computes the squared distances from a point to two bounding boxes at once.
+	 * \param   point           The point, padded with a zero.
+	 * \param   verticalWeight  The factor by which squared vertical distances are scaled.
+	 * \param   minCoord0       The minimum coordinates of the first bounding box, followed by a fourth value that is ignored.
+	 * \param   maxCoord0       The maximum coordinates of the first bounding box, followed by a fourth value that is ignored.
+	 * \param   minCoord1       The minimum coordinates of the second bounding box, followed by a fourth value that is ignored.
+	 * \param   maxCoord1       The maximum coordinates of the second bounding box, followed by a fourth value that is ignored.
+	 * \param   distSq0         A reference to the squared distance to the first bounding box.
+	 * \param   distSq1         A reference to the squared distance to the second bounding box.
+	 */
+	inline void computeDistSqToBoxes(const float *point, float verticalWeight, const float *minCoord0, const float *maxCoord0, const float *minCoord1, const float *maxCoord1, float &distSq0, float &distSq1)
+	{
+#ifdef RVO_USE_SSE
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 p = _mm_loadu_ps(point);
+
+		/* Per axis, at most one of the differences to the minimum and maximum coordinates is positive. */
+		__m128 d0 = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minCoord0), p), _mm_sub_ps(p, _mm_loadu_ps(maxCoord0))), zero);
+		__m128 d1 = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minCoord1), p), _mm_sub_ps(p, _mm_loadu_ps(maxCoord1))), zero);
+		d0 = _mm_mul_ps(d0, d0);
+		d1 = _mm_mul_ps(d1, d1);
+
+		/* Sum the first three lanes of both vectors, weighting the third, leaving the first sum in lane 0 and the second in lane 1. The fourth lanes hold the node indices and are left out. */
+		const __m128 low = _mm_unpacklo_ps(d0, d1);
+		const __m128 sum = _mm_add_ps(_mm_add_ps(low, _mm_movehl_ps(low, low)), _mm_mul_ps(_mm_unpackhi_ps(d0, d1), _mm_set1_ps(verticalWeight)));
+
+		distSq0 = _mm_cvtss_f32(sum);
+		distSq1 = _mm_cvtss_f32(_mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+#else
+		distSq0 = 0.0f;
+		distSq1 = 0.0f;
+
+		for (size_t i = 0; i < 3; ++i) {
+			const float weight = i == 2 ? verticalWeight : 1.0f;
+			distSq0 += weight * sqr(std::max(0.0f, std::max(minCoord0[i] - point[i], point[i] - maxCoord0[i])));
+			distSq1 += weight * sqr(std::max(0.0f, std::max(minCoord1[i] - point[i], point[i] - maxCoord1[i])));
 		}
+#endif
 	}
 
-	void KdTree::buildAgentTreeRecursive(size_t begin, size_t end, size_t node)
+	/**
+	 * \brief   Computes the squared distance between two bounding boxes.
+	 * \param   minCoord0       The minimum coordinates of the first bounding box.
+	 * \param   maxCoord0       The maximum coordinates of the first bounding box.
+	 * \param   minCoord1       The minimum coordinates of the second bounding box.
+	 * \param   maxCoord1       The maximum coordinates of the second bounding box.
+	 * \param   verticalWeight  The factor by which squared vertical distances are scaled.
+	 * \return  The squared distance between the bounding boxes, which is zero if they overlap.
+	 */
+	inline float computeBoxDistSq(const float *minCoord0, const float *maxCoord0, const float *minCoord1, const float *maxCoord1, float verticalWeight)
 	{
-		agentTree_[node].begin = begin;
-		agentTree_[node].end = end;
-		agentTree_[node].minCoord = agents_[begin]->position_;
-		agentTree_[node].maxCoord = agents_[begin]->position_;
+		return sqr(std::max(0.0f, std::max(minCoord1[0] - maxCoord0[0], minCoord0[0] - maxCoord1[0]))) + sqr(std::max(0.0f, std::max(minCoord1[1] - maxCoord0[1], minCoord0[1] - maxCoord1[1]))) + verticalWeight * sqr(std::max(0.0f, std::max(minCoord1[2] - maxCoord0[2], minCoord0[2] - maxCoord1[2])));
+	}
 
-		for (size_t i = begin + 1; i < end; ++i) {
-			agentTree_[node].maxCoord[0] = std::max(agentTree_[node].maxCoord[0], agents_[i]->position_.x());
-			agentTree_[node].minCoord[0] = std::min(agentTree_[node].minCoord[0], agents_[i]->position_.x());
-			agentTree_[node].maxCoord[1] = std::max(agentTree_[node].maxCoord[1], agents_[i]->position_.y());
-			agentTree_[node].minCoord[1] = std::min(agentTree_[node].minCoord[1], agents_[i]->position_.y());
-			agentTree_[node].maxCoord[2] = std::max(agentTree_[node].maxCoord[2], agents_[i]->position_.z());
-			agentTree_[node].minCoord[2] = std::min(agentTree_[node].minCoord[2], agents_[i]->position_.z());
+	/**
+	 * \brief   Computes the squared distances from a point to a range of packed positions.
+	 * \param   point           The point, padded with a zero.
+	 * \param   verticalWeight  The factor by which squared vertical distances are scaled.
+	 * \param   positionsX      The x-coordinates of the positions.
+	 * \param   positionsY      The y-coordinates of the positions.
+	 * \param   positionsZ      The z-coordinates of the positions.
+	 * \param   count           The number of positions.
+	 * \param   distSqs         An array of at least count elements that receives the squared distances.
+	 */
+	inline void computeDistSqs(const float *point, float verticalWeight, const float *positionsX, const float *positionsY, const float *positionsZ, size_t count, float *distSqs)
+	{
+		size_t i = 0;
+
+#ifdef RVO_USE_SSE
+		const __m128 x = _mm_set1_ps(point[0]);
+		const __m128 y = _mm_set1_ps(point[1]);
+		const __m128 z = _mm_set1_ps(point[2]);
+		const __m128 weight = _mm_set1_ps(verticalWeight);
+
+		for (; i + 4 <= count; i += 4) {
+			const __m128 dx = _mm_sub_ps(_mm_loadu_ps(positionsX + i), x);
+			const __m128 dy = _mm_sub_ps(_mm_loadu_ps(positionsY + i), y);
+			const __m128 dz = _mm_sub_ps(_mm_loadu_ps(positionsZ + i), z);
+
+			_mm_storeu_ps(distSqs + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(weight, _mm_mul_ps(dz, dz))));
 		}
+#endif
 
-		if (end - begin > RVO_MAX_LEAF_SIZE) {
-			/* No leaf node. */
-			size_t coord;
+		for (; i < count; ++i) {
+			distSqs[i] = sqr(positionsX[i] - point[0]) + sqr(positionsY[i] - point[1]) + verticalWeight * sqr(positionsZ[i] - point[2]);
+		}
+	}
 
-			if (agentTree_[node].maxCoord[0] - agentTree_[node].minCoord[0] > agentTree_[node].maxCoord[1] - agentTree_[node].minCoord[1] && agentTree_[node].maxCoord[0] - agentTree_[node].minCoord[0] > agentTree_[node].maxCoord[2] - agentTree_[node].minCoord[2]) {
-				coord = 0;
-			}
-			else if (agentTree_[node].maxCoord[1] - agentTree_[node].minCoord[1] > agentTree_[node].maxCoord[2] - agentTree_[node].minCoord[2]) {
-				coord = 1;
+	/**
+	 * \brief   Computes a lower bound on the squared distance between a moving point and the agents of a node over a time horizon.
+	 * \param   point           The point.
+	 * \param   velocity        The velocity of the point.
+	 * \param   timeHorizon     The time horizon.
+	 * \param   minCoord        The minimum coordinates of the bounding box of the node.
+	 * \param   maxCoord        The maximum coordinates of the bounding box of the node.
+	 * \param   minVelocity     The minimum velocity coordinates of the agents of the node.
+	 * \param   maxVelocity     The maximum velocity coordinates of the agents of the node.
+	 * \param   verticalWeight  The factor by which squared vertical distances are scaled.
+	 * \return  The squared distance from the point to the hull of the bounding box at the start and at the end of the time horizon relative to the point.
+	 */
+	inline float computeSweptBoxDistSq(const Vector3 &point, const Vector3 &velocity, float timeHorizon, const float *minCoord, const float *maxCoord, const float *minVelocity, const float *maxVelocity, float verticalWeight)
+	{
+		float distSq = 0.0f;
+
+		for (size_t i = 0; i < 3; ++i) {
+			/* Relative to the point, the bounds of the box move linearly in time, so they are extreme at the start or at the end of the time horizon. */
+			const float lower = minCoord[i] - point[i] + std::min(0.0f, timeHorizon * (minVelocity[i] - velocity[i]));
+			const float upper = maxCoord[i] - point[i] + std::max(0.0f, timeHorizon * (maxVelocity[i] - velocity[i]));
+
+			distSq += (i == 2 ? verticalWeight : 1.0f) * sqr(std::max(0.0f, std::max(lower, -upper)));
+		}
+
+		return distSq;
+	}
+
+	/**
+	 * \brief   Computes the squared distance of closest approach of two points moving at constant velocities over a time horizon.
+	 * \param   relativePosition  The position of the second point relative to the first.
+	 * \param   relativeVelocity  The velocity of the second point relative to the first.
+	 * \param   timeHorizon       The time horizon.
+	 * \param   verticalWeight    The factor by which squared vertical distances are scaled.
+	 * \return  The smallest squared distance between the points between now and the time horizon.
+	 */
+	inline float computeSweptDistSq(const Vector3 &relativePosition, const Vector3 &relativeVelocity, float timeHorizon, float verticalWeight)
+	{
+		const float speedSq = absSqWeighted(relativeVelocity, verticalWeight);
+		const float dotProduct = relativePosition.x() * relativeVelocity.x() + relativePosition.y() * relativeVelocity.y() + verticalWeight * relativePosition.z() * relativeVelocity.z();
+
+		if (dotProduct >= 0.0f || speedSq == 0.0f) {
+			return absSqWeighted(relativePosition, verticalWeight);
+		}
+
+		return absSqWeighted(relativePosition + std::min(-dotProduct / speedSq, timeHorizon) * relativeVelocity, verticalWeight);
+	}
+
+	/**
+	 * \brief   Returns whether a segment intersects a bounding box enlarged on all sides.
+	 * \param   point1    The first point of the segment.
+	 * \param   point2    The second point of the segment.
+	 * \param   minCoord  The minimum coordinates of the bounding box.
+	 * \param   maxCoord  The maximum coordinates of the bounding box.
+	 * \param   padding   The distance by which the bounding box is enlarged.
+	 * \return  True if the segment intersects the enlarged bounding box.
+	 */
+	inline bool intersectsSegment(const Vector3 &point1, const Vector3 &point2, const float *minCoord, const float *maxCoord, float padding)
+	{
+		float tMin = 0.0f;
+		float tMax = 1.0f;
+
+		for (size_t i = 0; i < 3; ++i) {
+			const float delta = point2[i] - point1[i];
+			const float lower = minCoord[i] - padding - point1[i];
+			const float upper = maxCoord[i] + padding - point1[i];
+
+			if (delta == 0.0f) {
+				if (lower > 0.0f || upper < 0.0f) {
+					return false;
+				}
 			}
 			else {
-				coord = 2;
+				float t1 = lower / delta;
+				float t2 = upper / delta;
+
+				if (t1 > t2) {
+					std::swap(t1, t2);
+				}
+
+				tMin = std::max(tMin, t1);
+				tMax = std::min(tMax, t2);
+
+				if (tMin > tMax) {
+					return false;
+				}
 			}
+		}
+
+		return true;
+	}
 
-			const float splitValue = 0.5f * (agentTree_[node].maxCoord[coord] + agentTree_[node].minCoord[coord]);
+	KdTree::KdTree(RVOSimulator *sim) : refit_(false), rebuild_(true), sweep_(false), approximationScale_(1.0f), buildCost_(0.0f), maxAgentRadius_(0.0f), maxNeighborDistSq_(0.0f), minVerticalWeight_(1.0f), rebuildThreshold_(1.5f), leafSize_(RVO_DEFAULT_LEAF_SIZE), buildMethod_(RVO_SPLIT_BUILD), neighborSearch_(RVO_PER_AGENT_SEARCH), splitPolicy_(RVO_MIDPOINT_SPLIT), sim_(sim) { }
 
-			size_t left = begin;
+	void KdTree::build()
+	{
+		if (refit_ && !rebuild_ && !agents_.empty()) {
+			/* Keep the permutation and topology of the previous build and only update the bounding boxes. */
+			float cost = 0.0f;
 
-			size_t right = end;
+			updateAgentPositions();
 
-			while (left < right) {
-				while (left < right && agents_[left]->position_[coord] < splitValue) {
-					++left;
+			if (startParallelRegion(agents_.size())) {
+#ifdef _OPENMP
+#pragma omp parallel
+#pragma omp single nowait
+#endif
+				cost = refitAgentTreeRecursive(0);
+			}
+			else {
+				cost = refitAgentTreeRecursive(0);
+			}
+
+			if (cost <= rebuildThreshold_ * buildCost_) {
+				if (neighborSearch_ == RVO_BOTTOM_UP_SEARCH) {
+					updateAgentCells();
 				}
 
-				while (right > left && agents_[right - 1]->position_[coord] >= splitValue) {
-					--right;
+				if (sweep_) {
+					updateAgentVelocities();
 				}
 
-				if (left < right) {
-					std::swap(agents_[left], agents_[right - 1]);
-					++left;
-					--right;
+				return;
+			}
+		}
+
+		agents_ = sim_->agents_;
+		rebuild_ = false;
+
+		if (!agents_.empty()) {
+			/* Gather the positions of the agents once, so that the build permutes them together with the agents instead of reading them through the agents. */
+			const AgentStore &store = *sim_->agentStore_;
+			buildPositions_.resize(agents_.size());
+
+#ifdef _OPENMP
+#pragma omp parallel for if (agents_.size() > RVO_MIN_TASK_SIZE)
+#endif
+			for (int i = 0; i < static_cast<int>(agents_.size()); ++i) {
+				buildPositions_[i] = store.positions_[agents_[i]->slot_];
+			}
+
+			/* The subtrees are built into the worst-case node layout, in which disjoint ranges of agents map to disjoint ranges of nodes, and then compacted. */
+			size_t numNodes = 0;
+			buildTree_.resize(2 * agents_.size() - 1);
+
+			if (buildMethod_ == RVO_MORTON_BUILD) {
+				sortAgentsByMortonCode();
+
+				if (startParallelRegion(agents_.size())) {
+#ifdef _OPENMP
+#pragma omp parallel
+#pragma omp single nowait
+#endif
+					numNodes = buildMortonTreeRecursive(0, agents_.size(), 0);
+				}
+				else {
+					numNodes = buildMortonTreeRecursive(0, agents_.size(), 0);
 				}
 			}
+			else if (startParallelRegion(agents_.size())) {
+				buildBuffer_.resize(agents_.size());
+				buildPositionBuffer_.resize(agents_.size());
+
+#ifdef _OPENMP
+#pragma omp parallel
+#pragma omp single nowait
+#endif
+				numNodes = buildAgentTreeRecursive(0, agents_.size(), 0);
+			}
+			else {
+				numNodes = buildAgentTreeRecursive(0, agents_.size(), 0);
+			}
 
-			size_t leftSize = left - begin;
+			agentTree_.resize(numNodes);
+			compactAgentTreeRecursive(0, 0, 0);
 
-			if (leftSize == 0) {
-				++leftSize;
-				++left;
-				++right;
+			/* Lay the agent store out in tree order so that the agents of a leaf, and the neighbors an agent finds, are contiguous in memory. */
+			if (sim_->kdTree_ == this) {
+				sim_->agentStore_->reorderAgents(agents_);
+			}
+
+			if (refit_) {
+				buildCost_ = computeAgentTreeCost(0);
+			}
+
+			if (neighborSearch_ == RVO_BOTTOM_UP_SEARCH) {
+				updateAgentLeaves();
+				updateAgentCells();
 			}
+		}
+		else {
+			agentTree_.clear();
+		}
 
-			agentTree_[node].left = node + 1;
-			agentTree_[node].right = node + 2 * leftSize;
+		updateAgentPositions();
 
-			buildAgentTreeRecursive(begin, left, agentTree_[node].left);
-			buildAgentTreeRecursive(left, end, agentTree_[node].right);
+		if (sweep_) {
+			updateAgentVelocities();
 		}
 	}
 
-	void KdTree::computeAgentNeighbors(Agent *agent, float rangeSq) const
+	void KdTree::setApproximation(float epsilon)
 	{
-		queryAgentTreeRecursive(agent, rangeSq, 0);
+		approximationScale_ = 1.0f / sqr(1.0f + std::max(0.0f, epsilon));
 	}
 
-	void KdTree::queryAgentTreeRecursive(Agent *agent, float &rangeSq, size_t node) const
+	void KdTree::setBuildMethod(AgentTreeBuildMethod buildMethod)
 	{
-		if (agentTree_[node].end - agentTree_[node].begin <= RVO_MAX_LEAF_SIZE) {
-			for (size_t i = agentTree_[node].begin; i < agentTree_[node].end; ++i) {
-				agent->insertAgentNeighbor(agents_[i], rangeSq);
-			}
+		buildMethod_ = buildMethod;
+		rebuild_ = true;
+	}
+
+	void KdTree::setLeafSize(size_t leafSize)
+	{
+		leafSize_ = std::max(static_cast<size_t>(1), std::min(leafSize, RVO_MAX_LEAF_SIZE));
+		rebuild_ = true;
+	}
+
+	void KdTree::setNeighborSearch(AgentNeighborSearch neighborSearch)
+	{
+		neighborSearch_ = neighborSearch;
+		rebuild_ = true;
+	}
+
+	void KdTree::setRefit(bool refit, float rebuildThreshold)
+	{
+		refit_ = refit;
+		rebuildThreshold_ = rebuildThreshold;
+		rebuild_ = true;
+	}
+
+	void KdTree::setSplitPolicy(AgentTreeSplitPolicy splitPolicy)
+	{
+		splitPolicy_ = splitPolicy;
+		rebuild_ = true;
+	}
+
+	void KdTree::setSweep(bool sweep)
+	{
+		sweep_ = sweep;
+		rebuild_ = true;
+	}
+
+	size_t KdTree::buildAgentTreeRecursive(size_t begin, size_t end, size_t node)
+	{
+		AgentTreeNode &treeNode = buildTree_[node];
+
+#ifdef _OPENMP
+		const bool parallel = end - begin >= RVO_MIN_PARALLEL_SIZE && omp_in_parallel();
+#else
+		const bool parallel = false;
+#endif
+
+		if (parallel) {
+			computeBoundingBoxParallel(begin, end, treeNode.minCoord, treeNode.maxCoord);
+		}
+		else {
+			computeBoundingBox(begin, end, treeNode.minCoord, treeNode.maxCoord);
+		}
+
+		if (end - begin <= leafSize_) {
+			treeNode.index = static_cast<uint32_t>(begin);
+			treeNode.count = static_cast<uint32_t>(end - begin);
+
+			return 1;
+		}
+
+		/* No leaf node. */
+		size_t coord;
+		float splitValue;
+		chooseSplit(begin, end, treeNode, coord, splitValue);
+
+		size_t left = parallel ? partitionAgentsParallel(begin, end, coord, splitValue) : partitionAgents(begin, end, coord, splitValue);
+
+		/* No split value separates agents at identical positions. Split their range in the middle instead, so that the tree over many coincident agents stays balanced rather than peeling off one agent per level. */
+		if (left == begin || left == end) {
+			left = begin + (end - begin) / 2;
+		}
+
+		const size_t leftSize = left - begin;
+
+		treeNode.index = static_cast<uint32_t>(left);
+		treeNode.count = 0;
+
+		/* The subtrees cover disjoint ranges of agents and nodes, so they may be built concurrently. */
+		size_t leftNodes = 0;
+
+#ifdef _OPENMP
+#pragma omp task shared(leftNodes) if (leftSize >= RVO_MIN_TASK_SIZE && omp_in_parallel())
+#endif
+		leftNodes = buildAgentTreeRecursive(begin, left, node + 1);
+		const size_t rightNodes = buildAgentTreeRecursive(left, end, node + 2 * leftSize);
+
+#ifdef _OPENMP
+#pragma omp taskwait
+#endif
+
+		return 1 + leftNodes + rightNodes;
+	}
+
+	void KdTree::chooseSplit(size_t begin, size_t end, const AgentTreeNode &treeNode, size_t &coord, float &splitValue) const
+	{
+		if (treeNode.maxCoord[0] - treeNode.minCoord[0] > treeNode.maxCoord[1] - treeNode.minCoord[1] && treeNode.maxCoord[0] - treeNode.minCoord[0] > treeNode.maxCoord[2] - treeNode.minCoord[2]) {
+			coord = 0;
+		}
+		else if (treeNode.maxCoord[1] - treeNode.minCoord[1] > treeNode.maxCoord[2] - treeNode.minCoord[2]) {
+			coord = 1;
 		}
 		else {
-			const float distSqLeft = sqr(std::max(0.0f, agentTree_[agentTree_[node].left].minCoord[0] - agent->position_.x())) + sqr(std::max(0.0f, agent->position_.x() - agentTree_[agentTree_[node].left].maxCoord[0])) + sqr(std::max(0.0f, agentTree_[agentTree_[node].left].minCoord[1] - agent->position_.y())) + sqr(std::max(0.0f, agent->position_.y() - agentTree_[agentTree_[node].left].maxCoord[1])) + sqr(std::max(0.0f, agentTree_[agentTree_[node].left].minCoord[2] - agent->position_.z())) + sqr(std::max(0.0f, agent->position_.z() - agentTree_[agentTree_[node].left].maxCoord[2]));
+			coord = 2;
+		}
+
+		splitValue = 0.5f * (treeNode.maxCoord[coord] + treeNode.minCoord[coord]);
+
+		/* The midpoint of an extent of a few units in the last place may round down to the minimum, which would leave the left child empty. */
+		if (!(splitValue > treeNode.minCoord[coord])) {
+			splitValue = treeNode.maxCoord[coord];
+		}
+
+		if (splitPolicy_ == RVO_MEDIAN_SPLIT) {
+			const size_t numSamples = std::min(end - begin, RVO_MEDIAN_SAMPLE_SIZE);
+			float samples[RVO_MEDIAN_SAMPLE_SIZE];
+
+			for (size_t i = 0; i < numSamples; ++i) {
+				samples[i] = buildPositions_[begin + i * (end - begin) / numSamples][coord];
+			}
+
+			std::nth_element(samples, samples + numSamples / 2, samples + numSamples);
+
+			/* A median equal to the minimum would leave the left child empty, so keep the midpoint then. */
+			if (samples[numSamples / 2] > treeNode.minCoord[coord]) {
+				splitValue = samples[numSamples / 2];
+			}
+		}
+		else if (splitPolicy_ == RVO_SAH_SPLIT) {
+			const size_t stride = (end - begin + RVO_SAH_SAMPLE_SIZE - 1) / RVO_SAH_SAMPLE_SIZE;
+			float bestCost = 0.0f;
+			bool found = false;
+
+			for (size_t axis = 0; axis < 3; ++axis) {
+				const float extent = treeNode.maxCoord[axis] - treeNode.minCoord[axis];
 
-			const float distSqRight = sqr(std::max(0.0f, agentTree_[agentTree_[node].right].minCoord[0] - agent->position_.x())) + sqr(std::max(0.0f, agent->position_.x() - agentTree_[agentTree_[node].right].maxCoord[0])) + sqr(std::max(0.0f, agentTree_[agentTree_[node].right].minCoord[1] - agent->position_.y())) + sqr(std::max(0.0f, agent->position_.y() - agentTree_[agentTree_[node].right].maxCoord[1])) + sqr(std::max(0.0f, agentTree_[agentTree_[node].right].minCoord[2] - agent->position_.z())) + sqr(std::max(0.0f, agent->position_.z() - agentTree_[agentTree_[node].right].maxCoord[2]));
+				if (!(extent > 0.0f)) {
+					continue;
+				}
+
+				size_t counts[RVO_SAH_NUM_BINS] = { };
+				float binMinCoords[RVO_SAH_NUM_BINS][3];
+				float binMaxCoords[RVO_SAH_NUM_BINS][3];
+				const float scale = static_cast<float>(RVO_SAH_NUM_BINS) / extent;
 
-			if (distSqLeft < distSqRight) {
-				if (distSqLeft < rangeSq) {
-					queryAgentTreeRecursive(agent, rangeSq, agentTree_[node].left);
+				for (size_t i = begin; i < end; i += stride) {
+					const Vector3 &position = buildPositions_[i];
+					const size_t bin = std::min(static_cast<size_t>((position[axis] - treeNode.minCoord[axis]) * scale), RVO_SAH_NUM_BINS - 1);
 
-					if (distSqRight < rangeSq) {
-						queryAgentTreeRecursive(agent, rangeSq, agentTree_[node].right);
+					for (size_t j = 0; j < 3; ++j) {
+						if (counts[bin] == 0 || position[j] < binMinCoords[bin][j]) {
+							binMinCoords[bin][j] = position[j];
+						}
+
+						if (counts[bin] == 0 || position[j] > binMaxCoords[bin][j]) {
+							binMaxCoords[bin][j] = position[j];
+						}
 					}
+
+					++counts[bin];
 				}
-			}
-			else {
-				if (distSqRight < rangeSq) {
-					queryAgentTreeRecursive(agent, rangeSq, agentTree_[node].right);
 
-					if (distSqLeft < rangeSq) {
-						queryAgentTreeRecursive(agent, rangeSq, agentTree_[node].left);
+				/* Sweep from the right to accumulate the cost of the right children, then from the left to evaluate each split between two bins. */
+				float rightCosts[RVO_SAH_NUM_BINS];
+				float minCoord[3];
+				float maxCoord[3];
+				size_t numBinned = 0;
+				size_t count = 0;
+
+				for (size_t bin = 0; bin < RVO_SAH_NUM_BINS; ++bin) {
+					numBinned += counts[bin];
+				}
+
+				for (size_t bin = RVO_SAH_NUM_BINS - 1; bin > 0; --bin) {
+					if (counts[bin] != 0) {
+						for (size_t j = 0; j < 3; ++j) {
+							minCoord[j] = count == 0 ? binMinCoords[bin][j] : std::min(minCoord[j], binMinCoords[bin][j]);
+							maxCoord[j] = count == 0 ? binMaxCoords[bin][j] : std::max(maxCoord[j], binMaxCoords[bin][j]);
+						}
+
+						count += counts[bin];
+					}
+
+					rightCosts[bin] = count == 0 ? 0.0f : surfaceArea(minCoord, maxCoord) * static_cast<float>(count);
+				}
+
+				count = 0;
+
+				for (size_t bin = 0; bin + 1 < RVO_SAH_NUM_BINS; ++bin) {
+					if (counts[bin] != 0) {
+						for (size_t j = 0; j < 3; ++j) {
+							minCoord[j] = count == 0 ? binMinCoords[bin][j] : std::min(minCoord[j], binMinCoords[bin][j]);
+							maxCoord[j] = count == 0 ? binMaxCoords[bin][j] : std::max(maxCoord[j], binMaxCoords[bin][j]);
+						}
+
+						count += counts[bin];
 					}
+
+					if (count == 0 || count == numBinned) {
+						continue;
+					}
+
+					const float cost = surfaceArea(minCoord, maxCoord) * static_cast<float>(count) + rightCosts[bin + 1];
+
+					if (!found || cost < bestCost) {
+						bestCost = cost;
+						coord = axis;
+						splitValue = treeNode.minCoord[axis] + static_cast<float>(bin + 1) / scale;
+						found = true;
+					}
+				}
+			}
+		}
+	}
+
+	size_t KdTree::buildMortonTreeRecursive(size_t begin, size_t end, size_t node)
+	{
+		AgentTreeNode &treeNode = buildTree_[node];
+
+		if (end - begin <= leafSize_) {
+			computeBoundingBox(begin, end, treeNode.minCoord, treeNode.maxCoord);
+			treeNode.index = static_cast<uint32_t>(begin);
+			treeNode.count = static_cast<uint32_t>(end - begin);
+
+			return 1;
+		}
+
+		/* Split where the highest bit that differs between the Morton codes of the range changes from zero to one. Ranges of equal codes are split in the middle. */
+		const uint64_t firstCode = mortonCodes_[begin];
+		const uint64_t lastCode = mortonCodes_[end - 1];
+		size_t split = (begin + end) / 2;
+
+		if (firstCode != lastCode) {
+			uint64_t bit = firstCode ^ lastCode;
+
+			while ((bit & (bit - 1)) != 0) {
+				bit &= bit - 1;
+			}
+
+			size_t left = begin + 1;
+			size_t right = end - 1;
+
+			while (left < right) {
+				const size_t middle = left + (right - left) / 2;
+
+				if ((mortonCodes_[middle] & bit) != 0) {
+					right = middle;
 				}
+				else {
+					left = middle + 1;
+				}
+			}
+
+			split = left;
+		}
+
+		treeNode.index = static_cast<uint32_t>(split);
+		treeNode.count = 0;
+
+		const size_t leftNode = node + 1;
+		const size_t rightNode = node + 2 * (split - begin);
+		size_t leftNodes = 0;
+
+#ifdef _OPENMP
+#pragma omp task shared(leftNodes) if (split - begin >= RVO_MIN_TASK_SIZE && omp_in_parallel())
+#endif
+		leftNodes = buildMortonTreeRecursive(begin, split, leftNode);
+		const size_t rightNodes = buildMortonTreeRecursive(split, end, rightNode);
+
+#ifdef _OPENMP
+#pragma omp taskwait
+#endif
+
+		for (size_t i = 0; i < 3; ++i) {
+			treeNode.minCoord[i] = std::min(buildTree_[leftNode].minCoord[i], buildTree_[rightNode].minCoord[i]);
+			treeNode.maxCoord[i] = std::max(buildTree_[leftNode].maxCoord[i], buildTree_[rightNode].maxCoord[i]);
+		}
+
+		return 1 + leftNodes + rightNodes;
+	}
+
+	size_t KdTree::compactAgentTreeRecursive(size_t buildNode, size_t begin, size_t node)
+	{
+		const AgentTreeNode &buildTreeNode = buildTree_[buildNode];
+		agentTree_[node] = buildTreeNode;
+
+		if (buildTreeNode.count != 0) {
+			return node + 1;
+		}
+
+		/* The left subtree follows its parent, and the right subtree follows the left subtree. */
+		const size_t split = buildTreeNode.index;
+		const size_t right = compactAgentTreeRecursive(buildNode + 1, begin, node + 1);
+		agentTree_[node].index = static_cast<uint32_t>(right);
+
+		return compactAgentTreeRecursive(buildNode + 2 * (split - begin), split, right);
+	}
+
+	void KdTree::computeBoundingBox(size_t begin, size_t end, float *minCoord, float *maxCoord) const
+	{
+		for (size_t i = 0; i < 3; ++i) {
+			minCoord[i] = buildPositions_[begin][i];
+			maxCoord[i] = buildPositions_[begin][i];
+		}
+
+		for (size_t i = begin + 1; i < end; ++i) {
+			maxCoord[0] = std::max(maxCoord[0], buildPositions_[i].x());
+			minCoord[0] = std::min(minCoord[0], buildPositions_[i].x());
+			maxCoord[1] = std::max(maxCoord[1], buildPositions_[i].y());
+			minCoord[1] = std::min(minCoord[1], buildPositions_[i].y());
+			maxCoord[2] = std::max(maxCoord[2], buildPositions_[i].z());
+			minCoord[2] = std::min(minCoord[2], buildPositions_[i].z());
+		}
+	}
+
+	size_t KdTree::partitionAgents(size_t begin, size_t end, size_t coord, float splitValue)
+	{
+		size_t left = begin;
+
+		size_t right = end;
+
+		while (left < right) {
+			while (left < right && buildPositions_[left][coord] < splitValue) {
+				++left;
+			}
+
+			while (right > left && buildPositions_[right - 1][coord] >= splitValue) {
+				--right;
+			}
+
+			if (left < right) {
+				std::swap(agents_[left], agents_[right - 1]);
+				std::swap(buildPositions_[left], buildPositions_[right - 1]);
+				++left;
+				--right;
+			}
+		}
+
+		return left;
+	}
+
+	void KdTree::computeBoundingBoxParallel(size_t begin, size_t end, float *minCoord, float *maxCoord) const
+	{
+#ifdef _OPENMP
+		const size_t numChunks = static_cast<size_t>(omp_get_num_threads());
+		const size_t chunkSize = (end - begin + numChunks - 1) / numChunks;
+		std::vector<float> minCoords(3 * numChunks);
+		std::vector<float> maxCoords(3 * numChunks);
+
+		/* Chunks that are empty keep the bounding box of the first agent. */
+		computeBoundingBox(begin, begin + 1, &minCoords[0], &maxCoords[0]);
+
+		for (size_t i = 1; i < numChunks; ++i) {
+			std::copy(minCoords.begin(), minCoords.begin() + 3, minCoords.begin() + 3 * i);
+			std::copy(maxCoords.begin(), maxCoords.begin() + 3, maxCoords.begin() + 3 * i);
+		}
+
+		for (size_t i = 0; i < numChunks; ++i) {
+			const size_t chunkBegin = std::min(begin + i * chunkSize, end);
+			const size_t chunkEnd = std::min(chunkBegin + chunkSize, end);
+
+			if (chunkBegin < chunkEnd) {
+#pragma omp task shared(minCoords, maxCoords)
+				computeBoundingBox(chunkBegin, chunkEnd, &minCoords[3 * i], &maxCoords[3 * i]);
+			}
+		}
+
+#pragma omp taskwait
+
+		std::copy(minCoords.begin(), minCoords.begin() + 3, minCoord);
+		std::copy(maxCoords.begin(), maxCoords.begin() + 3, maxCoord);
+
+		for (size_t i = 1; i < numChunks; ++i) {
+			for (size_t j = 0; j < 3; ++j) {
+				minCoord[j] = std::min(minCoord[j], minCoords[3 * i + j]);
+				maxCoord[j] = std::max(maxCoord[j], maxCoords[3 * i + j]);
+			}
+		}
+#else
+		computeBoundingBox(begin, end, minCoord, maxCoord);
+#endif
+	}
+
+	size_t KdTree::partitionAgentsParallel(size_t begin, size_t end, size_t coord, float splitValue)
+	{
+#ifdef _OPENMP
+		const size_t numChunks = static_cast<size_t>(omp_get_num_threads());
+		const size_t chunkSize = (end - begin + numChunks - 1) / numChunks;
+		std::vector<size_t> chunkBegins(numChunks + 1);
+		std::vector<size_t> chunkLefts(numChunks);
+
+		for (size_t i = 0; i <= numChunks; ++i) {
+			chunkBegins[i] = std::min(begin + i * chunkSize, end);
+		}
+
+		/* Partition each chunk in place. */
+		for (size_t i = 0; i < numChunks; ++i) {
+#pragma omp task shared(chunkBegins, chunkLefts)
+			chunkLefts[i] = partitionAgents(chunkBegins[i], chunkBegins[i + 1], coord, splitValue);
+		}
+
+#pragma omp taskwait
+
+		/* Gather the left and right parts of all chunks into the build buffer, then copy them back. */
+		size_t left = begin;
+
+		for (size_t i = 0; i < numChunks; ++i) {
+			left += chunkLefts[i] - chunkBegins[i];
+		}
+
+		size_t leftOffset = begin;
+		size_t rightOffset = left;
+
+		for (size_t i = 0; i < numChunks; ++i) {
+#pragma omp task shared(chunkBegins, chunkLefts)
+			{
+				std::copy(agents_.begin() + chunkBegins[i], agents_.begin() + chunkLefts[i], buildBuffer_.begin() + leftOffset);
+				std::copy(agents_.begin() + chunkLefts[i], agents_.begin() + chunkBegins[i + 1], buildBuffer_.begin() + rightOffset);
+				std::copy(buildPositions_.begin() + chunkBegins[i], buildPositions_.begin() + chunkLefts[i], buildPositionBuffer_.begin() + leftOffset);
+				std::copy(buildPositions_.begin() + chunkLefts[i], buildPositions_.begin() + chunkBegins[i + 1], buildPositionBuffer_.begin() + rightOffset);
+			}
+
+			leftOffset += chunkLefts[i] - chunkBegins[i];
+			rightOffset += chunkBegins[i + 1] - chunkLefts[i];
+		}
+
+#pragma omp taskwait
+
+		for (size_t i = 0; i < numChunks; ++i) {
+#pragma omp task shared(chunkBegins)
+			{
+				std::copy(buildBuffer_.begin() + chunkBegins[i], buildBuffer_.begin() + chunkBegins[i + 1], agents_.begin() + chunkBegins[i]);
+				std::copy(buildPositionBuffer_.begin() + chunkBegins[i], buildPositionBuffer_.begin() + chunkBegins[i + 1], buildPositions_.begin() + chunkBegins[i]);
 			}
 		}
+
+#pragma omp taskwait
+
+		return left;
+#else
+		return partitionAgents(begin, end, coord, splitValue);
+#endif
+	}
+
+	void KdTree::sortAgentsByMortonCode()
+	{
+		const size_t numAgents = agents_.size();
+
+		float minCoord[3];
+		float maxCoord[3];
+		computeBoundingBox(0, numAgents, minCoord, maxCoord);
+
+		/* Quantize all axes with the same scale so that the cells of the Morton order are cubes. */
+		const float maxExtent = std::max(std::max(maxCoord[0] - minCoord[0], maxCoord[1] - minCoord[1]), maxCoord[2] - minCoord[2]);
+		const float maxQuantized = static_cast<float>(0x1fffff);
+		const float scale = maxExtent > 0.0f ? maxQuantized / maxExtent : 0.0f;
+
+		mortonCodes_.resize(numAgents);
+		mortonBuffer_.resize(numAgents);
+		buildBuffer_.resize(numAgents);
+		buildPositionBuffer_.resize(numAgents);
+
+#ifdef _OPENMP
+#pragma omp parallel for if (numAgents > RVO_MIN_TASK_SIZE)
+#endif
+		for (int i = 0; i < static_cast<int>(numAgents); ++i) {
+			const Vector3 &position = buildPositions_[i];
+			const uint64_t x = static_cast<uint64_t>(std::min((position.x() - minCoord[0]) * scale, maxQuantized));
+			const uint64_t y = static_cast<uint64_t>(std::min((position.y() - minCoord[1]) * scale, maxQuantized));
+			const uint64_t z = static_cast<uint64_t>(std::min((position.z() - minCoord[2]) * scale, maxQuantized));
+
+			mortonCodes_[i] = (spreadBits(x) << 2) | (spreadBits(y) << 1) | spreadBits(z);
+		}
+
+		/* Least significant digit radix sort of the agents by Morton code, with one histogram per thread. Passes over digits shared by all agents are skipped. */
+#ifdef _OPENMP
+		const int numThreads = startParallelRegion(numAgents) ? omp_get_max_threads() : 1;
+#else
+		const int numThreads = 1;
+#endif
+		const size_t numDigits = 256;
+
+		radixHistograms_.resize(numThreads * numDigits);
+
+		for (size_t shift = 0; shift < 64; shift += 8) {
+			bool skip = false;
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(numThreads)
+#endif
+			{
+#ifdef _OPENMP
+				const size_t thread = static_cast<size_t>(omp_get_thread_num());
+				const size_t threads = static_cast<size_t>(omp_get_num_threads());
+#else
+				const size_t thread = 0;
+				const size_t threads = 1;
+#endif
+				const size_t begin = numAgents * thread / threads;
+				const size_t end = numAgents * (thread + 1) / threads;
+				size_t *const histogram = &radixHistograms_[thread * numDigits];
+
+				std::fill(histogram, histogram + numDigits, 0);
+
+				for (size_t i = begin; i < end; ++i) {
+					++histogram[(mortonCodes_[i] >> shift) & (numDigits - 1)];
+				}
+
+#ifdef _OPENMP
+#pragma omp barrier
+#pragma omp single
+#endif
+				{
+					/* Turn the counts into the positions at which each thread scatters each digit. */
+					size_t offset = 0;
+
+					for (size_t digit = 0; digit < numDigits; ++digit) {
+						const size_t digitBegin = offset;
+
+						for (size_t t = 0; t < threads; ++t) {
+							const size_t count = radixHistograms_[t * numDigits + digit];
+							radixHistograms_[t * numDigits + digit] = offset;
+							offset += count;
+						}
+
+						if (offset - digitBegin == numAgents) {
+							skip = true;
+						}
+					}
+				}
+
+				if (!skip) {
+					for (size_t i = begin; i < end; ++i) {
+						const size_t position = histogram[(mortonCodes_[i] >> shift) & (numDigits - 1)]++;
+						mortonBuffer_[position] = mortonCodes_[i];
+						buildBuffer_[position] = agents_[i];
+						buildPositionBuffer_[position] = buildPositions_[i];
+					}
+				}
+			}
+
+			if (!skip) {
+				mortonCodes_.swap(mortonBuffer_);
+				agents_.swap(buildBuffer_);
+				buildPositions_.swap(buildPositionBuffer_);
+			}
+		}
+	}
+
+	float KdTree::computeAgentTreeCost(size_t node) const
+	{
+		const float cost = surfaceArea(agentTree_[node].minCoord, agentTree_[node].maxCoord);
+
+		if (agentTree_[node].count != 0) {
+			return cost;
+		}
+
+		return cost + computeAgentTreeCost(node + 1) + computeAgentTreeCost(agentTree_[node].index);
+	}
+
+	float KdTree::refitAgentTreeRecursive(size_t node)
+	{
+		AgentTreeNode &treeNode = agentTree_[node];
+
+		if (treeNode.count != 0) {
+			const size_t begin = treeNode.index;
+			const size_t end = begin + treeNode.count;
+
+			treeNode.minCoord[0] = treeNode.maxCoord[0] = positionsX_[begin];
+			treeNode.minCoord[1] = treeNode.maxCoord[1] = positionsY_[begin];
+			treeNode.minCoord[2] = treeNode.maxCoord[2] = positionsZ_[begin];
+
+			for (size_t i = begin + 1; i < end; ++i) {
+				treeNode.minCoord[0] = std::min(treeNode.minCoord[0], positionsX_[i]);
+				treeNode.maxCoord[0] = std::max(treeNode.maxCoord[0], positionsX_[i]);
+				treeNode.minCoord[1] = std::min(treeNode.minCoord[1], positionsY_[i]);
+				treeNode.maxCoord[1] = std::max(treeNode.maxCoord[1], positionsY_[i]);
+				treeNode.minCoord[2] = std::min(treeNode.minCoord[2], positionsZ_[i]);
+				treeNode.maxCoord[2] = std::max(treeNode.maxCoord[2], positionsZ_[i]);
+			}
+
+			return surfaceArea(treeNode.minCoord, treeNode.maxCoord);
+		}
+
+		const size_t leftNode = node + 1;
+		const size_t rightNode = treeNode.index;
+		float leftCost = 0.0f;
+		float rightCost = 0.0f;
+
+#ifdef _OPENMP
+#pragma omp task shared(leftCost) if (rightNode - leftNode >= RVO_MIN_TASK_NODES && omp_in_parallel())
+#endif
+		leftCost = refitAgentTreeRecursive(leftNode);
+		rightCost = refitAgentTreeRecursive(rightNode);
+
+#ifdef _OPENMP
+#pragma omp taskwait
+#endif
+
+		for (size_t i = 0; i < 3; ++i) {
+			treeNode.minCoord[i] = std::min(agentTree_[leftNode].minCoord[i], agentTree_[rightNode].minCoord[i]);
+			treeNode.maxCoord[i] = std::max(agentTree_[leftNode].maxCoord[i], agentTree_[rightNode].maxCoord[i]);
+		}
+
+		return leftCost + rightCost + surfaceArea(treeNode.minCoord, treeNode.maxCoord);
+	}
+
+	void KdTree::updateAgentCells()
+	{
+		const size_t numNodes = agentTree_.size();
+		const float infinity = std::numeric_limits<float>::infinity();
+
+		for (size_t i = 0; i < 3; ++i) {
+			agentCells_[0].minCoord[i] = -infinity;
+			agentCells_[0].maxCoord[i] = infinity;
+		}
+
+		/* The nodes are in depth-first order, so the cell of each parent precedes those of its children. */
+		for (size_t node = 0; node < numNodes; ++node) {
+			const AgentTreeNode &treeNode = agentTree_[node];
+
+			if (treeNode.count != 0) {
+				continue;
+			}
+
+			const size_t leftNode = node + 1;
+			const size_t rightNode = treeNode.index;
+			const AgentTreeCell &cell = agentCells_[node];
+			AgentTreeCell &leftCell = agentCells_[leftNode];
+			AgentTreeCell &rightCell = agentCells_[rightNode];
+
+			for (size_t i = 0; i < 3; ++i) {
+				leftCell.minCoord[i] = rightCell.minCoord[i] = cell.minCoord[i];
+				leftCell.maxCoord[i] = rightCell.maxCoord[i] = cell.maxCoord[i];
+			}
+
+			/* Cut along the coordinate with the widest gap between the bounding boxes of the children. */
+			size_t coord = 0;
+			float gap = -infinity;
+			bool leftFirst = true;
+
+			for (size_t i = 0; i < 3; ++i) {
+				const float leftGap = agentTree_[rightNode].minCoord[i] - agentTree_[leftNode].maxCoord[i];
+				const float rightGap = agentTree_[leftNode].minCoord[i] - agentTree_[rightNode].maxCoord[i];
+
+				if (leftGap > gap) {
+					coord = i;
+					gap = leftGap;
+					leftFirst = true;
+				}
+
+				if (rightGap > gap) {
+					coord = i;
+					gap = rightGap;
+					leftFirst = false;
+				}
+			}
+
+			if (gap < 0.0f) {
+				for (size_t i = 0; i < 3; ++i) {
+					leftCell.minCoord[i] = rightCell.minCoord[i] = infinity;
+					leftCell.maxCoord[i] = rightCell.maxCoord[i] = -infinity;
+				}
+			}
+			else if (leftFirst) {
+				leftCell.maxCoord[coord] = std::min(leftCell.maxCoord[coord], agentTree_[rightNode].minCoord[coord]);
+				rightCell.minCoord[coord] = std::max(rightCell.minCoord[coord], agentTree_[leftNode].maxCoord[coord]);
+			}
+			else {
+				leftCell.minCoord[coord] = std::max(leftCell.minCoord[coord], agentTree_[rightNode].maxCoord[coord]);
+				rightCell.maxCoord[coord] = std::min(rightCell.maxCoord[coord], agentTree_[leftNode].minCoord[coord]);
+			}
+		}
+	}
+
+	void KdTree::updateAgentLeaves()
+	{
+		const size_t numNodes = agentTree_.size();
+
+		leafNodes_.resize(agents_.size());
+		agentCells_.resize(numNodes);
+		agentCells_[0].parent = 0;
+		agentCells_[0].sibling = 0;
+
+		for (size_t node = 0; node < numNodes; ++node) {
+			const AgentTreeNode &treeNode = agentTree_[node];
+
+			if (treeNode.count != 0) {
+				for (size_t i = treeNode.index; i < treeNode.index + treeNode.count; ++i) {
+					leafNodes_[agents_[i]->id_] = static_cast<uint32_t>(node);
+				}
+			}
+			else {
+				agentCells_[node + 1].parent = agentCells_[treeNode.index].parent = static_cast<uint32_t>(node);
+				agentCells_[node + 1].sibling = treeNode.index;
+				agentCells_[treeNode.index].sibling = static_cast<uint32_t>(node + 1);
+			}
+		}
+	}
+
+	void KdTree::updateAgentPositions()
+	{
+		const AgentStore &store = *sim_->agentStore_;
+		const size_t numAgents = agents_.size();
+
+		/* The last rebuild of the agent kd-tree of the simulation put the slots of the agent store in tree order, and adding or removing an agent forces a rebuild, so slot i holds the agent at tree index i. */
+		const bool storeOrder = sim_->kdTree_ == this;
+
+		positionsX_.resize(numAgents);
+		positionsY_.resize(numAgents);
+		positionsZ_.resize(numAgents);
+
+		const bool dualTreeSearch = neighborSearch_ == RVO_DUAL_TREE_SEARCH;
+
+		if (sweep_) {
+			velocitiesX_.resize(numAgents);
+			velocitiesY_.resize(numAgents);
+			velocitiesZ_.resize(numAgents);
+		}
+
+		if (dualTreeSearch) {
+			maxNeighbors_.resize(numAgents);
+			neighborDistSqs_.resize(numAgents);
+			verticalWeights_.resize(numAgents);
+			treeIndices_.resize(numAgents);
+		}
+
+		float maxAgentRadius = 0.0f;
+		float maxNeighborDistSq = 0.0f;
+		float minVerticalWeight = 1.0f;
+
+#ifdef _OPENMP
+#pragma omp parallel if (numAgents > RVO_MIN_TASK_SIZE)
+#endif
+		{
+			float threadMaxAgentRadius = 0.0f;
+			float threadMaxNeighborDistSq = 0.0f;
+			float threadMinVerticalWeight = 1.0f;
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+			for (int i = 0; i < static_cast<int>(numAgents); ++i) {
+				const size_t slot = storeOrder ? static_cast<size_t>(i) : agents_[i]->slot_;
+
+				positionsX_[i] = store.positions_[slot].x();
+				positionsY_[i] = store.positions_[slot].y();
+				positionsZ_[i] = store.positions_[slot].z();
+				threadMaxAgentRadius = std::max(threadMaxAgentRadius, store.radii_[slot]);
+
+				if (sweep_) {
+					velocitiesX_[i] = store.velocities_[slot].x();
+					velocitiesY_[i] = store.velocities_[slot].y();
+					velocitiesZ_[i] = store.velocities_[slot].z();
+				}
+
+				if (dualTreeSearch) {
+					maxNeighbors_[i] = agents_[i]->maxNeighbors_;
+					neighborDistSqs_[i] = agents_[i]->maxNeighbors_ > 0 ? sqr(agents_[i]->neighborDist_) : 0.0f;
+					verticalWeights_[i] = agents_[i]->computeNeighborVerticalWeight();
+					treeIndices_[agents_[i]->id_] = i;
+					threadMaxNeighborDistSq = std::max(threadMaxNeighborDistSq, neighborDistSqs_[i]);
+					threadMinVerticalWeight = std::min(threadMinVerticalWeight, verticalWeights_[i]);
+				}
+			}
+
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+			{
+				maxAgentRadius = std::max(maxAgentRadius, threadMaxAgentRadius);
+				maxNeighborDistSq = std::max(maxNeighborDistSq, threadMaxNeighborDistSq);
+				minVerticalWeight = std::min(minVerticalWeight, threadMinVerticalWeight);
+			}
+		}
+
+		/* Bound the padding of the nodes in visibility queries and the range and vertical weight of the dual-tree search. */
+		maxAgentRadius_ = maxAgentRadius;
+		maxNeighborDistSq_ = maxNeighborDistSq;
+		minVerticalWeight_ = minVerticalWeight;
+	}
+
+	void KdTree::updateAgentVelocities()
+	{
+		agentVelocities_.resize(agentTree_.size());
+
+		/* The children of a node follow it, so visiting the nodes in reverse order bounds the children first. */
+		for (size_t node = agentTree_.size(); node-- != 0; ) {
+			const AgentTreeNode &treeNode = agentTree_[node];
+			AgentTreeVelocityBox &velocityBox = agentVelocities_[node];
+
+			if (treeNode.count != 0) {
+				const size_t end = treeNode.index + treeNode.count;
+
+				velocityBox.minVelocity[0] = velocityBox.maxVelocity[0] = velocitiesX_[treeNode.index];
+				velocityBox.minVelocity[1] = velocityBox.maxVelocity[1] = velocitiesY_[treeNode.index];
+				velocityBox.minVelocity[2] = velocityBox.maxVelocity[2] = velocitiesZ_[treeNode.index];
+
+				for (size_t i = treeNode.index + 1; i < end; ++i) {
+					velocityBox.minVelocity[0] = std::min(velocityBox.minVelocity[0], velocitiesX_[i]);
+					velocityBox.maxVelocity[0] = std::max(velocityBox.maxVelocity[0], velocitiesX_[i]);
+					velocityBox.minVelocity[1] = std::min(velocityBox.minVelocity[1], velocitiesY_[i]);
+					velocityBox.maxVelocity[1] = std::max(velocityBox.maxVelocity[1], velocitiesY_[i]);
+					velocityBox.minVelocity[2] = std::min(velocityBox.minVelocity[2], velocitiesZ_[i]);
+					velocityBox.maxVelocity[2] = std::max(velocityBox.maxVelocity[2], velocitiesZ_[i]);
+				}
+			}
+			else {
+				const AgentTreeVelocityBox &leftBox = agentVelocities_[node + 1];
+				const AgentTreeVelocityBox &rightBox = agentVelocities_[treeNode.index];
+
+				for (size_t i = 0; i < 3; ++i) {
+					velocityBox.minVelocity[i] = std::min(leftBox.minVelocity[i], rightBox.minVelocity[i]);
+					velocityBox.maxVelocity[i] = std::max(leftBox.maxVelocity[i], rightBox.maxVelocity[i]);
+				}
+			}
+		}
+	}
+
+	void KdTree::computeAgentNeighbors(Agent *agent, float rangeSq) const
+	{
+		if (sweep_) {
+			queryAgentTreeSwept(sim_->agentStore_->positions_[agent->slot_], sim_->agentStore_->velocities_[agent->slot_], agent->timeHorizon_, rangeSq, *agent, 0, approximationScale_, agent->computeNeighborVerticalWeight());
+		}
+		else if (neighborSearch_ == RVO_BOTTOM_UP_SEARCH && agent->id_ < leafNodes_.size()) {
+			queryAgentTreeBottomUp(sim_->agentStore_->positions_[agent->slot_], rangeSq, *agent, leafNodes_[agent->id_], approximationScale_, agent->computeNeighborVerticalWeight());
+		}
+		else {
+			queryAgentTree(sim_->agentStore_->positions_[agent->slot_], rangeSq, *agent, 0, approximationScale_, agent->computeNeighborVerticalWeight());
+		}
+	}
+
+	void KdTree::computeAllAgentNeighbors()
+	{
+		const size_t numAgents = agents_.size();
+
+		/* Collect the neighbors in tree order, each agent into a slot of its maximum number of neighbors, from which copyAgentNeighbors() copies them to the agents. */
+		agentRangeSqs_ = neighborDistSqs_;
+		neighborCounts_.assign(numAgents, 0);
+		neighborOffsets_.resize(numAgents + 1);
+		neighborOffsets_[0] = 0;
+
+		for (size_t i = 0; i < numAgents; ++i) {
+			neighborOffsets_[i + 1] = neighborOffsets_[i] + maxNeighbors_[i];
+		}
+
+		neighbors_.resize(neighborOffsets_[numAgents]);
+
+		if (numAgents != 0 && maxNeighborDistSq_ > 0.0f) {
+			/* The range of each query node is the largest squared range of its agents, which shrinks as they find their maximum numbers of neighbors. */
+			queryRangeSqs_.assign(agentTree_.size(), maxNeighborDistSq_);
+
+			/* Divide the query side of the traversal into disjoint subtrees, so that each agent receives its neighbors from a single thread. */
+			size_t maxDepth = 0;
+
+#ifdef _OPENMP
+			if (omp_get_max_threads() > 1 && !omp_in_parallel()) {
+				while ((static_cast<size_t>(1) << maxDepth) < RVO_DUAL_TREE_TASKS_PER_THREAD * static_cast<size_t>(omp_get_max_threads())) {
+					++maxDepth;
+				}
+			}
+#endif
+
+			std::vector<std::pair<size_t, size_t> > stack(1, std::make_pair(static_cast<size_t>(0), static_cast<size_t>(0)));
+			std::vector<size_t> queryNodes;
+
+			while (!stack.empty()) {
+				const size_t node = stack.back().first;
+				const size_t depth = stack.back().second;
+				stack.pop_back();
+
+				if (agentTree_[node].count != 0 || depth == maxDepth) {
+					queryNodes.push_back(node);
+				}
+				else {
+					stack.push_back(std::make_pair(static_cast<size_t>(agentTree_[node].index), depth + 1));
+					stack.push_back(std::make_pair(node + 1, depth + 1));
+				}
+			}
+
+			const size_t numQueryNodes = queryNodes.size();
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) if (numQueryNodes > 1)
+#endif
+			for (int i = 0; i < static_cast<int>(numQueryNodes); ++i) {
+				queryAgentTreePair(queryNodes[i], 0);
+			}
+		}
+	}
+
+	void KdTree::copyAgentNeighbors(Agent *agent) const
+	{
+		const size_t i = treeIndices_[agent->id_];
+		agent->agentNeighbors_.clear();
+
+		if (neighborCounts_[i] != 0) {
+			const AgentNeighbor *const neighbors = &neighbors_[neighborOffsets_[i]];
+			agent->agentNeighbors_.reserve(neighborCounts_[i]);
+			agent->agentNeighbors_.assign(neighbors, neighbors + neighborCounts_[i]);
+		}
+	}
+
+	void KdTree::computeAgentNeighborCandidates(Agent *agent, float rangeSq) const
+	{
+		AgentRangeCollector collector(agent, agent->neighborCandidates_);
+		queryAgentTree(sim_->agentStore_->positions_[agent->slot_], rangeSq, collector, 0, 1.0f, 1.0f);
+	}
+
+	void KdTree::computeAgentsInRange(const Vector3 &point, float rangeSq, std::vector<const Agent *> &agents) const
+	{
+		if (agents_.empty()) {
+			return;
+		}
+
+		AgentRangeCollector collector(NULL, agents);
+		queryAgentTree(point, rangeSq, collector, 0, 1.0f, 1.0f);
+	}
+
+	void KdTree::computeAgentsInBox(const Vector3 &minCoord, const Vector3 &maxCoord, std::vector<const Agent *> &agents) const
+	{
+		if (agents_.empty()) {
+			return;
+		}
+
+		const float boxMinCoord[3] = { minCoord.x(), minCoord.y(), minCoord.z() };
+		const float boxMaxCoord[3] = { maxCoord.x(), maxCoord.y(), maxCoord.z() };
+		queryAgentTreeBox(boxMinCoord, boxMaxCoord, agents, 0);
+	}
+
+	bool KdTree::queryVisibility(const Vector3 &point1, const Vector3 &point2, float radius) const
+	{
+		return agents_.empty() || queryVisibilityRecursive(point1, point2, radius, 0);
+	}
+
+	size_t KdTree::computeNearestAgents(const Vector3 &point, float rangeSq, size_t maxAgents, std::pair<float, const Agent *> *neighbors) const
+	{
+		if (maxAgents == 0 || agents_.empty()) {
+			return 0;
+		}
+
+		NearestAgentCollector collector(maxAgents, neighbors);
+		queryAgentTree(point, rangeSq, collector, 0, 1.0f, 1.0f);
+
+		return collector.numNeighbors;
+	}
+
+	size_t KdTree::computeApproximateNearestAgents(const Vector3 &point, float rangeSq, size_t maxAgents, float epsilon, std::pair<float, const Agent *> *neighbors, size_t &numNodes) const
+	{
+		numNodes = 0;
+
+		if (maxAgents == 0 || agents_.empty()) {
+			return 0;
+		}
+
+		NearestAgentCollector collector(maxAgents, neighbors);
+		numNodes = queryAgentTree(point, rangeSq, collector, 0, 1.0f / sqr(1.0f + std::max(0.0f, epsilon)), 1.0f);
+
+		return collector.numNeighbors;
+	}
+
+	template <typename Collector>
+	size_t KdTree::queryAgentTree(const Vector3 &point, float &rangeSq, Collector &collector, size_t node, float rangeScale, float verticalWeight) const
+	{
+		const float paddedPoint[4] = { point.x(), point.y(), point.z(), 0.0f };
+
+		/* The far children deferred while descending into the near ones, with their squared distances to the point. */
+		size_t stackNodes[RVO_MAX_QUERY_STACK_SIZE];
+		float stackDistSqs[RVO_MAX_QUERY_STACK_SIZE];
+		size_t stackSize = 0;
+		size_t numNodes = 0;
+
+		for (;;) {
+			const AgentTreeNode &treeNode = agentTree_[node];
+			++numNodes;
+
+			if (treeNode.count != 0) {
+				/* Compute all distances from the packed positions of the leaf first, so that only agents within range are touched. */
+				const size_t begin = treeNode.index;
+				const size_t size = treeNode.count;
+				float distSqs[RVO_MAX_LEAF_SIZE];
+				computeDistSqs(paddedPoint, verticalWeight, &positionsX_[begin], &positionsY_[begin], &positionsZ_[begin], size, distSqs);
+
+				for (size_t i = 0; i < size; ++i) {
+					if (distSqs[i] < rangeSq) {
+						collector.insertAgentNeighbor(agents_[begin + i], distSqs[i], rangeSq);
+					}
+				}
+			}
+			else {
+				const AgentTreeNode &leftNode = agentTree_[node + 1];
+				const AgentTreeNode &rightNode = agentTree_[treeNode.index];
+
+				float distSqLeft;
+				float distSqRight;
+				computeDistSqToBoxes(paddedPoint, verticalWeight, leftNode.minCoord, leftNode.maxCoord, rightNode.minCoord, rightNode.maxCoord, distSqLeft, distSqRight);
+
+				size_t nearNode = node + 1;
+				size_t farNode = treeNode.index;
+				float nearDistSq = distSqLeft;
+				float farDistSq = distSqRight;
+
+				if (!(distSqLeft < distSqRight)) {
+					std::swap(nearNode, farNode);
+					std::swap(nearDistSq, farDistSq);
+				}
+
+				/* An approximate query scales the range before pruning nodes, so that it skips the nodes that could only hold agents slightly nearer than the farthest agent so far. */
+				if (nearDistSq < rangeSq * rangeScale) {
+					if (farDistSq < rangeSq * rangeScale) {
+						if (stackSize < RVO_MAX_QUERY_STACK_SIZE) {
+							stackNodes[stackSize] = farNode;
+							stackDistSqs[stackSize] = farDistSq;
+							++stackSize;
+						}
+						else {
+							/* Only degenerate trees are this deep. Visit the near child recursively and the far child next. */
+							numNodes += queryAgentTree(point, rangeSq, collector, nearNode, rangeScale, verticalWeight);
+							nearNode = farNode;
+							nearDistSq = farDistSq;
+						}
+					}
+
+					if (nearDistSq < rangeSq * rangeScale) {
+						node = nearNode;
+						continue;
+					}
+				}
+			}
+
+			/* Resume at the most recently deferred child that is still within range, which may have shrunk since it was deferred. */
+			do {
+				if (stackSize == 0) {
+					return numNodes;
+				}
+
+				--stackSize;
+			} while (!(stackDistSqs[stackSize] < rangeSq * rangeScale));
+
+			node = stackNodes[stackSize];
+		}
+	}
+
+	template <typename Collector>
+	size_t KdTree::queryAgentTreeBottomUp(const Vector3 &point, float &rangeSq, Collector &collector, size_t leaf, float rangeScale, float verticalWeight) const
+	{
+		const float coords[3] = { point.x(), point.y(), point.z() };
+		size_t numNodes = queryAgentTree(point, rangeSq, collector, leaf, rangeScale, verticalWeight);
+		size_t node = leaf;
+
+		while (node != 0) {
+			/* Every agent outside the node is outside its cell and at least as far as the nearest face of the cell, so the search stops once the range no longer reaches past the faces. */
+			const AgentTreeCell &cell = agentCells_[node];
+			const float horizontalFaceDist = std::min(std::min(coords[0] - cell.minCoord[0], cell.maxCoord[0] - coords[0]), std::min(coords[1] - cell.minCoord[1], cell.maxCoord[1] - coords[1]));
+			const float verticalFaceDist = std::min(coords[2] - cell.minCoord[2], cell.maxCoord[2] - coords[2]);
+
+			if (horizontalFaceDist > 0.0f && verticalFaceDist > 0.0f && std::min(horizontalFaceDist * horizontalFaceDist, verticalWeight * (verticalFaceDist * verticalFaceDist)) >= rangeSq * rangeScale) {
+				break;
+			}
+
+			const size_t sibling = cell.sibling;
+
+			if (computeBoxDistSq(coords, coords, agentTree_[sibling].minCoord, agentTree_[sibling].maxCoord, verticalWeight) < rangeSq * rangeScale) {
+				numNodes += queryAgentTree(point, rangeSq, collector, sibling, rangeScale, verticalWeight);
+			}
+
+			node = cell.parent;
+		}
+
+		return numNodes;
+	}
+
+	template <typename Collector>
+	size_t KdTree::queryAgentTreeSwept(const Vector3 &point, const Vector3 &velocity, float timeHorizon, float &rangeSq, Collector &collector, size_t node, float rangeScale, float verticalWeight) const
+	{
+		/* The far children deferred while descending into the near ones, with their lower bounds on the squared distance to the point. */
+		size_t stackNodes[RVO_MAX_QUERY_STACK_SIZE];
+		float stackDistSqs[RVO_MAX_QUERY_STACK_SIZE];
+		size_t stackSize = 0;
+		size_t numNodes = 0;
+
+		for (;;) {
+			const AgentTreeNode &treeNode = agentTree_[node];
+			++numNodes;
+
+			if (treeNode.count != 0) {
+				const size_t end = treeNode.index + treeNode.count;
+
+				for (size_t i = treeNode.index; i < end; ++i) {
+					const float distSq = computeSweptDistSq(Vector3(positionsX_[i], positionsY_[i], positionsZ_[i]) - point, Vector3(velocitiesX_[i], velocitiesY_[i], velocitiesZ_[i]) - velocity, timeHorizon, verticalWeight);
+
+					if (distSq < rangeSq) {
+						collector.insertAgentNeighbor(agents_[i], distSq, rangeSq);
+					}
+				}
+			}
+			else {
+				const AgentTreeNode &leftNode = agentTree_[node + 1];
+				const AgentTreeNode &rightNode = agentTree_[treeNode.index];
+				const AgentTreeVelocityBox &leftBox = agentVelocities_[node + 1];
+				const AgentTreeVelocityBox &rightBox = agentVelocities_[treeNode.index];
+
+				size_t nearNode = node + 1;
+				size_t farNode = treeNode.index;
+				float nearDistSq = computeSweptBoxDistSq(point, velocity, timeHorizon, leftNode.minCoord, leftNode.maxCoord, leftBox.minVelocity, leftBox.maxVelocity, verticalWeight);
+				float farDistSq = computeSweptBoxDistSq(point, velocity, timeHorizon, rightNode.minCoord, rightNode.maxCoord, rightBox.minVelocity, rightBox.maxVelocity, verticalWeight);
+
+				if (!(nearDistSq < farDistSq)) {
+					std::swap(nearNode, farNode);
+					std::swap(nearDistSq, farDistSq);
+				}
+
+				if (nearDistSq < rangeSq * rangeScale) {
+					if (farDistSq < rangeSq * rangeScale) {
+						if (stackSize < RVO_MAX_QUERY_STACK_SIZE) {
+							stackNodes[stackSize] = farNode;
+							stackDistSqs[stackSize] = farDistSq;
+							++stackSize;
+						}
+						else {
+							/* Only degenerate trees are this deep. Visit the near child recursively and the far child next. */
+							numNodes += queryAgentTreeSwept(point, velocity, timeHorizon, rangeSq, collector, nearNode, rangeScale, verticalWeight);
+							nearNode = farNode;
+							nearDistSq = farDistSq;
+						}
+					}
+
+					if (nearDistSq < rangeSq * rangeScale) {
+						node = nearNode;
+						continue;
+					}
+				}
+			}
+
+			do {
+				if (stackSize == 0) {
+					return numNodes;
+				}
+
+				--stackSize;
+			} while (!(stackDistSqs[stackSize] < rangeSq * rangeScale));
+
+			node = stackNodes[stackSize];
+		}
+	}
+
+	void KdTree::queryAgentTreePair(size_t queryNode, size_t node)
+	{
+		const AgentTreeNode &queryTreeNode = agentTree_[queryNode];
+		const AgentTreeNode &treeNode = agentTree_[node];
+
+		if (computeBoxDistSq(queryTreeNode.minCoord, queryTreeNode.maxCoord, treeNode.minCoord, treeNode.maxCoord, minVerticalWeight_) >= queryRangeSqs_[queryNode] * approximationScale_) {
+			return;
+		}
+
+		if (queryTreeNode.count != 0 && treeNode.count != 0) {
+			const size_t begin = treeNode.index;
+			const size_t size = treeNode.count;
+			const size_t queryEnd = queryTreeNode.index + queryTreeNode.count;
+			float distSqs[RVO_MAX_LEAF_SIZE];
+			float queryRangeSq = 0.0f;
+
+			for (size_t i = queryTreeNode.index; i < queryEnd; ++i) {
+				float &rangeSq = agentRangeSqs_[i];
+				const float point[4] = { positionsX_[i], positionsY_[i], positionsZ_[i], 0.0f };
+
+				if (computeBoxDistSq(point, point, treeNode.minCoord, treeNode.maxCoord, verticalWeights_[i]) < rangeSq * approximationScale_) {
+					computeDistSqs(point, verticalWeights_[i], &positionsX_[begin], &positionsY_[begin], &positionsZ_[begin], size, distSqs);
+
+					AgentNeighbor *const neighbors = &neighbors_[neighborOffsets_[i]];
+					const size_t maxNeighbors = neighborOffsets_[i + 1] - neighborOffsets_[i];
+					size_t &numNeighbors = neighborCounts_[i];
+
+					for (size_t j = 0; j < size; ++j) {
+						if (distSqs[j] < rangeSq && begin + j != i && !(sim_->neighborCulling_ && agents_[i]->isAgentNeighborCulled(agents_[begin + j]))) {
+							/* Insert as by Agent::insertAgentNeighbor(). */
+							if (numNeighbors < maxNeighbors) {
+								++numNeighbors;
+							}
+
+							size_t k = numNeighbors - 1;
+
+							while (k != 0 && distSqs[j] < neighbors[k - 1].distSq) {
+								neighbors[k] = neighbors[k - 1];
+								--k;
+							}
+
+							/* The agents of the simulator's own tree are in the order of their slots. */
+							neighbors[k].distSq = distSqs[j];
+							neighbors[k].slot = static_cast<uint32_t>(sim_->kdTree_ == this ? begin + j : agents_[begin + j]->slot_);
+
+							if (numNeighbors == maxNeighbors) {
+								rangeSq = neighbors[numNeighbors - 1].distSq;
+							}
+						}
+					}
+				}
+
+				queryRangeSq = std::max(queryRangeSq, rangeSq);
+			}
+
+			queryRangeSqs_[queryNode] = queryRangeSq;
+		}
+		else if (treeNode.count != 0 || (queryTreeNode.count == 0 && surfaceArea(queryTreeNode.minCoord, queryTreeNode.maxCoord) >= surfaceArea(treeNode.minCoord, treeNode.maxCoord))) {
+			queryAgentTreePair(queryNode + 1, node);
+			queryAgentTreePair(queryTreeNode.index, node);
+			queryRangeSqs_[queryNode] = std::max(queryRangeSqs_[queryNode + 1], queryRangeSqs_[queryTreeNode.index]);
+		}
+		else {
+			const AgentTreeNode &leftNode = agentTree_[node + 1];
+			const AgentTreeNode &rightNode = agentTree_[treeNode.index];
+
+			/* Visit the child nearer to the center of the query node first, since the children of large nodes often both touch it. */
+			const float center[4] = { 0.5f * (queryTreeNode.minCoord[0] + queryTreeNode.maxCoord[0]), 0.5f * (queryTreeNode.minCoord[1] + queryTreeNode.maxCoord[1]), 0.5f * (queryTreeNode.minCoord[2] + queryTreeNode.maxCoord[2]), 0.0f };
+			float distSqLeft;
+			float distSqRight;
+			computeDistSqToBoxes(center, 1.0f, leftNode.minCoord, leftNode.maxCoord, rightNode.minCoord, rightNode.maxCoord, distSqLeft, distSqRight);
+
+			if (distSqLeft <= distSqRight) {
+				queryAgentTreePair(queryNode, node + 1);
+				queryAgentTreePair(queryNode, treeNode.index);
+			}
+			else {
+				queryAgentTreePair(queryNode, treeNode.index);
+				queryAgentTreePair(queryNode, node + 1);
+			}
+		}
+	}
+
+	void KdTree::queryAgentTreeBox(const float *minCoord, const float *maxCoord, std::vector<const Agent *> &agents, size_t node) const
+	{
+		const AgentTreeNode &treeNode = agentTree_[node];
+
+		if (treeNode.maxCoord[0] < minCoord[0] || treeNode.minCoord[0] > maxCoord[0] || treeNode.maxCoord[1] < minCoord[1] || treeNode.minCoord[1] > maxCoord[1] || treeNode.maxCoord[2] < minCoord[2] || treeNode.minCoord[2] > maxCoord[2]) {
+			return;
+		}
+
+		if (treeNode.count != 0) {
+			const size_t end = treeNode.index + treeNode.count;
+
+			for (size_t i = treeNode.index; i < end; ++i) {
+				if (positionsX_[i] >= minCoord[0] && positionsX_[i] <= maxCoord[0] && positionsY_[i] >= minCoord[1] && positionsY_[i] <= maxCoord[1] && positionsZ_[i] >= minCoord[2] && positionsZ_[i] <= maxCoord[2]) {
+					agents.push_back(agents_[i]);
+				}
+			}
+		}
+		else {
+			queryAgentTreeBox(minCoord, maxCoord, agents, node + 1);
+			queryAgentTreeBox(minCoord, maxCoord, agents, treeNode.index);
+		}
+	}
+
+	bool KdTree::queryVisibilityRecursive(const Vector3 &point1, const Vector3 &point2, float radius, size_t node) const
+	{
+		const AgentTreeNode &treeNode = agentTree_[node];
+
+		if (!intersectsSegment(point1, point2, treeNode.minCoord, treeNode.maxCoord, radius + maxAgentRadius_)) {
+			return true;
+		}
+
+		if (treeNode.count != 0) {
+			const size_t end = treeNode.index + treeNode.count;
+
+			for (size_t i = treeNode.index; i < end; ++i) {
+				if (blocksVisibility(point1, point2, radius, Vector3(positionsX_[i], positionsY_[i], positionsZ_[i]), sim_->agentStore_->radii_[agents_[i]->slot_])) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		return queryVisibilityRecursive(point1, point2, radius, node + 1) && queryVisibilityRecursive(point1, point2, radius, treeNode.index);
 	}
 }
@@ -39,8 +39,13 @@
 #include "API.h"
 
 #include <cstddef>
+#include <utility>
 #include <vector>
+#include <stdint.h>
 
+#include "AgentNeighborBuffer.h"
+#include "RVOSimulator.h"
+#include "SpatialIndex.h"
 #include "Vector3.h"
 
 namespace RVO {
@@ -50,7 +55,7 @@ namespace RVO {
 	/**
 	 * \brief   Defines <i>k</i>d-trees for agents in the simulation.
 	 */
-	class KdTree {
+	class KdTree : public SpatialIndex {
 	private:
 		/**
 		 * \brief   Defines an agent <i>k</i>d-tree node.
@@ -58,36 +63,69 @@ namespace RVO {
 		class AgentTreeNode {
 		public:
 			/**
-			 * \brief   The beginning node number.
+			 * \brief   The minimum coordinates.
 			 */
-			size_t begin;
+			float minCoord[3];
 
 			/**
-			 * \brief   The ending node number.
+			 * \brief   The beginning agent number of a leaf node, or the right node number of an internal node. The left node of an internal node immediately follows it.
 			 */
-			size_t end;
+			uint32_t index;
 
 			/**
-			 * \brief   The left node number.
+			 * \brief   The maximum coordinates.
 			 */
-			size_t left;
+			float maxCoord[3];
 
 			/**
-			 * \brief   The right node number.
+			 * \brief   The number of agents of a leaf node, or zero for an internal node.
+			 */
+			uint32_t count;
+		};
+
+		/**
+		 * \brief   Defines the cell of an agent <i>k</i>d-tree node for the bottom-up search, a box that contains the bounding box of the node and no agent outside the node, together with the neighboring nodes in the tree.
+		 */
+		class AgentTreeCell {
+		public:
+			/**
+			 * \brief   The minimum coordinates, which exceed the maximum coordinates if the cell is empty.
 			 */
-			size_t right;
+			float minCoord[3];
+
+			/**
+			 * \brief   The parent node number, or zero for the root node.
+			 */
+			uint32_t parent;
 
 			/**
 			 * \brief   The maximum coordinates.
 			 */
-			Vector3 maxCoord;
+			float maxCoord[3];
 
 			/**
-			 * \brief   The minimum coordinates.
+			 * \brief   The sibling node number, or zero for the root node.
 			 */
-			Vector3 minCoord;
+			uint32_t sibling;
 		};
 
+		/**
+		 * \brief   Defines the bounds of the velocities of the agents of an agent <i>k</i>d-tree node for the swept search.
+		 */
+		class AgentTreeVelocityBox {
+		public:
+			/**
+			 * \brief   The minimum velocity coordinates.
+			 */
+			float minVelocity[3];
+
+			/**
+			 * \brief   The maximum velocity coordinates.
+			 */
+			float maxVelocity[3];
+		};
+
+	public:
 		/**
 		 * \brief   Constructs a <i>k</i>d-tree instance.
 		 * \param   sim  The simulator instance.
@@ -96,22 +134,348 @@ namespace RVO {
 
 		/**
 		 * \brief   Builds an agent <i>k</i>d-tree.
+		 * \note    With OpenMP, the subtrees of large nodes are built as concurrent tasks. If refitting is enabled and the set of agents is unchanged, the tree of the previous step is refit instead, unless its cost exceeds the rebuild threshold.
 		 */
-		void buildAgentTree();
-
-		void buildAgentTreeRecursive(size_t begin, size_t end, size_t node);
+		virtual void build();
 
 		/**
 		 * \brief   Computes the agent neighbors of the specified agent.
 		 * \param   agent    A pointer to the agent for which agent neighbors are to be computed.
+		 * \param   rangeSq  The squared range around the agent, in the neighbor metric of the agent.
+		 */
+		virtual void computeAgentNeighbors(Agent *agent, float rangeSq) const;
+
+		/**
+		 * \brief   Computes all agents within range of the specified agent as the candidates for its agent neighbors.
+		 * \param   agent    A pointer to the agent for which the candidates are to be computed.
 		 * \param   rangeSq  The squared range around the agent.
 		 */
-		void computeAgentNeighbors(Agent *agent, float rangeSq) const;
+		virtual void computeAgentNeighborCandidates(Agent *agent, float rangeSq) const;
+
+		/**
+		 * \brief   Computes the agent neighbors of all agents in one traversal of the agent <i>k</i>d-tree against itself.
+		 * \note    The agent neighbors are the same as those computed by computeAgentNeighbors() with the squared neighbor distance of each agent. Pairs of distant subtrees are pruned once for all of their agents instead of once per agent. Requires the dual-tree search to have been set before the last build, and leaves the agent neighbors to be copied to the agents by copyAgentNeighbors().
+		 */
+		void computeAllAgentNeighbors();
+
+		/**
+		 * \brief   Copies the agent neighbors of the specified agent computed by computeAllAgentNeighbors() to the agent.
+		 * \param   agent  A pointer to the agent.
+		 */
+		void copyAgentNeighbors(Agent *agent) const;
+
+		/**
+		 * \brief   Computes all agents within range of a point.
+		 * \param   point    The point.
+		 * \param   rangeSq  The squared range around the point.
+		 * \param   agents   A reference to the vector to which the agents within range are appended in no particular order.
+		 */
+		virtual void computeAgentsInRange(const Vector3 &point, float rangeSq, std::vector<const Agent *> &agents) const;
+
+		/**
+		 * \brief   Computes all agents within an axis-aligned box.
+		 * \param   minCoord  The minimum coordinates of the box.
+		 * \param   maxCoord  The maximum coordinates of the box.
+		 * \param   agents    A reference to the vector to which the agents within the box are appended in no particular order.
+		 */
+		virtual void computeAgentsInBox(const Vector3 &minCoord, const Vector3 &maxCoord, std::vector<const Agent *> &agents) const;
+
+		/**
+		 * \brief   Computes the agents nearest to a point.
+		 * \param   point      The point.
+		 * \param   rangeSq    The squared range around the point.
+		 * \param   maxAgents  The maximum number of agents to be computed.
+		 * \param   neighbors  An array of at least maxAgents elements that receives the squared distances to and pointers to the nearest agents in order of increasing distance.
+		 * \return  The number of agents computed.
+		 */
+		virtual size_t computeNearestAgents(const Vector3 &point, float rangeSq, size_t maxAgents, std::pair<float, const Agent *> *neighbors) const;
+
+		/**
+		 * \brief   Computes agents approximately nearest to a point and counts the nodes visited, as for the agent neighbors with an approximation.
+		 * \param   point      The point.
+		 * \param   rangeSq    The squared range around the point.
+		 * \param   maxAgents  The maximum number of agents to be computed.
+		 * \param   epsilon    The relative error of the distances to the agents, as by setApproximation().
+		 * \param   neighbors  An array of at least maxAgents elements that receives the squared distances to and pointers to the agents in order of increasing distance.
+		 * \param   numNodes   A reference to the number of nodes visited.
+		 * \return  The number of agents computed.
+		 */
+		size_t computeApproximateNearestAgents(const Vector3 &point, float rangeSq, size_t maxAgents, float epsilon, std::pair<float, const Agent *> *neighbors, size_t &numNodes) const;
+
+		/**
+		 * \brief   Returns whether a sphere swept along a segment is clear of agents.
+		 * \param   point1  The first point of the segment.
+		 * \param   point2  The second point of the segment.
+		 * \param   radius  The radius of the sphere swept along the segment.
+		 * \return  True if no agent blocks the visibility along the segment, as defined by blocksVisibility().
+		 */
+		virtual bool queryVisibility(const Vector3 &point1, const Vector3 &point2, float radius) const;
+
+		/**
+		 * \brief   Sets the relative error allowed in the distances to the agent neighbors.
+		 * \param   epsilon  The replacement relative error. Zero, the default, computes the exact agent neighbors. Otherwise, nodes farther than the range divided by one plus the relative error are pruned, so that the distance to the farthest agent neighbor is at most one plus the relative error times that of the exact agent neighbors.
+		 */
+		void setApproximation(float epsilon);
+
+		/**
+		 * \brief   Sets the method of building the agent <i>k</i>d-tree.
+		 * \param   buildMethod  The replacement method of building the agent <i>k</i>d-tree.
+		 */
+		void setBuildMethod(AgentTreeBuildMethod buildMethod);
+
+		/**
+		 * \brief   Sets the way of searching the agent <i>k</i>d-tree for the agent neighbors in each simulation step.
+		 * \param   neighborSearch  The replacement way of searching the agent <i>k</i>d-tree. With the dual-tree search, each build also records the neighbor distances, vertical weights of the neighbor metrics and maximum numbers of neighbors of the agents for computeAllAgentNeighbors(). With the bottom-up search, each rebuild also records the parent and sibling of each node and the leaf node of each agent, which a refit keeps, and each build or refit computes the cells of the nodes.
+		 */
+		void setNeighborSearch(AgentNeighborSearch neighborSearch);
+
+		/**
+		 * \brief   Sets whether the agent <i>k</i>d-tree of the previous build is refit instead of rebuilt.
+		 * \param   refit             True to refit the agent <i>k</i>d-tree while the set of agents is unchanged.
+		 * \param   rebuildThreshold  The ratio of the cost of the refit agent <i>k</i>d-tree to its cost when it was last rebuilt above which it is rebuilt.
+		 */
+		void setRefit(bool refit, float rebuildThreshold);
+
+		/**
+		 * \brief   Sets the maximum number of agents in a leaf node.
+		 * \param   leafSize  The replacement maximum number of agents in a leaf node, which is clamped to between 1 and 64.
+		 */
+		void setLeafSize(size_t leafSize);
+
+		/**
+		 * \brief   Sets the policy of choosing the split of a node when building by splitting.
+		 * \param   splitPolicy  The replacement policy of choosing the split of a node.
+		 */
+		void setSplitPolicy(AgentTreeSplitPolicy splitPolicy);
 
-		void queryAgentTreeRecursive(Agent *agent, float &rangeSq, size_t node) const;
+		/**
+		 * \brief   Sets whether the agent neighbors are searched for within the volumes swept by the agents over their time horizons.
+		 * \param   sweep  True to rank the agents by their squared distances of closest approach to each agent over its time horizon given their current velocities, false to rank them by their current squared distances. With the swept search, each build or refit also records the velocities of the agents and bounds them in each node.
+		 */
+		void setSweep(bool sweep);
+
+	private:
+		/**
+		 * \brief   Builds an agent <i>k</i>d-tree over a range of agents into the build nodes, splitting each node as chosen by chooseSplit().
+		 * \param   begin  The beginning of the range.
+		 * \param   end    The end of the range.
+		 * \param   node   The root build node of the tree. The left and right subtrees of an internal build node start at the build nodes node + 1 and node + 2 * (index - begin).
+		 * \return  The number of nodes of the tree.
+		 */
+		size_t buildAgentTreeRecursive(size_t begin, size_t end, size_t node);
+
+		/**
+		 * \brief   Builds an agent <i>k</i>d-tree over a range of agents sorted by Morton code into the build nodes, splitting each node where the highest differing bit of the Morton codes changes, and computes its bounding boxes bottom-up.
+		 * \param   begin  The beginning of the range.
+		 * \param   end    The end of the range.
+		 * \param   node   The root build node of the tree, laid out as by buildAgentTreeRecursive().
+		 * \return  The number of nodes of the tree.
+		 */
+		size_t buildMortonTreeRecursive(size_t begin, size_t end, size_t node);
+
+		/**
+		 * \brief   Chooses the coordinate and value at which a node is split according to the split policy.
+		 * \param   begin       The beginning of the range of agents of the node.
+		 * \param   end         The end of the range of agents of the node.
+		 * \param   treeNode    The node, whose bounding box has been computed.
+		 * \param   coord       A reference to the coordinate to split on.
+		 * \param   splitValue  A reference to the split value.
+		 */
+		void chooseSplit(size_t begin, size_t end, const AgentTreeNode &treeNode, size_t &coord, float &splitValue) const;
+
+		/**
+		 * \brief   Copies an agent <i>k</i>d-tree from the build nodes into the nodes in depth-first order without gaps.
+		 * \param   buildNode  The root build node of the tree.
+		 * \param   begin      The beginning of the range of agents of the tree.
+		 * \param   node       The node to which the root is copied.
+		 * \return  The node following the copied tree.
+		 */
+		size_t compactAgentTreeRecursive(size_t buildNode, size_t begin, size_t node);
+
+		/**
+		 * \brief   Computes the bounding box of a range of agents.
+		 * \param   begin     The beginning of the range.
+		 * \param   end       The end of the range. Must be greater than begin.
+		 * \param   minCoord  An array of three elements that receives the minimum coordinates.
+		 * \param   maxCoord  An array of three elements that receives the maximum coordinates.
+		 */
+		void computeBoundingBox(size_t begin, size_t end, float *minCoord, float *maxCoord) const;
+
+		/**
+		 * \brief   Computes the bounding box of a range of agents using one task per thread of the enclosing parallel region.
+		 * \param   begin     The beginning of the range.
+		 * \param   end       The end of the range. Must be greater than begin.
+		 * \param   minCoord  An array of three elements that receives the minimum coordinates.
+		 * \param   maxCoord  An array of three elements that receives the maximum coordinates.
+		 */
+		void computeBoundingBoxParallel(size_t begin, size_t end, float *minCoord, float *maxCoord) const;
+
+		/**
+		 * \brief   Partitions a range of agents such that the agents with a coordinate less than the split value precede the others.
+		 * \param   begin       The beginning of the range.
+		 * \param   end         The end of the range.
+		 * \param   coord       The coordinate to split on.
+		 * \param   splitValue  The split value.
+		 * \return  The end of the range of agents with a coordinate less than the split value.
+		 */
+		size_t partitionAgents(size_t begin, size_t end, size_t coord, float splitValue);
+
+		/**
+		 * \brief   Partitions a range of agents using one task per thread of the enclosing parallel region.
+		 * \param   begin       The beginning of the range.
+		 * \param   end         The end of the range.
+		 * \param   coord       The coordinate to split on.
+		 * \param   splitValue  The split value.
+		 * \return  The end of the range of agents with a coordinate less than the split value.
+		 */
+		size_t partitionAgentsParallel(size_t begin, size_t end, size_t coord, float splitValue);
+
+		/**
+		 * \brief   Sorts the agents by the 63-bit Morton codes of their positions within their bounding box using a parallel radix sort.
+		 */
+		void sortAgentsByMortonCode();
+
+		/**
+		 * \brief   Computes the cost of an agent <i>k</i>d-tree, which is the sum of the surface areas of the bounding boxes of its nodes.
+		 * \param   node  The root node of the tree.
+		 * \return  The cost of the tree.
+		 */
+		float computeAgentTreeCost(size_t node) const;
+
+		/**
+		 * \brief   Recomputes the bounding boxes of an agent <i>k</i>d-tree bottom-up while keeping its topology.
+		 * \param   node  The root node of the tree.
+		 * \return  The cost of the refit tree.
+		 */
+		float refitAgentTreeRecursive(size_t node);
+
+		/**
+		 * \brief   Copies the positions of the agents, and their velocities for the swept search, into contiguous arrays in the order of the agent <i>k</i>d-tree, so that the agents of each leaf node are stored together.
+		 */
+		void updateAgentPositions();
+
+		/**
+		 * \brief   Passes the agents of an agent <i>k</i>d-tree within range of a point to a collector, nearer subtrees first, and lets the collector shrink the range. The distances may weight the vertical axis, which makes the range an ellipsoid.
+		 * \param   point           The point.
+		 * \param   rangeSq         The squared range around the point.
+		 * \param   collector       The collector, which provides insertAgentNeighbor(const Agent *agent, float distSq, float &rangeSq).
+		 * \param   node            The root node of the tree.
+		 * \param   rangeScale      The factor by which the squared range is scaled before the nodes are pruned, which is one for an exact query.
+		 * \param   verticalWeight  The factor by which squared vertical distances are scaled, which is one for a spherical range.
+		 * \return  The number of nodes visited.
+		 */
+		template <typename Collector>
+		size_t queryAgentTree(const Vector3 &point, float &rangeSq, Collector &collector, size_t node, float rangeScale, float verticalWeight) const;
+
+		/**
+		 * \brief   Passes the agents within range of a point to a collector as queryAgentTree() does, starting at a leaf node and querying the siblings of its ancestors until the range lies within the cell of an ancestor.
+		 * \param   point           The point, which must lie within the bounding box of the leaf node.
+		 * \param   rangeSq         The squared range around the point.
+		 * \param   collector       The collector, as for queryAgentTree().
+		 * \param   leaf            The leaf node.
+		 * \param   rangeScale      The factor by which the squared range is scaled before the nodes are pruned.
+		 * \param   verticalWeight  The factor by which squared vertical distances are scaled.
+		 * \return  The number of nodes visited.
+		 */
+		template <typename Collector>
+		size_t queryAgentTreeBottomUp(const Vector3 &point, float &rangeSq, Collector &collector, size_t leaf, float rangeScale, float verticalWeight) const;
+
+		/**
+		 * \brief   Passes the agents within range of a moving point at their closest approach to it to a collector as queryAgentTree() does, assuming that the point and the agents keep their current velocities. Each node is pruned by the hull of its bounding box at the start and at the end of the time horizon relative to the point, which contains its agents throughout.
+		 * \param   point           The point.
+		 * \param   velocity        The velocity of the point.
+		 * \param   timeHorizon     The time horizon over which the agents are swept.
+		 * \param   rangeSq         The squared range around the point.
+		 * \param   collector       The collector, as for queryAgentTree().
+		 * \param   node            The root node of the tree.
+		 * \param   rangeScale      The factor by which the squared range is scaled before the nodes are pruned.
+		 * \param   verticalWeight  The factor by which squared vertical distances are scaled.
+		 * \return  The number of nodes visited.
+		 */
+		template <typename Collector>
+		size_t queryAgentTreeSwept(const Vector3 &point, const Vector3 &velocity, float timeHorizon, float &rangeSq, Collector &collector, size_t node, float rangeScale, float verticalWeight) const;
+
+		/**
+		 * \brief   Computes the bounds of the velocities of the agents of each node of the agent <i>k</i>d-tree for the swept search bottom-up.
+		 */
+		void updateAgentVelocities();
+
+		/**
+		 * \brief   Computes the cells of the nodes of the agent <i>k</i>d-tree for the bottom-up search top-down. The cell of a child is the cell of its parent cut off at the bounding box of its sibling along a coordinate on which their bounding boxes do not overlap, or empty if they overlap on all coordinates, as they may after a refit.
+		 */
+		void updateAgentCells();
+
+		/**
+		 * \brief   Records the parent and sibling of each node of the agent <i>k</i>d-tree and the leaf node of each agent by agent number for the bottom-up search.
+		 */
+		void updateAgentLeaves();
+
+		/**
+		 * \brief   Inserts the agents of an agent <i>k</i>d-tree into the agent neighbors of the agents of another agent <i>k</i>d-tree within their neighbor distances, splitting the larger tree of each pair of nodes and pruning pairs farther apart than the largest range of the agents of the first tree.
+		 * \param   queryNode  The root node of the tree whose agents receive agent neighbors.
+		 * \param   node       The root node of the tree whose agents are inserted.
+		 */
+		void queryAgentTreePair(size_t queryNode, size_t node);
+
+		/**
+		 * \brief   Appends the agents of an agent <i>k</i>d-tree within an axis-aligned box to a vector.
+		 * \param   minCoord  The minimum coordinates of the box.
+		 * \param   maxCoord  The maximum coordinates of the box.
+		 * \param   agents    A reference to the vector to which the agents within the box are appended.
+		 * \param   node      The root node of the tree.
+		 */
+		void queryAgentTreeBox(const float *minCoord, const float *maxCoord, std::vector<const Agent *> &agents, size_t node) const;
+
+		/**
+		 * \brief   Returns whether the agents of an agent <i>k</i>d-tree leave a sphere swept along a segment clear.
+		 * \param   point1  The first point of the segment.
+		 * \param   point2  The second point of the segment.
+		 * \param   radius  The radius of the sphere swept along the segment.
+		 * \param   node    The root node of the tree.
+		 * \return  True if no agent of the tree blocks the visibility along the segment.
+		 */
+		bool queryVisibilityRecursive(const Vector3 &point1, const Vector3 &point2, float radius, size_t node) const;
 
 		std::vector<Agent *> agents_;
+		std::vector<Agent *> buildBuffer_;
+		std::vector<Vector3> buildPositions_;
+		std::vector<Vector3> buildPositionBuffer_;
 		std::vector<AgentTreeNode> agentTree_;
+		std::vector<AgentTreeCell> agentCells_;
+		std::vector<AgentTreeVelocityBox> agentVelocities_;
+		std::vector<AgentTreeNode> buildTree_;
+		std::vector<uint64_t> mortonCodes_;
+		std::vector<uint64_t> mortonBuffer_;
+		std::vector<size_t> radixHistograms_;
+		std::vector<float> positionsX_;
+		std::vector<float> positionsY_;
+		std::vector<float> positionsZ_;
+		std::vector<float> velocitiesX_;
+		std::vector<float> velocitiesY_;
+		std::vector<float> velocitiesZ_;
+		std::vector<float> agentRangeSqs_;
+		std::vector<size_t> maxNeighbors_;
+		std::vector<float> neighborDistSqs_;
+		std::vector<float> verticalWeights_;
+		std::vector<size_t> treeIndices_;
+		std::vector<uint32_t> leafNodes_;
+		std::vector<size_t> neighborCounts_;
+		std::vector<size_t> neighborOffsets_;
+		std::vector<AgentNeighbor> neighbors_;
+		std::vector<float> queryRangeSqs_;
+		bool refit_;
+		bool rebuild_;
+		bool sweep_;
+		float approximationScale_;
+		float buildCost_;
+		float maxAgentRadius_;
+		float maxNeighborDistSq_;
+		float minVerticalWeight_;
+		float rebuildThreshold_;
+		size_t leafSize_;
+		AgentTreeBuildMethod buildMethod_;
+		AgentNeighborSearch neighborSearch_;
+		AgentTreeSplitPolicy splitPolicy_;
 		RVOSimulator *sim_;
 
 		friend class Agent;
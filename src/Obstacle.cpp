@@ -0,0 +1,94 @@
+/*
+ * Obstacle.cpp
+ * RVO2-3D Library
+ *
+ * Copyright 2008 University of North Carolina at Chapel Hill
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Please send all bug reports to <geom@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Jur van den Berg, Stephen J. Guy, Jamie Snape, Ming C. Lin, Dinesh Manocha
+ * Dept. of Computer Science
+ * 201 S. Columbia St.
+ * Frederick P. Brooks, Jr. Computer Science Bldg.
+ * Chapel Hill, N.C. 27599-3175
+ * United States of America
+ *
+ * <http://gamma.cs.unc.edu/RVO2/>
+ */
+
+#include "Obstacle.h"
+
+namespace RVO {
+	Obstacle::Obstacle(const Vector3 &vertex0, const Vector3 &vertex1, const Vector3 &vertex2, size_t id) : id_(id)
+	{
+		vertices_[0] = vertex0;
+		vertices_[1] = vertex1;
+		vertices_[2] = vertex2;
+	}
+
+	Vector3 Obstacle::computeClosestPoint(const Vector3 &point) const
+	{
+		/* Find the Voronoi region of the triangle that contains the point, as in Ericson, Real-Time Collision Detection, Section 5.1.5. */
+		const Vector3 edge01 = vertices_[1] - vertices_[0];
+		const Vector3 edge02 = vertices_[2] - vertices_[0];
+		const Vector3 relativePoint0 = point - vertices_[0];
+		const float d1 = edge01 * relativePoint0;
+		const float d2 = edge02 * relativePoint0;
+
+		if (d1 <= 0.0f && d2 <= 0.0f) {
+			return vertices_[0];
+		}
+
+		const Vector3 relativePoint1 = point - vertices_[1];
+		const float d3 = edge01 * relativePoint1;
+		const float d4 = edge02 * relativePoint1;
+
+		if (d3 >= 0.0f && d4 <= d3) {
+			return vertices_[1];
+		}
+
+		const float vc = d1 * d4 - d3 * d2;
+
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+			return vertices_[0] + (d1 / (d1 - d3)) * edge01;
+		}
+
+		const Vector3 relativePoint2 = point - vertices_[2];
+		const float d5 = edge01 * relativePoint2;
+		const float d6 = edge02 * relativePoint2;
+
+		if (d6 >= 0.0f && d5 <= d6) {
+			return vertices_[2];
+		}
+
+		const float vb = d5 * d2 - d1 * d6;
+
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+			return vertices_[0] + (d2 / (d2 - d6)) * edge02;
+		}
+
+		const float va = d3 * d6 - d5 * d4;
+
+		if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+			return vertices_[1] + ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (vertices_[2] - vertices_[1]);
+		}
+
+		const float denominator = 1.0f / (va + vb + vc);
+
+		return vertices_[0] + (vb * denominator) * edge01 + (vc * denominator) * edge02;
+	}
+}
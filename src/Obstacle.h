@@ -0,0 +1,76 @@
+/*
+ * Obstacle.h
+ * RVO2-3D Library
+ *
+ * Copyright 2008 University of North Carolina at Chapel Hill
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Please send all bug reports to <geom@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Jur van den Berg, Stephen J. Guy, Jamie Snape, Ming C. Lin, Dinesh Manocha
+ * Dept. of Computer Science
+ * 201 S. Columbia St.
+ * Frederick P. Brooks, Jr. Computer Science Bldg.
+ * Chapel Hill, N.C. 27599-3175
+ * United States of America
+ *
+ * <http://gamma.cs.unc.edu/RVO2/>
+ */
+/**
+ * \file    Obstacle.h
+ * \brief   Contains the Obstacle class.
+ */
+#ifndef RVO_OBSTACLE_H_
+#define RVO_OBSTACLE_H_
+
+#include "API.h"
+
+#include <cstddef>
+
+#include "Vector3.h"
+
+namespace RVO {
+	/**
+	 * \brief   Defines a triangle of a static obstacle in the simulation.
+	 */
+	class Obstacle {
+	private:
+		/**
+		 * \brief   Constructs a static obstacle triangle instance.
+		 * \param   vertex0  The first vertex of the triangle.
+		 * \param   vertex1  The second vertex of the triangle.
+		 * \param   vertex2  The third vertex of the triangle.
+		 * \param   id       The number of the obstacle to which the triangle belongs.
+		 */
+		Obstacle(const Vector3 &vertex0, const Vector3 &vertex1, const Vector3 &vertex2, size_t id);
+
+		/**
+		 * \brief   Computes the point of this triangle nearest to a point.
+		 * \param   point  The point.
+		 * \return  The nearest point of this triangle.
+		 */
+		Vector3 computeClosestPoint(const Vector3 &point) const;
+
+		Vector3 vertices_[3];
+		size_t id_;
+
+		friend class Agent;
+		friend class ObstacleTree;
+		friend class RVOSimulator;
+	};
+}
+
+#endif /* RVO_OBSTACLE_H_ */
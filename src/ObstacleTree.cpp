@@ -0,0 +1,198 @@
+/*
+ * ObstacleTree.cpp
+ * RVO2-3D Library
+ *
+ * Copyright 2008 University of North Carolina at Chapel Hill
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Please send all bug reports to <geom@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Jur van den Berg, Stephen J. Guy, Jamie Snape, Ming C. Lin, Dinesh Manocha
+ * Dept. of Computer Science
+ * 201 S. Columbia St.
+ * Frederick P. Brooks, Jr. Computer Science Bldg.
+ * Chapel Hill, N.C. 27599-3175
+ * United States of America
+ *
+ * <http://gamma.cs.unc.edu/RVO2/>
+ */
+
+#include "ObstacleTree.h"
+
+#include <algorithm>
+
+#include "Agent.h"
+#include "AgentStore.h"
+#include "Definitions.h"
+#include "Obstacle.h"
+#include "RVOSimulator.h"
+
+namespace RVO {
+	/**
+	 * \brief   The maximum number of static obstacle triangles in a leaf node.
+	 */
+	const size_t RVO_MAX_OBSTACLE_LEAF_SIZE = 4;
+
+	float ObstacleTree::computeDistSq(const Vector3 &point, const ObstacleTreeNode &treeNode)
+	{
+		float distSq = 0.0f;
+
+		for (size_t i = 0; i < 3; ++i) {
+			distSq += sqr(std::max(0.0f, treeNode.minCoord[i] - point[i])) + sqr(std::max(0.0f, point[i] - treeNode.maxCoord[i]));
+		}
+
+		return distSq;
+	}
+
+	ObstacleTree::ObstacleTree(RVOSimulator *sim) : sim_(sim) { }
+
+	void ObstacleTree::build()
+	{
+		obstacles_.assign(sim_->obstacles_.begin(), sim_->obstacles_.end());
+		obstacleTree_.clear();
+
+		if (!obstacles_.empty()) {
+			obstacleTree_.reserve(2 * obstacles_.size() - 1);
+			buildObstacleTreeRecursive(0, obstacles_.size());
+		}
+	}
+
+	void ObstacleTree::buildObstacleTreeRecursive(size_t begin, size_t end)
+	{
+		const size_t node = obstacleTree_.size();
+		obstacleTree_.push_back(ObstacleTreeNode());
+
+		/* The centroids are compared as the sums of the vertices. */
+		float minCoord[3];
+		float maxCoord[3];
+		float minCentroid[3];
+		float maxCentroid[3];
+
+		for (size_t i = 0; i < 3; ++i) {
+			minCoord[i] = maxCoord[i] = obstacles_[begin]->vertices_[0][i];
+			minCentroid[i] = maxCentroid[i] = obstacles_[begin]->vertices_[0][i] + obstacles_[begin]->vertices_[1][i] + obstacles_[begin]->vertices_[2][i];
+		}
+
+		for (size_t i = begin; i < end; ++i) {
+			const Vector3 *const vertices = obstacles_[i]->vertices_;
+
+			for (size_t j = 0; j < 3; ++j) {
+				minCoord[j] = std::min(minCoord[j], std::min(vertices[0][j], std::min(vertices[1][j], vertices[2][j])));
+				maxCoord[j] = std::max(maxCoord[j], std::max(vertices[0][j], std::max(vertices[1][j], vertices[2][j])));
+				minCentroid[j] = std::min(minCentroid[j], vertices[0][j] + vertices[1][j] + vertices[2][j]);
+				maxCentroid[j] = std::max(maxCentroid[j], vertices[0][j] + vertices[1][j] + vertices[2][j]);
+			}
+		}
+
+		for (size_t i = 0; i < 3; ++i) {
+			obstacleTree_[node].minCoord[i] = minCoord[i];
+			obstacleTree_[node].maxCoord[i] = maxCoord[i];
+		}
+
+		if (end - begin <= RVO_MAX_OBSTACLE_LEAF_SIZE) {
+			obstacleTree_[node].index = static_cast<uint32_t>(begin);
+			obstacleTree_[node].count = static_cast<uint32_t>(end - begin);
+
+			return;
+		}
+
+		size_t coord = 0;
+
+		for (size_t i = 1; i < 3; ++i) {
+			if (maxCentroid[i] - minCentroid[i] > maxCentroid[coord] - minCentroid[coord]) {
+				coord = i;
+			}
+		}
+
+		const float splitValue = 0.5f * (minCentroid[coord] + maxCentroid[coord]);
+
+		size_t left = begin;
+		size_t right = end;
+
+		while (left < right) {
+			while (left < right && obstacles_[left]->vertices_[0][coord] + obstacles_[left]->vertices_[1][coord] + obstacles_[left]->vertices_[2][coord] < splitValue) {
+				++left;
+			}
+
+			while (right > left && obstacles_[right - 1]->vertices_[0][coord] + obstacles_[right - 1]->vertices_[1][coord] + obstacles_[right - 1]->vertices_[2][coord] >= splitValue) {
+				--right;
+			}
+
+			if (left < right) {
+				std::swap(obstacles_[left], obstacles_[right - 1]);
+				++left;
+				--right;
+			}
+		}
+
+		/* Triangles with coincident centroids are split by count. */
+		if (left == begin || left == end) {
+			left = begin + (end - begin) / 2;
+		}
+
+		obstacleTree_[node].count = 0;
+
+		buildObstacleTreeRecursive(begin, left);
+		obstacleTree_[node].index = static_cast<uint32_t>(obstacleTree_.size());
+		buildObstacleTreeRecursive(left, end);
+	}
+
+	void ObstacleTree::computeObstacleNeighbors(Agent *agent, float rangeSq) const
+	{
+		if (!obstacleTree_.empty() && computeDistSq(sim_->agentStore_->positions_[agent->slot_], obstacleTree_[0]) < rangeSq) {
+			queryObstacleTreeRecursive(agent, rangeSq, 0);
+		}
+	}
+
+	void ObstacleTree::queryObstacleTreeRecursive(Agent *agent, float rangeSq, size_t node) const
+	{
+		const ObstacleTreeNode &treeNode = obstacleTree_[node];
+		const Vector3 &position = sim_->agentStore_->positions_[agent->slot_];
+
+		if (treeNode.count != 0) {
+			const size_t end = treeNode.index + treeNode.count;
+
+			for (size_t i = treeNode.index; i < end; ++i) {
+				const Vector3 point = obstacles_[i]->computeClosestPoint(position);
+				const float distSq = absSq(point - position);
+
+				if (distSq < rangeSq) {
+					agent->insertObstacleNeighbor(obstacles_[i], point, distSq);
+				}
+			}
+		}
+		else {
+			/* Visit the nearer child first, so that the planes of nearer triangles can cover farther nodes. */
+			size_t nearNode = node + 1;
+			size_t farNode = treeNode.index;
+			float nearDistSq = computeDistSq(position, obstacleTree_[nearNode]);
+			float farDistSq = computeDistSq(position, obstacleTree_[farNode]);
+
+			if (farDistSq < nearDistSq) {
+				std::swap(nearNode, farNode);
+				std::swap(nearDistSq, farDistSq);
+			}
+
+			if (nearDistSq < rangeSq && !agent->isObstacleCovered(obstacleTree_[nearNode].minCoord, obstacleTree_[nearNode].maxCoord)) {
+				queryObstacleTreeRecursive(agent, rangeSq, nearNode);
+			}
+
+			if (farDistSq < rangeSq && !agent->isObstacleCovered(obstacleTree_[farNode].minCoord, obstacleTree_[farNode].maxCoord)) {
+				queryObstacleTreeRecursive(agent, rangeSq, farNode);
+			}
+		}
+	}
+}
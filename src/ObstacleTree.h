@@ -0,0 +1,134 @@
+/*
+ * ObstacleTree.h
+ * RVO2-3D Library
+ *
+ * Copyright 2008 University of North Carolina at Chapel Hill
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Please send all bug reports to <geom@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Jur van den Berg, Stephen J. Guy, Jamie Snape, Ming C. Lin, Dinesh Manocha
+ * Dept. of Computer Science
+ * 201 S. Columbia St.
+ * Frederick P. Brooks, Jr. Computer Science Bldg.
+ * Chapel Hill, N.C. 27599-3175
+ * United States of America
+ *
+ * <http://gamma.cs.unc.edu/RVO2/>
+ */
+/**
+ * \file    ObstacleTree.h
+ * \brief   Contains the ObstacleTree class.
+ */
+#ifndef RVO_OBSTACLE_TREE_H_
+#define RVO_OBSTACLE_TREE_H_
+
+#include "API.h"
+
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+#include "Vector3.h"
+
+namespace RVO {
+	class Agent;
+	class Obstacle;
+	class RVOSimulator;
+
+	/**
+	 * \brief   Defines bounding volume hierarchies for the static obstacle triangles in the simulation.
+	 *
+	 * The hierarchy is built once when the obstacles are processed, so that static obstacles cost only a query per agent and step.
+	 */
+	class ObstacleTree {
+	private:
+		/**
+		 * \brief   Defines an obstacle tree node.
+		 */
+		class ObstacleTreeNode {
+		public:
+			/**
+			 * \brief   The minimum coordinates.
+			 */
+			float minCoord[3];
+
+			/**
+			 * \brief   The beginning obstacle number of a leaf node, or the right node number of an internal node. The left node of an internal node immediately follows it.
+			 */
+			uint32_t index;
+
+			/**
+			 * \brief   The maximum coordinates.
+			 */
+			float maxCoord[3];
+
+			/**
+			 * \brief   The number of obstacles of a leaf node, or zero for an internal node.
+			 */
+			uint32_t count;
+		};
+
+	public:
+		/**
+		 * \brief   Constructs an obstacle tree instance.
+		 * \param   sim  The simulator instance.
+		 */
+		explicit ObstacleTree(RVOSimulator *sim);
+
+		/**
+		 * \brief   Builds an obstacle tree over the static obstacle triangles of the simulation.
+		 */
+		void build();
+
+		/**
+		 * \brief   Computes the static obstacle neighbors of the specified agent and their ORCA planes.
+		 * \param   agent    A pointer to the agent for which static obstacle neighbors are to be computed.
+		 * \param   rangeSq  The squared range around the agent.
+		 */
+		void computeObstacleNeighbors(Agent *agent, float rangeSq) const;
+
+	private:
+		/**
+		 * \brief   Builds an obstacle tree over a range of static obstacle triangles, splitting each node at the midpoint of the centroids of its triangles along their largest extent.
+		 * \param   begin  The beginning of the range.
+		 * \param   end    The end of the range.
+		 */
+		void buildObstacleTreeRecursive(size_t begin, size_t end);
+
+		/**
+		 * \brief   Computes the squared distance from a point to the bounding box of an obstacle tree node.
+		 * \param   point     The point.
+		 * \param   treeNode  The node.
+		 * \return  The squared distance, which is zero if the point lies within the bounding box.
+		 */
+		static float computeDistSq(const Vector3 &point, const ObstacleTreeNode &treeNode);
+
+		/**
+		 * \brief   Passes the static obstacle triangles of an obstacle tree within range of an agent to the agent, nearer subtrees first, skipping subtrees covered by the ORCA planes the agent has created so far.
+		 * \param   agent    A pointer to the agent.
+		 * \param   rangeSq  The squared range around the agent.
+		 * \param   node     The root node of the tree.
+		 */
+		void queryObstacleTreeRecursive(Agent *agent, float rangeSq, size_t node) const;
+
+		std::vector<const Obstacle *> obstacles_;
+		std::vector<ObstacleTreeNode> obstacleTree_;
+		RVOSimulator *sim_;
+	};
+}
+
+#endif /* RVO_OBSTACLE_TREE_H_ */
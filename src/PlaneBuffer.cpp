@@ -0,0 +1,226 @@
+/*
+ * PlaneBuffer.cpp
+ * RVO2-3D Library
+ *
+ * Copyright 2008 University of North Carolina at Chapel Hill
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Please send all bug reports to <geom@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Jur van den Berg, Stephen J. Guy, Jamie Snape, Ming C. Lin, Dinesh Manocha
+ * Dept. of Computer Science
+ * 201 S. Columbia St.
+ * Frederick P. Brooks, Jr. Computer Science Bldg.
+ * Chapel Hill, N.C. 27599-3175
+ * United States of America
+ *
+ * <http://gamma.cs.unc.edu/RVO2/>
+ */
+
+#include "PlaneBuffer.h"
+
+#include <cmath>
+
+#include "Definitions.h"
+
+namespace RVO {
+#ifdef RVO_USE_SSE
+	/**
+	 * \brief   Computes four ORCA planes at once.
+	 * \param   relativePositions   The coordinates of the positions of the spheres relative to the agent, one array per axis.
+	 * \param   relativeVelocities  The coordinates of the velocities of the agent relative to the spheres, one array per axis.
+	 * \param   combinedRadii       The sums of the radii of the agent and the spheres.
+	 * \param   invTimeHorizon      The inverse of the time horizon of the agent.
+	 * \param   invTimeStep         The inverse of the time step of the simulation.
+	 * \param   velocity            The velocity of the agent.
+	 * \param   responsibility      The share of the avoidance taken by the agent.
+	 * \param   points              The arrays that receive the coordinates of the points of the planes.
+	 * \param   normals             The arrays that receive the coordinates of the normals of the planes.
+	 */
+	inline void computeFourORCAPlanes(const float *const relativePositions[3], const float *const relativeVelocities[3], const float *combinedRadii, float invTimeHorizon, float invTimeStep, const Vector3 &velocity, float responsibility, float *const points[3], float *const normals[3])
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 invTimeHorizon4 = _mm_set1_ps(invTimeHorizon);
+
+		const __m128 px = _mm_loadu_ps(relativePositions[0]);
+		const __m128 py = _mm_loadu_ps(relativePositions[1]);
+		const __m128 pz = _mm_loadu_ps(relativePositions[2]);
+		const __m128 vx = _mm_loadu_ps(relativeVelocities[0]);
+		const __m128 vy = _mm_loadu_ps(relativeVelocities[1]);
+		const __m128 vz = _mm_loadu_ps(relativeVelocities[2]);
+		const __m128 combinedRadius = _mm_loadu_ps(combinedRadii);
+
+		const __m128 distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py)), _mm_mul_ps(pz, pz));
+		const __m128 combinedRadiusSq = _mm_mul_ps(combinedRadius, combinedRadius);
+
+		/* Vector from cutoff center to relative velocity. */
+		__m128 wx = _mm_sub_ps(vx, _mm_mul_ps(invTimeHorizon4, px));
+		__m128 wy = _mm_sub_ps(vy, _mm_mul_ps(invTimeHorizon4, py));
+		__m128 wz = _mm_sub_ps(vz, _mm_mul_ps(invTimeHorizon4, pz));
+		const __m128 wLengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, wx), _mm_mul_ps(wy, wy)), _mm_mul_ps(wz, wz));
+		const __m128 dotProduct = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, px), _mm_mul_ps(wy, py)), _mm_mul_ps(wz, pz));
+
+		const __m128 noCollision = _mm_cmpgt_ps(distSq, combinedRadiusSq);
+		const __m128 cutoff = _mm_and_ps(_mm_cmplt_ps(dotProduct, zero), _mm_cmpgt_ps(_mm_mul_ps(dotProduct, dotProduct), _mm_mul_ps(combinedRadiusSq, wLengthSq)));
+
+		/* Project on cone, in every lane. The lanes of the other branches are discarded below. */
+		const __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, vx), _mm_mul_ps(py, vy)), _mm_mul_ps(pz, vz));
+		const __m128 cx = _mm_sub_ps(_mm_mul_ps(py, vz), _mm_mul_ps(pz, vy));
+		const __m128 cy = _mm_sub_ps(_mm_mul_ps(pz, vx), _mm_mul_ps(px, vz));
+		const __m128 cz = _mm_sub_ps(_mm_mul_ps(px, vy), _mm_mul_ps(py, vx));
+		const __m128 crossLengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)), _mm_mul_ps(cz, cz));
+		const __m128 velocityLengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+		const __m128 c = _mm_sub_ps(velocityLengthSq, _mm_div_ps(crossLengthSq, _mm_sub_ps(distSq, combinedRadiusSq)));
+		const __m128 t = _mm_div_ps(_mm_add_ps(b, _mm_sqrt_ps(_mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(distSq, c)))), distSq);
+
+		/* Each branch projects on a sphere centered at the relative position scaled by a factor, which is the inverse time horizon for the cutoff sphere, t for the cone and the inverse time step for a collision. */
+		const __m128 coneOrCutoff = _mm_or_ps(_mm_and_ps(cutoff, invTimeHorizon4), _mm_andnot_ps(cutoff, t));
+		const __m128 scale = _mm_or_ps(_mm_and_ps(noCollision, coneOrCutoff), _mm_andnot_ps(noCollision, _mm_set1_ps(invTimeStep)));
+
+		wx = _mm_sub_ps(vx, _mm_mul_ps(scale, px));
+		wy = _mm_sub_ps(vy, _mm_mul_ps(scale, py));
+		wz = _mm_sub_ps(vz, _mm_mul_ps(scale, pz));
+		const __m128 wLength = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, wx), _mm_mul_ps(wy, wy)), _mm_mul_ps(wz, wz)));
+		const __m128 invWLength = _mm_div_ps(one, wLength);
+		const __m128 unitWX = _mm_mul_ps(wx, invWLength);
+		const __m128 unitWY = _mm_mul_ps(wy, invWLength);
+		const __m128 unitWZ = _mm_mul_ps(wz, invWLength);
+		const __m128 uLength = _mm_sub_ps(_mm_mul_ps(combinedRadius, scale), wLength);
+		const __m128 responsibility4 = _mm_set1_ps(responsibility);
+
+		_mm_storeu_ps(normals[0], unitWX);
+		_mm_storeu_ps(normals[1], unitWY);
+		_mm_storeu_ps(normals[2], unitWZ);
+		_mm_storeu_ps(points[0], _mm_add_ps(_mm_set1_ps(velocity.x()), _mm_mul_ps(responsibility4, _mm_mul_ps(uLength, unitWX))));
+		_mm_storeu_ps(points[1], _mm_add_ps(_mm_set1_ps(velocity.y()), _mm_mul_ps(responsibility4, _mm_mul_ps(uLength, unitWY))));
+		_mm_storeu_ps(points[2], _mm_add_ps(_mm_set1_ps(velocity.z()), _mm_mul_ps(responsibility4, _mm_mul_ps(uLength, unitWZ))));
+	}
+#endif
+
+	Plane computeORCAPlane(const Vector3 &relativePosition, const Vector3 &relativeVelocity, float combinedRadius, float invTimeHorizon, float invTimeStep, const Vector3 &velocity, float responsibility)
+	{
+		const float distSq = absSq(relativePosition);
+		const float combinedRadiusSq = sqr(combinedRadius);
+
+		Plane plane;
+		Vector3 u;
+
+		if (distSq > combinedRadiusSq) {
+			/* No collision. */
+			const Vector3 w = relativeVelocity - invTimeHorizon * relativePosition;
+			/* Vector from cutoff center to relative velocity. */
+			const float wLengthSq = absSq(w);
+
+			const float dotProduct = w * relativePosition;
+
+			if (dotProduct < 0.0f && sqr(dotProduct) > combinedRadiusSq * wLengthSq) {
+				/* Project on cut-off circle. */
+				const float wLength = std::sqrt(wLengthSq);
+				const Vector3 unitW = w / wLength;
+
+				plane.normal = unitW;
+				u = (combinedRadius * invTimeHorizon - wLength) * unitW;
+			}
+			else {
+				/* Project on cone. */
+				const float a = distSq;
+				const float b = relativePosition * relativeVelocity;
+				const float c = absSq(relativeVelocity) - absSq(cross(relativePosition, relativeVelocity)) / (distSq - combinedRadiusSq);
+				const float t = (b + std::sqrt(sqr(b) - a * c)) / a;
+				const Vector3 w = relativeVelocity - t * relativePosition;
+				const float wLength = abs(w);
+				const Vector3 unitW = w / wLength;
+
+				plane.normal = unitW;
+				u = (combinedRadius * t - wLength) * unitW;
+			}
+		}
+		else {
+			/* Collision. */
+			const Vector3 w = relativeVelocity - invTimeStep * relativePosition;
+			const float wLength = abs(w);
+			const Vector3 unitW = w / wLength;
+
+			plane.normal = unitW;
+			u = (combinedRadius * invTimeStep - wLength) * unitW;
+		}
+
+		plane.point = velocity + responsibility * u;
+
+		return plane;
+	}
+
+	void computeORCAPlanes(const float *const relativePositions[3], const float *const relativeVelocities[3], const float *combinedRadii, size_t count, float invTimeHorizon, float invTimeStep, const Vector3 &velocity, float responsibility, PlaneBuffer &planes)
+	{
+		const size_t begin = planes.size();
+		planes.resize(begin + count);
+
+		size_t i = 0;
+
+#ifdef RVO_USE_SSE
+		for (; i + 4 <= count; i += 4) {
+			const float *const groupPositions[3] = { relativePositions[0] + i, relativePositions[1] + i, relativePositions[2] + i };
+			const float *const groupVelocities[3] = { relativeVelocities[0] + i, relativeVelocities[1] + i, relativeVelocities[2] + i };
+			float *const points[3] = { planes.points(0) + begin + i, planes.points(1) + begin + i, planes.points(2) + begin + i };
+			float *const normals[3] = { planes.normals(0) + begin + i, planes.normals(1) + begin + i, planes.normals(2) + begin + i };
+
+			computeFourORCAPlanes(groupPositions, groupVelocities, combinedRadii + i, invTimeHorizon, invTimeStep, velocity, responsibility, points, normals);
+		}
+
+		if (i < count) {
+			/* Pad the last group by repeating its first sphere, and keep only the planes of its spheres. */
+			const size_t groupBegin = i;
+			float groupValues[7][4];
+			float planeValues[6][4];
+
+			for (size_t j = 0; j < 4; ++j) {
+				const size_t k = i + j < count ? i + j : i;
+
+				for (size_t axis = 0; axis < 3; ++axis) {
+					groupValues[axis][j] = relativePositions[axis][k];
+					groupValues[3 + axis][j] = relativeVelocities[axis][k];
+				}
+
+				groupValues[6][j] = combinedRadii[k];
+			}
+
+			const float *const groupPositions[3] = { groupValues[0], groupValues[1], groupValues[2] };
+			const float *const groupVelocities[3] = { groupValues[3], groupValues[4], groupValues[5] };
+			float *const points[3] = { planeValues[0], planeValues[1], planeValues[2] };
+			float *const normals[3] = { planeValues[3], planeValues[4], planeValues[5] };
+
+			computeFourORCAPlanes(groupPositions, groupVelocities, groupValues[6], invTimeHorizon, invTimeStep, velocity, responsibility, points, normals);
+
+			for (; i < count; ++i) {
+				for (size_t axis = 0; axis < 3; ++axis) {
+					planes.points(axis)[begin + i] = planeValues[axis][i - groupBegin];
+					planes.normals(axis)[begin + i] = planeValues[3 + axis][i - groupBegin];
+				}
+			}
+		}
+#else
+		for (; i < count; ++i) {
+			const Plane plane = computeORCAPlane(Vector3(relativePositions[0][i], relativePositions[1][i], relativePositions[2][i]), Vector3(relativeVelocities[0][i], relativeVelocities[1][i], relativeVelocities[2][i]), combinedRadii[i], invTimeHorizon, invTimeStep, velocity, responsibility);
+
+			for (size_t axis = 0; axis < 3; ++axis) {
+				planes.points(axis)[begin + i] = plane.point[axis];
+				planes.normals(axis)[begin + i] = plane.normal[axis];
+			}
+		}
+#endif
+	}
+}
@@ -0,0 +1,385 @@
+/*
+ * PlaneBuffer.h
+ * RVO2-3D Library
+ *
+ * Copyright 2008 University of North Carolina at Chapel Hill
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Please send all bug reports to <geom@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Jur van den Berg, Stephen J. Guy, Jamie Snape, Ming C. Lin, Dinesh Manocha
+ * Dept. of Computer Science
+ * 201 S. Columbia St.
+ * Frederick P. Brooks, Jr. Computer Science Bldg.
+ * Chapel Hill, N.C. 27599-3175
+ * United States of America
+ *
+ * <http://gamma.cs.unc.edu/RVO2/>
+ */
+/**
+ * \file    PlaneBuffer.h
+ * \brief   Contains the PlaneBuffer class, the construction of ORCA planes and the tests of the linear programs against them.
+ */
+#ifndef RVO_PLANE_BUFFER_H_
+#define RVO_PLANE_BUFFER_H_
+
+#include "API.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define RVO_USE_SSE
+#endif
+
+#include "Definitions.h"
+#include "RVOSimulator.h"
+#include "Vector3.h"
+
+namespace RVO {
+	/**
+	 * \brief   Defines a sequence of planes stored as one array per coordinate of their points and normals, so that several planes can be processed at once.
+	 *
+	 * The six arrays share one allocation, and their capacity is a multiple of four, so that groups of four planes may be loaded up to the capacity.
+	 */
+	class PlaneBuffer {
+	public:
+		/**
+		 * \brief   Constructs an empty plane buffer instance with room for four planes.
+		 */
+		PlaneBuffer() : values_(24), capacity_(4), size_(0) { }
+
+		/**
+		 * \brief   Returns the plane at the specified position.
+		 * \param   planeNo  The position of the plane.
+		 * \return  The plane.
+		 */
+		inline Plane operator[](size_t planeNo) const
+		{
+			Plane plane;
+			plane.point = Vector3(values_[planeNo], values_[capacity_ + planeNo], values_[2 * capacity_ + planeNo]);
+			plane.normal = Vector3(values_[3 * capacity_ + planeNo], values_[4 * capacity_ + planeNo], values_[5 * capacity_ + planeNo]);
+
+			return plane;
+		}
+
+		/**
+		 * \brief   Removes all planes.
+		 */
+		inline void clear()
+		{
+			size_ = 0;
+		}
+
+		/**
+		 * \brief   Returns the array of a coordinate of the normals of the planes.
+		 * \param   axis  The axis of the coordinate.
+		 * \return  A pointer to the first element of the array.
+		 */
+		inline const float *normals(size_t axis) const
+		{
+			return &values_[(3 + axis) * capacity_];
+		}
+
+		/**
+		 * \brief   Returns the array of a coordinate of the normals of the planes.
+		 * \param   axis  The axis of the coordinate.
+		 * \return  A pointer to the first element of the array.
+		 */
+		inline float *normals(size_t axis)
+		{
+			return &values_[(3 + axis) * capacity_];
+		}
+
+		/**
+		 * \brief   Returns the array of a coordinate of the points of the planes.
+		 * \param   axis  The axis of the coordinate.
+		 * \return  A pointer to the first element of the array.
+		 */
+		inline const float *points(size_t axis) const
+		{
+			return &values_[axis * capacity_];
+		}
+
+		/**
+		 * \brief   Returns the array of a coordinate of the points of the planes.
+		 * \param   axis  The axis of the coordinate.
+		 * \return  A pointer to the first element of the array.
+		 */
+		inline float *points(size_t axis)
+		{
+			return &values_[axis * capacity_];
+		}
+
+		/**
+		 * \brief   Appends a plane.
+		 * \param   plane  The plane.
+		 */
+		inline void push_back(const Plane &plane)
+		{
+			resize(size_ + 1);
+
+			for (size_t i = 0; i < 3; ++i) {
+				values_[i * capacity_ + size_ - 1] = plane.point[i];
+				values_[(3 + i) * capacity_ + size_ - 1] = plane.normal[i];
+			}
+		}
+
+		/**
+		 * \brief   Ensures that the capacity is at least the specified number of planes, keeping the planes.
+		 * \param   capacity  The number of planes.
+		 */
+		void reserve(size_t capacity)
+		{
+			if (capacity > capacity_) {
+				capacity = (capacity + 3) & ~static_cast<size_t>(3);
+				std::vector<float> values(6 * capacity);
+
+				for (size_t i = 0; i < 6; ++i) {
+					std::copy(values_.begin() + i * capacity_, values_.begin() + i * capacity_ + size_, values.begin() + i * capacity);
+				}
+
+				values_.swap(values);
+				capacity_ = capacity;
+			}
+		}
+
+		/**
+		 * \brief   Changes the number of planes, keeping the first planes. Added planes are undefined.
+		 * \param   size  The number of planes.
+		 */
+		inline void resize(size_t size)
+		{
+			if (size > capacity_) {
+				reserve(std::max(size, 2 * capacity_));
+			}
+
+			size_ = size;
+		}
+
+		/**
+		 * \brief   Returns the number of planes.
+		 * \return  The number of planes.
+		 */
+		inline size_t size() const
+		{
+			return size_;
+		}
+
+	private:
+		std::vector<float> values_;
+		size_t capacity_;
+		size_t size_;
+	};
+
+	/**
+	 * \brief   Bounds the parameters of the points of a line that lie on the permitted side of the first planes of a plane buffer.
+	 * \param   planes         The planes.
+	 * \param   planeNo        The number of planes to bound the line by.
+	 * \param   linePoint      A point on the line, at parameter zero.
+	 * \param   lineDirection  The direction of the line.
+	 * \param   tLeft          A reference to the lower bound of the parameters, which only increases.
+	 * \param   tRight         A reference to the upper bound of the parameters, which only decreases.
+	 * \return  False if a plane (almost) parallel to the line excludes it, or if the bounds cross.
+	 * \note    The bounds do not depend on the order of the planes, so four planes are tested at once where SSE is available.
+	 */
+	inline bool boundLine(const PlaneBuffer &planes, size_t planeNo, const Vector3 &linePoint, const Vector3 &lineDirection, float &tLeft, float &tRight)
+	{
+		const float *const pointsX = planes.points(0);
+		const float *const pointsY = planes.points(1);
+		const float *const pointsZ = planes.points(2);
+		const float *const normalsX = planes.normals(0);
+		const float *const normalsY = planes.normals(1);
+		const float *const normalsZ = planes.normals(2);
+
+#ifdef RVO_USE_SSE
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 epsilon = _mm_set1_ps(RVO_EPSILON);
+		const __m128 lineX = _mm_set1_ps(linePoint.x());
+		const __m128 lineY = _mm_set1_ps(linePoint.y());
+		const __m128 lineZ = _mm_set1_ps(linePoint.z());
+		const __m128 directionX = _mm_set1_ps(lineDirection.x());
+		const __m128 directionY = _mm_set1_ps(lineDirection.y());
+		const __m128 directionZ = _mm_set1_ps(lineDirection.z());
+		const __m128 laneNos = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+		__m128 lefts = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+		__m128 rights = _mm_set1_ps(std::numeric_limits<float>::infinity());
+
+		/* The capacity of the plane buffer is a multiple of four, so the last group may be loaded whole and its lanes beyond the planes are masked. */
+		for (size_t i = 0; i < planeNo; i += 4) {
+			const __m128 normalX = _mm_loadu_ps(normalsX + i);
+			const __m128 normalY = _mm_loadu_ps(normalsY + i);
+			const __m128 normalZ = _mm_loadu_ps(normalsZ + i);
+			const __m128 numerator = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pointsX + i), lineX), normalX), _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pointsY + i), lineY), normalY)), _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pointsZ + i), lineZ), normalZ));
+			const __m128 denominator = _mm_add_ps(_mm_add_ps(_mm_mul_ps(directionX, normalX), _mm_mul_ps(directionY, normalY)), _mm_mul_ps(directionZ, normalZ));
+			const __m128 valid = _mm_cmplt_ps(laneNos, _mm_set1_ps(static_cast<float>(planeNo - i)));
+			const __m128 parallel = _mm_and_ps(valid, _mm_cmple_ps(_mm_mul_ps(denominator, denominator), epsilon));
+
+			if (_mm_movemask_ps(_mm_and_ps(parallel, _mm_cmpgt_ps(numerator, zero))) != 0) {
+				/* Line is (almost) parallel to a plane that invalidates it. */
+				return false;
+			}
+
+			const __m128 t = _mm_div_ps(numerator, denominator);
+			const __m128 bounding = _mm_andnot_ps(parallel, valid);
+			const __m128 left = _mm_and_ps(bounding, _mm_cmpge_ps(denominator, zero));
+			const __m128 right = _mm_andnot_ps(_mm_cmpge_ps(denominator, zero), bounding);
+
+			/* The maximum and minimum keep their second operand if t is not a number, as std::max() and std::min() keep the bound. */
+			lefts = _mm_max_ps(_mm_or_ps(_mm_and_ps(left, t), _mm_andnot_ps(left, lefts)), lefts);
+			rights = _mm_min_ps(_mm_or_ps(_mm_and_ps(right, t), _mm_andnot_ps(right, rights)), rights);
+		}
+
+		float leftValues[4];
+		float rightValues[4];
+		_mm_storeu_ps(leftValues, lefts);
+		_mm_storeu_ps(rightValues, rights);
+
+		for (size_t i = 0; i < 4; ++i) {
+			tLeft = std::max(tLeft, leftValues[i]);
+			tRight = std::min(tRight, rightValues[i]);
+		}
+
+		return tLeft <= tRight;
+#else
+		for (size_t i = 0; i < planeNo; ++i) {
+			const float numerator = (pointsX[i] - linePoint.x()) * normalsX[i] + (pointsY[i] - linePoint.y()) * normalsY[i] + (pointsZ[i] - linePoint.z()) * normalsZ[i];
+			const float denominator = lineDirection.x() * normalsX[i] + lineDirection.y() * normalsY[i] + lineDirection.z() * normalsZ[i];
+
+			if (sqr(denominator) <= RVO_EPSILON) {
+				/* Line is (almost) parallel to plane i. */
+				if (numerator > 0.0f) {
+					return false;
+				}
+				else {
+					continue;
+				}
+			}
+
+			const float t = numerator / denominator;
+
+			if (denominator >= 0.0f) {
+				/* Plane i bounds line on the left. */
+				tLeft = std::max(tLeft, t);
+			}
+			else {
+				/* Plane i bounds line on the right. */
+				tRight = std::min(tRight, t);
+			}
+
+			if (tLeft > tRight) {
+				return false;
+			}
+		}
+
+		return true;
+#endif
+	}
+
+	/**
+	 * \brief   Finds the first plane of a range of a plane buffer that a velocity lies beyond by more than a distance.
+	 * \param   planes    The planes.
+	 * \param   begin     The first plane of the range.
+	 * \param   end       The end of the range.
+	 * \param   velocity  The velocity.
+	 * \param   distance  The distance, which is zero to find the first plane whose constraint the velocity violates.
+	 * \return  The number of the first such plane, or end if there is none.
+	 * \note    The distance beyond a plane is normal * (point - velocity) with the same operations in the same order as Vector3, and four planes are tested at once where SSE is available.
+	 */
+	inline size_t findViolatedPlane(const PlaneBuffer &planes, size_t begin, size_t end, const Vector3 &velocity, float distance)
+	{
+		const float *const pointsX = planes.points(0);
+		const float *const pointsY = planes.points(1);
+		const float *const pointsZ = planes.points(2);
+		const float *const normalsX = planes.normals(0);
+		const float *const normalsY = planes.normals(1);
+		const float *const normalsZ = planes.normals(2);
+
+#ifdef RVO_USE_SSE
+		const __m128 velocityX = _mm_set1_ps(velocity.x());
+		const __m128 velocityY = _mm_set1_ps(velocity.y());
+		const __m128 velocityZ = _mm_set1_ps(velocity.z());
+		const __m128 distance4 = _mm_set1_ps(distance);
+
+		/* Start at a multiple of four, so that each group lies within the capacity of the plane buffer, and mask the lanes outside of the range. */
+		for (size_t i = begin & ~static_cast<size_t>(3); i < end; i += 4) {
+			const __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(normalsX + i), _mm_sub_ps(_mm_loadu_ps(pointsX + i), velocityX)), _mm_mul_ps(_mm_loadu_ps(normalsY + i), _mm_sub_ps(_mm_loadu_ps(pointsY + i), velocityY))), _mm_mul_ps(_mm_loadu_ps(normalsZ + i), _mm_sub_ps(_mm_loadu_ps(pointsZ + i), velocityZ)));
+			int mask = _mm_movemask_ps(_mm_cmpgt_ps(dist, distance4));
+
+			if (i < begin) {
+				mask &= ~((1 << (begin - i)) - 1);
+			}
+
+			if (end - i < 4) {
+				mask &= (1 << (end - i)) - 1;
+			}
+
+			if (mask != 0) {
+				size_t lane = 0;
+
+				while ((mask & (1 << lane)) == 0) {
+					++lane;
+				}
+
+				return i + lane;
+			}
+		}
+
+		return end;
+#else
+		for (size_t i = begin; i < end; ++i) {
+			if (normalsX[i] * (pointsX[i] - velocity.x()) + normalsY[i] * (pointsY[i] - velocity.y()) + normalsZ[i] * (pointsZ[i] - velocity.z()) > distance) {
+				return i;
+			}
+		}
+
+		return end;
+#endif
+	}
+
+	/**
+	 * \brief   Computes the ORCA plane of an agent with respect to a moving sphere.
+	 * \param   relativePosition  The position of the sphere relative to the agent.
+	 * \param   relativeVelocity  The velocity of the agent relative to the sphere.
+	 * \param   combinedRadius    The sum of the radii of the agent and the sphere.
+	 * \param   invTimeHorizon    The inverse of the time horizon of the agent.
+	 * \param   invTimeStep       The inverse of the time step of the simulation.
+	 * \param   velocity          The velocity of the agent.
+	 * \param   responsibility    The share of the avoidance taken by the agent, which is one half for another agent and one for a static obstacle.
+	 * \return  The ORCA plane.
+	 */
+	Plane computeORCAPlane(const Vector3 &relativePosition, const Vector3 &relativeVelocity, float combinedRadius, float invTimeHorizon, float invTimeStep, const Vector3 &velocity, float responsibility);
+
+	/**
+	 * \brief   Computes the ORCA planes of an agent with respect to several moving spheres and appends them to a plane buffer.
+	 * \param   relativePositions   The coordinates of the positions of the spheres relative to the agent, one array per axis.
+	 * \param   relativeVelocities  The coordinates of the velocities of the agent relative to the spheres, one array per axis.
+	 * \param   combinedRadii       The sums of the radii of the agent and the spheres.
+	 * \param   count               The number of spheres.
+	 * \param   invTimeHorizon      The inverse of the time horizon of the agent.
+	 * \param   invTimeStep         The inverse of the time step of the simulation.
+	 * \param   velocity            The velocity of the agent.
+	 * \param   responsibility      The share of the avoidance taken by the agent.
+	 * \param   planes              A reference to the plane buffer.
+	 * \note    The planes are the same as those of computeORCAPlane(), with the same operations in the same order, and four are computed at once where SSE is available.
+	 */
+	void computeORCAPlanes(const float *const relativePositions[3], const float *const relativeVelocities[3], const float *combinedRadii, size_t count, float invTimeHorizon, float invTimeStep, const Vector3 &velocity, float responsibility, PlaneBuffer &planes);
+}
+
+#endif /* RVO_PLANE_BUFFER_H_ */
@@ -32,30 +32,42 @@
 
 #include "RVOSimulator.h"
 
+#include <algorithm>
+#include <cmath>
+
 #ifdef _OPENMP
 #include <omp.h>
 #endif
 
 #include "Agent.h"
+#include "AgentStore.h"
+#include "HashGrid.h"
 #include "KdTree.h"
+#include "Obstacle.h"
+#include "ObstacleTree.h"
+#include "PlaneBuffer.h"
 
 namespace RVO {
-	RVOSimulator::RVOSimulator() : defaultAgent_(NULL), kdTree_(NULL), globalTime_(0.0f), timeStep_(0.0f)
+	RVOSimulator::RVOSimulator() : defaultAgent_(NULL), agentStore_(NULL), hashGrid_(NULL), kdTree_(NULL), obstacleTree_(NULL), spatialIndex_(NULL), spatialIndexType_(RVO_KD_TREE), neighborDisplacement_(0.0), neighborListEpoch_(1), neighborCulling_(false), spatialIndexStale_(true), defaultMaxSpeed_(0.0f), defaultRadius_(0.0f), globalTime_(0.0f), neighborSkin_(0.0f), timeStep_(0.0f), numObstacles_(0)
 	{
+		agentStore_ = new AgentStore();
 		kdTree_ = new KdTree(this);
+		spatialIndex_ = kdTree_;
 	}
 
-	RVOSimulator::RVOSimulator(float timeStep, float neighborDist, size_t maxNeighbors, float timeHorizon, float radius, float maxSpeed, const Vector3 &velocity) : defaultAgent_(NULL), kdTree_(NULL), globalTime_(0.0f), timeStep_(timeStep)
+	RVOSimulator::RVOSimulator(float timeStep, float neighborDist, size_t maxNeighbors, float timeHorizon, float radius, float maxSpeed, const Vector3 &velocity) : defaultAgent_(NULL), agentStore_(NULL), hashGrid_(NULL), kdTree_(NULL), obstacleTree_(NULL), spatialIndex_(NULL), spatialIndexType_(RVO_KD_TREE), neighborDisplacement_(0.0), neighborListEpoch_(1), neighborCulling_(false), spatialIndexStale_(true), defaultMaxSpeed_(0.0f), defaultRadius_(0.0f), globalTime_(0.0f), neighborSkin_(0.0f), timeStep_(timeStep), numObstacles_(0)
 	{
+		agentStore_ = new AgentStore();
 		kdTree_ = new KdTree(this);
+		spatialIndex_ = kdTree_;
 		defaultAgent_ = new Agent(this);
 
 		defaultAgent_->maxNeighbors_ = maxNeighbors;
-		defaultAgent_->maxSpeed_ = maxSpeed;
 		defaultAgent_->neighborDist_ = neighborDist;
-		defaultAgent_->radius_ = radius;
 		defaultAgent_->timeHorizon_ = timeHorizon;
-		defaultAgent_->velocity_ = velocity;
+		defaultMaxSpeed_ = maxSpeed;
+		defaultRadius_ = radius;
+		defaultVelocity_ = velocity;
 	}
 
 	RVOSimulator::~RVOSimulator()
@@ -68,9 +80,27 @@ namespace RVO {
 			delete agents_[i];
 		}
 
+		delete agentStore_;
+
+		if (hashGrid_ != NULL) {
+			delete hashGrid_;
+		}
+
 		if (kdTree_ != NULL) {
 			delete kdTree_;
 		}
+
+		for (size_t i = 0; i < obstacles_.size(); ++i) {
+			delete obstacles_[i];
+		}
+
+		if (obstacleTree_ != NULL) {
+			delete obstacleTree_;
+		}
+
+		for (size_t i = 0; i < projPlanes_.size(); ++i) {
+			delete projPlanes_[i];
+		}
 	}
 
 	size_t RVOSimulator::getAgentNumAgentNeighbors(size_t agentNo) const
@@ -80,7 +110,17 @@ namespace RVO {
 
 	size_t RVOSimulator::getAgentAgentNeighbor(size_t agentNo, size_t neighborNo) const
 	{
-		return agents_[agentNo]->agentNeighbors_[neighborNo].second->id_;
+		return agentStore_->agents_[agents_[agentNo]->agentNeighbors_[neighborNo].slot]->id_;
+	}
+
+	size_t RVOSimulator::getAgentNumObstacleNeighbors(size_t agentNo) const
+	{
+		return agents_[agentNo]->obstacleNeighbors_.size();
+	}
+
+	size_t RVOSimulator::getAgentObstacleNeighbor(size_t agentNo, size_t neighborNo) const
+	{
+		return agents_[agentNo]->obstacleNeighbors_[neighborNo].second->id_;
 	}
 
 	size_t RVOSimulator::getAgentNumORCAPlanes(size_t agentNo) const
@@ -88,16 +128,148 @@ namespace RVO {
 		return agents_[agentNo]->orcaPlanes_.size();
 	}
 
-	const Plane &RVOSimulator::getAgentORCAPlane(size_t agentNo, size_t planeNo) const
+	Plane RVOSimulator::getAgentORCAPlane(size_t agentNo, size_t planeNo) const
 	{
 		return agents_[agentNo]->orcaPlanes_[planeNo];
 	}
 
+	void RVOSimulator::processObstacles()
+	{
+		if (obstacleTree_ == NULL) {
+			obstacleTree_ = new ObstacleTree(this);
+		}
+
+		obstacleTree_->build();
+	}
+
+	size_t RVOSimulator::queryAgentsInBox(const Vector3 &minCoord, const Vector3 &maxCoord, size_t *agentNos, size_t maxAgents) const
+	{
+		updateSpatialIndex();
+
+		queryAgents_.clear();
+		spatialIndex_->computeAgentsInBox(minCoord, maxCoord, queryAgents_);
+
+		for (size_t i = 0; i < queryAgents_.size() && i < maxAgents; ++i) {
+			agentNos[i] = queryAgents_[i]->id_;
+		}
+
+		return queryAgents_.size();
+	}
+
+	size_t RVOSimulator::queryAgentsInRange(const Vector3 &point, float range, size_t *agentNos, size_t maxAgents) const
+	{
+		updateSpatialIndex();
+
+		queryAgents_.clear();
+		spatialIndex_->computeAgentsInRange(point, range * range, queryAgents_);
+
+		for (size_t i = 0; i < queryAgents_.size() && i < maxAgents; ++i) {
+			agentNos[i] = queryAgents_[i]->id_;
+		}
+
+		return queryAgents_.size();
+	}
+
+	size_t RVOSimulator::queryNearestAgents(const Vector3 &point, float range, size_t *agentNos, size_t maxAgents) const
+	{
+		updateSpatialIndex();
+
+		if (queryNeighbors_.size() < maxAgents) {
+			queryNeighbors_.resize(maxAgents);
+		}
+
+		const size_t numAgents = maxAgents == 0 ? 0 : spatialIndex_->computeNearestAgents(point, range * range, maxAgents, &queryNeighbors_[0]);
+
+		for (size_t i = 0; i < numAgents; ++i) {
+			agentNos[i] = queryNeighbors_[i].second->id_;
+		}
+
+		return numAgents;
+	}
+
+	size_t RVOSimulator::queryNearestAgents(const Vector3 *points, const float *ranges, const size_t *maxAgents, size_t numPoints, size_t *agentOffsets, size_t *agentNos) const
+	{
+		updateSpatialIndex();
+
+		/* Each point first stores its agents at the offset of its maximum number of agents. */
+		size_t maxMaxAgents = 0;
+		agentOffsets[0] = 0;
+
+		for (size_t i = 0; i < numPoints; ++i) {
+			agentOffsets[i + 1] = agentOffsets[i] + maxAgents[i];
+			maxMaxAgents = std::max(maxMaxAgents, maxAgents[i]);
+		}
+
+		std::vector<size_t> numAgents(numPoints);
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+		{
+			std::vector<std::pair<float, const Agent *> > neighbors(std::max(maxMaxAgents, static_cast<size_t>(1)));
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+			for (int i = 0; i < static_cast<int>(numPoints); ++i) {
+				numAgents[i] = maxAgents[i] == 0 ? 0 : spatialIndex_->computeNearestAgents(points[i], ranges[i] * ranges[i], maxAgents[i], &neighbors[0]);
+
+				for (size_t j = 0; j < numAgents[i]; ++j) {
+					agentNos[agentOffsets[i] + j] = neighbors[j].second->id_;
+				}
+			}
+		}
+
+		/* Close the gaps left by points with fewer agents than their maximum. */
+		size_t offset = 0;
+
+		for (size_t i = 0; i < numPoints; ++i) {
+			const size_t begin = agentOffsets[i];
+			agentOffsets[i] = offset;
+
+			for (size_t j = 0; j < numAgents[i]; ++j) {
+				agentNos[offset++] = agentNos[begin + j];
+			}
+		}
+
+		agentOffsets[numPoints] = offset;
+
+		return offset;
+	}
+
+	bool RVOSimulator::queryVisibility(const Vector3 &point1, const Vector3 &point2, float radius) const
+	{
+		updateSpatialIndex();
+
+		return spatialIndex_->queryVisibility(point1, point2, radius);
+	}
+
+	void RVOSimulator::queryVisibility(const Vector3 *points1, const Vector3 *points2, const float *radii, size_t numSegments, bool *visible) const
+	{
+		updateSpatialIndex();
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+		for (int i = 0; i < static_cast<int>(numSegments); ++i) {
+			visible[i] = spatialIndex_->queryVisibility(points1[i], points2[i], radii[i]);
+		}
+	}
+
 	void RVOSimulator::removeAgent(size_t agentNo)
 	{
+		agentStore_->removeAgent(agents_[agentNo]);
 		delete agents_[agentNo];
 		agents_[agentNo] = agents_.back();
 		agents_.pop_back();
+
+		if (agentNo < agents_.size()) {
+			agents_[agentNo]->id_ = agentNo;
+		}
+
+		kdTree_->rebuild_ = true;
+		++neighborListEpoch_;
+		spatialIndexStale_ = true;
 	}
 
 	size_t RVOSimulator::addAgent(const Vector3 &position)
@@ -108,17 +280,17 @@ namespace RVO {
 
 		Agent *agent = new Agent(this);
 
-		agent->position_ = position;
 		agent->maxNeighbors_ = defaultAgent_->maxNeighbors_;
-		agent->maxSpeed_ = defaultAgent_->maxSpeed_;
 		agent->neighborDist_ = defaultAgent_->neighborDist_;
-		agent->radius_ = defaultAgent_->radius_;
 		agent->timeHorizon_ = defaultAgent_->timeHorizon_;
-		agent->velocity_ = defaultAgent_->velocity_;
+		agentStore_->addAgent(agent, position, defaultVelocity_, defaultRadius_, defaultMaxSpeed_);
 
 		agent->id_ = agents_.size();
 
 		agents_.push_back(agent);
+		kdTree_->rebuild_ = true;
+		++neighborListEpoch_;
+		spatialIndexStale_ = true;
 
 		return agents_.size() - 1;
 	}
@@ -127,38 +299,112 @@ namespace RVO {
 	{
 		Agent *agent = new Agent(this);
 
-		agent->position_ = position;
 		agent->maxNeighbors_ = maxNeighbors;
-		agent->maxSpeed_ = maxSpeed;
 		agent->neighborDist_ = neighborDist;
-		agent->radius_ = radius;
 		agent->timeHorizon_ = timeHorizon;
-		agent->velocity_ = velocity;
+		agentStore_->addAgent(agent, position, velocity, radius, maxSpeed);
 
 		agent->id_ = agents_.size();
 
 		agents_.push_back(agent);
+		kdTree_->rebuild_ = true;
+		++neighborListEpoch_;
+		spatialIndexStale_ = true;
 
 		return agents_.size() - 1;
 	}
 
+	size_t RVOSimulator::addObstacle(const std::vector<Vector3> &vertices, const std::vector<size_t> &indices)
+	{
+		if (indices.size() % 3 != 0) {
+			return RVO_ERROR;
+		}
+
+		for (size_t i = 0; i < indices.size(); ++i) {
+			if (indices[i] >= vertices.size()) {
+				return RVO_ERROR;
+			}
+		}
+
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			const Vector3 &vertex0 = vertices[indices[i]];
+			const Vector3 &vertex1 = vertices[indices[i + 1]];
+			const Vector3 &vertex2 = vertices[indices[i + 2]];
+
+			if (absSq(cross(vertex1 - vertex0, vertex2 - vertex0)) > 0.0f) {
+				obstacles_.push_back(new Obstacle(vertex0, vertex1, vertex2, numObstacles_));
+			}
+		}
+
+		return numObstacles_++;
+	}
+
 	void RVOSimulator::doStep()
 	{
-		kdTree_->buildAgentTree();
+		updateSpatialIndex();
+
+		const bool dualTreeSearch = kdTree_->neighborSearch_ == RVO_DUAL_TREE_SEARCH && spatialIndexType_ == RVO_KD_TREE && neighborSkin_ == 0.0f && !kdTree_->sweep_;
 
+		if (dualTreeSearch) {
+			kdTree_->computeAllAgentNeighbors();
+		}
+
+		/* Visit the agents in the order of their slots in the agent store, in which agents near each other in space are near each other in memory. */
+		const std::vector<Agent *> &agents = agentStore_->agents_;
+
+		/* Each thread keeps a buffer for the planes that linearProgram4 projects, which is reused across agents and steps. */
 #ifdef _OPENMP
-#pragma omp parallel for
+		const size_t numThreads = static_cast<size_t>(omp_get_max_threads());
+#else
+		const size_t numThreads = 1;
+#endif
+
+		while (projPlanes_.size() < numThreads) {
+			projPlanes_.push_back(new PlaneBuffer());
+		}
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+		{
+#ifdef _OPENMP
+			PlaneBuffer &projPlanes = *projPlanes_[omp_get_thread_num()];
+#else
+			PlaneBuffer &projPlanes = *projPlanes_[0];
 #endif
-		for (int i = 0; i < static_cast<int>(agents_.size()); ++i) {
-			agents_[i]->computeNeighbors();
-			agents_[i]->computeNewVelocity();
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+			for (int i = 0; i < static_cast<int>(agents.size()); ++i) {
+				if (dualTreeSearch) {
+					kdTree_->copyAgentNeighbors(agents[i]);
+				}
+				else {
+					agents[i]->computeNeighbors();
+				}
+
+				agents[i]->computeNewVelocity(projPlanes);
+			}
 		}
 
 #ifdef _OPENMP
 #pragma omp parallel for
 #endif
-		for (int i = 0; i < static_cast<int>(agents_.size()); ++i) {
-			agents_[i]->update();
+		for (int i = 0; i < static_cast<int>(agents.size()); ++i) {
+			agents[i]->update();
+		}
+
+		spatialIndexStale_ = true;
+
+		if (neighborSkin_ > 0.0f && timeStep_ > 0.0f) {
+			float maxSpeedSq = 0.0f;
+
+			for (size_t i = 0; i < agentStore_->velocities_.size(); ++i) {
+				maxSpeedSq = std::max(maxSpeedSq, absSq(agentStore_->velocities_[i]));
+			}
+
+			neighborDisplacement_ += std::sqrt(maxSpeedSq) * timeStep_;
 		}
 
 		globalTime_ += timeStep_;
@@ -171,7 +417,7 @@ namespace RVO {
 
 	float RVOSimulator::getAgentMaxSpeed(size_t agentNo) const
 	{
-		return agents_[agentNo]->maxSpeed_;
+		return agentStore_->maxSpeeds_[agents_[agentNo]->slot_];
 	}
 
 	float RVOSimulator::getAgentNeighborDist(size_t agentNo) const
@@ -179,19 +425,24 @@ namespace RVO {
 		return agents_[agentNo]->neighborDist_;
 	}
 
+	float RVOSimulator::getAgentVerticalNeighborDist(size_t agentNo) const
+	{
+		return agents_[agentNo]->verticalNeighborDist_;
+	}
+
 	const Vector3 &RVOSimulator::getAgentPosition(size_t agentNo) const
 	{
-		return agents_[agentNo]->position_;
+		return agentStore_->positions_[agents_[agentNo]->slot_];
 	}
 
 	const Vector3 &RVOSimulator::getAgentPrefVelocity(size_t agentNo) const
 	{
-		return agents_[agentNo]->prefVelocity_;
+		return agentStore_->prefVelocities_[agents_[agentNo]->slot_];
 	}
 
 	float RVOSimulator::getAgentRadius(size_t agentNo) const
 	{
-		return agents_[agentNo]->radius_;
+		return agentStore_->radii_[agents_[agentNo]->slot_];
 	}
 
 	float RVOSimulator::getAgentTimeHorizon(size_t agentNo) const
@@ -201,7 +452,7 @@ namespace RVO {
 
 	const Vector3 &RVOSimulator::getAgentVelocity(size_t agentNo) const
 	{
-		return agents_[agentNo]->velocity_;
+		return agentStore_->velocities_[agents_[agentNo]->slot_];
 	}
 
 	float RVOSimulator::getGlobalTime() const
@@ -214,6 +465,16 @@ namespace RVO {
 		return agents_.size();
 	}
 
+	size_t RVOSimulator::getNumObstacles() const
+	{
+		return numObstacles_;
+	}
+
+	SpatialIndexType RVOSimulator::getSpatialIndex() const
+	{
+		return spatialIndexType_;
+	}
+
 	float RVOSimulator::getTimeStep() const
 	{
 		return timeStep_;
@@ -226,41 +487,54 @@ namespace RVO {
 		}
 
 		defaultAgent_->maxNeighbors_ = maxNeighbors;
-		defaultAgent_->maxSpeed_ = maxSpeed;
 		defaultAgent_->neighborDist_ = neighborDist;
-		defaultAgent_->radius_ = radius;
 		defaultAgent_->timeHorizon_ = timeHorizon;
-		defaultAgent_->velocity_ = velocity;
+		defaultMaxSpeed_ = maxSpeed;
+		defaultRadius_ = radius;
+		defaultVelocity_ = velocity;
 	}
 
 	void RVOSimulator::setAgentMaxNeighbors(size_t agentNo, size_t maxNeighbors)
 	{
 		agents_[agentNo]->maxNeighbors_ = maxNeighbors;
+		spatialIndexStale_ = true;
 	}
 
 	void RVOSimulator::setAgentMaxSpeed(size_t agentNo, float maxSpeed)
 	{
-		agents_[agentNo]->maxSpeed_ = maxSpeed;
+		agentStore_->maxSpeeds_[agents_[agentNo]->slot_] = maxSpeed;
 	}
 
 	void RVOSimulator::setAgentNeighborDist(size_t agentNo, float neighborDist)
 	{
 		agents_[agentNo]->neighborDist_ = neighborDist;
+		++neighborListEpoch_;
+		spatialIndexStale_ = true;
+	}
+
+	void RVOSimulator::setAgentVerticalNeighborDist(size_t agentNo, float verticalNeighborDist)
+	{
+		agents_[agentNo]->verticalNeighborDist_ = verticalNeighborDist;
+		++neighborListEpoch_;
+		spatialIndexStale_ = true;
 	}
 
 	void RVOSimulator::setAgentPosition(size_t agentNo, const Vector3 &position)
 	{
-		agents_[agentNo]->position_ = position;
+		agentStore_->positions_[agents_[agentNo]->slot_] = position;
+		++neighborListEpoch_;
+		spatialIndexStale_ = true;
 	}
 
 	void RVOSimulator::setAgentPrefVelocity(size_t agentNo, const Vector3 &prefVelocity)
 	{
-		agents_[agentNo]->prefVelocity_ = prefVelocity;
+		agentStore_->prefVelocities_[agents_[agentNo]->slot_] = prefVelocity;
 	}
 
 	void RVOSimulator::setAgentRadius(size_t agentNo, float radius)
 	{
-		agents_[agentNo]->radius_ = radius;
+		agentStore_->radii_[agents_[agentNo]->slot_] = radius;
+		spatialIndexStale_ = true;
 	}
 
 	void RVOSimulator::setAgentTimeHorizon(size_t agentNo, float timeHorizon)
@@ -270,7 +544,8 @@ namespace RVO {
 
 	void RVOSimulator::setAgentVelocity(size_t agentNo, const Vector3 &velocity)
 	{
-		agents_[agentNo]->velocity_ = velocity;
+		agentStore_->velocities_[agents_[agentNo]->slot_] = velocity;
+		spatialIndexStale_ = true;
 	}
 
 	float RVOSimulator::getAgentMaxAcceleration(size_t agentNo) const
@@ -340,8 +615,87 @@ namespace RVO {
 		agents_[agentNo]->useDirectionalSpeedLimits_ = use;
 	}
 
+	void RVOSimulator::setAgentNeighborApproximation(float epsilon)
+	{
+		kdTree_->setApproximation(epsilon);
+	}
+
+	void RVOSimulator::setAgentNeighborCulling(bool culling)
+	{
+		neighborCulling_ = culling;
+	}
+
+	void RVOSimulator::setAgentNeighborSearch(AgentNeighborSearch neighborSearch)
+	{
+		kdTree_->setNeighborSearch(neighborSearch);
+		spatialIndexStale_ = true;
+	}
+
+	void RVOSimulator::setAgentNeighborSweep(bool sweep)
+	{
+		kdTree_->setSweep(sweep);
+		spatialIndexStale_ = true;
+	}
+
+	void RVOSimulator::setAgentTreeBuildMethod(AgentTreeBuildMethod buildMethod)
+	{
+		kdTree_->setBuildMethod(buildMethod);
+		spatialIndexStale_ = true;
+	}
+
+	void RVOSimulator::setAgentTreeRefit(bool refit, float rebuildThreshold)
+	{
+		kdTree_->setRefit(refit, rebuildThreshold);
+		spatialIndexStale_ = true;
+	}
+
+	void RVOSimulator::setAgentTreeLeafSize(size_t leafSize)
+	{
+		kdTree_->setLeafSize(leafSize);
+		spatialIndexStale_ = true;
+	}
+
+	void RVOSimulator::setAgentTreeSplitPolicy(AgentTreeSplitPolicy splitPolicy)
+	{
+		kdTree_->setSplitPolicy(splitPolicy);
+		spatialIndexStale_ = true;
+	}
+
+	void RVOSimulator::setNeighborListSkin(float skin)
+	{
+		neighborSkin_ = skin;
+		++neighborListEpoch_;
+		spatialIndexStale_ = true;
+	}
+
+	void RVOSimulator::setSpatialIndex(SpatialIndexType spatialIndex)
+	{
+		spatialIndexType_ = spatialIndex;
+
+		if (spatialIndex == RVO_HASH_GRID) {
+			if (hashGrid_ == NULL) {
+				hashGrid_ = new HashGrid(this);
+			}
+
+			spatialIndex_ = hashGrid_;
+		}
+		else {
+			spatialIndex_ = kdTree_;
+		}
+
+		spatialIndexStale_ = true;
+	}
+
 	void RVOSimulator::setTimeStep(float timeStep)
 	{
 		timeStep_ = timeStep;
 	}
+
+	void RVOSimulator::updateSpatialIndex() const
+	{
+		if (spatialIndexStale_) {
+			spatialIndex_->build();
+			spatialIndexStale_ = false;
+		}
+	}
 }
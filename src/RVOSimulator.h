@@ -41,13 +41,20 @@
 
 #include <cstddef>
 #include <limits>
+#include <utility>
 #include <vector>
 
 #include "Vector3.h"
 
 namespace RVO {
 	class Agent;
+	class AgentStore;
+	class HashGrid;
 	class KdTree;
+	class Obstacle;
+	class ObstacleTree;
+	class PlaneBuffer;
+	class SpatialIndex;
 
 	/**
 	 * \brief   Error value.
@@ -56,6 +63,76 @@ namespace RVO {
 	 */
 	const size_t RVO_ERROR = std::numeric_limits<size_t>::max();
 
+	/**
+	 * \brief   Defines the kinds of spatial index used to compute the agent neighbors.
+	 */
+	enum SpatialIndexType {
+		/**
+		 * \brief   A <i>k</i>d-tree, which adapts to any distribution of the agents (default).
+		 */
+		RVO_KD_TREE,
+
+		/**
+		 * \brief   A uniform hash grid with cells the size of the largest neighbor distance, which is faster to build for dense, roughly uniform distributions of the agents.
+		 */
+		RVO_HASH_GRID
+	};
+
+	/**
+	 * \brief   Defines the methods of building the agent <i>k</i>d-tree.
+	 */
+	enum AgentTreeBuildMethod {
+		/**
+		 * \brief   Recursively splits the agents of each node at the midpoint of its widest extent (default).
+		 */
+		RVO_SPLIT_BUILD,
+
+		/**
+		 * \brief   Sorts the agents by Morton code and splits each node where the highest differing bit of the Morton codes changes, which builds in linear time and orders the leaves spatially.
+		 */
+		RVO_MORTON_BUILD
+	};
+
+	/**
+	 * \brief   Defines the policies of choosing the split of a node of the agent <i>k</i>d-tree built by RVO_SPLIT_BUILD.
+	 */
+	enum AgentTreeSplitPolicy {
+		/**
+		 * \brief   Splits at the midpoint of the widest extent (default).
+		 */
+		RVO_MIDPOINT_SPLIT,
+
+		/**
+		 * \brief   Splits the widest extent at the median of a sample of the agents, which keeps the tree balanced for clustered agents.
+		 */
+		RVO_MEDIAN_SPLIT,
+
+		/**
+		 * \brief   Splits where the sum of the surface areas of the children weighted by their numbers of agents is least, estimated over a fixed number of bins per axis.
+		 */
+		RVO_SAH_SPLIT
+	};
+
+	/**
+	 * \brief   Defines the ways of searching the agent <i>k</i>d-tree for the agent neighbors.
+	 */
+	enum AgentNeighborSearch {
+		/**
+		 * \brief   Queries the agent <i>k</i>d-tree from its root for each agent separately (default).
+		 */
+		RVO_PER_AGENT_SEARCH,
+
+		/**
+		 * \brief   Traverses the agent <i>k</i>d-tree against itself in pairs of nodes, which prunes each pair of distant subtrees once for all of their agents and suits large, roughly uniform crowds.
+		 */
+		RVO_DUAL_TREE_SEARCH,
+
+		/**
+		 * \brief   Queries the agent <i>k</i>d-tree for each agent separately, starting at the leaf node of the agent and climbing only as far as its range requires, which visits fewer nodes than querying from the root, also while the tree is refit.
+		 */
+		RVO_BOTTOM_UP_SEARCH
+	};
+
 	/**
 	 * \brief   Defines a plane.
 	 */
@@ -121,6 +198,15 @@ namespace RVO {
 		 */
 		RVO_API size_t addAgent(const Vector3 &position, float neighborDist, size_t maxNeighbors, float timeHorizon, float radius, float maxSpeed, const Vector3 &velocity = Vector3());
 
+		/**
+		 * \brief   Adds a new static obstacle to the simulation.
+		 * \param   vertices  The vertices of the triangle mesh of the obstacle.
+		 * \param   indices   The numbers of the three vertices of each triangle of the obstacle. Triangles with coincident or collinear vertices are ignored.
+		 * \return  The number of the obstacle, or RVO::RVO_ERROR when the number of indices is not a multiple of three or an index is out of range.
+		 * \note    To add a convex polytope, add a triangulation of its boundary. Obstacles are avoided within the time horizon of each agent, and are accounted for after processObstacles() has been called.
+		 */
+		RVO_API size_t addObstacle(const std::vector<Vector3> &vertices, const std::vector<size_t> &indices);
+
 		/**
 		 * \brief   Lets the simulator perform a simulation step and updates the three-dimensional position and three-dimensional velocity of each agent.
 		 */
@@ -134,6 +220,14 @@ namespace RVO {
 		 */
 		RVO_API size_t getAgentAgentNeighbor(size_t agentNo, size_t neighborNo) const;
 
+		/**
+		 * \brief   Returns the number of the obstacle of a static obstacle triangle neighbor of the specified agent.
+		 * \param   agentNo     The number of the agent whose static obstacle neighbor is to be retrieved.
+		 * \param   neighborNo  The number of the static obstacle neighbor to be retrieved, in order of increasing distance.
+		 * \return  The number of the obstacle to which the neighboring triangle belongs.
+		 */
+		RVO_API size_t getAgentObstacleNeighbor(size_t agentNo, size_t neighborNo) const;
+
 		/**
 		 * \brief   Returns the maximum neighbor count of a specified agent.
 		 * \param   agentNo  The number of the agent whose maximum neighbor count is to be retrieved.
@@ -155,6 +249,13 @@ namespace RVO {
 		 */
 		RVO_API float getAgentNeighborDist(size_t agentNo) const;
 
+		/**
+		 * \brief   Returns the vertical neighbor distance of a specified agent.
+		 * \param   agentNo  The number of the agent whose vertical neighbor distance is to be retrieved.
+		 * \return  The present vertical neighbor distance of the agent, or zero if its neighbor region is a sphere.
+		 */
+		RVO_API float getAgentVerticalNeighborDist(size_t agentNo) const;
+
 		/**
 		 * \brief   Returns the count of agent neighbors taken into account to compute the current velocity for the specified agent.
 		 * \param   agentNo  The number of the agent whose count of agent neighbors is to be retrieved.
@@ -162,6 +263,13 @@ namespace RVO {
 		 */
 		RVO_API size_t getAgentNumAgentNeighbors(size_t agentNo) const;
 
+		/**
+		 * \brief   Returns the count of static obstacle triangle neighbors taken into account to compute the current velocity for the specified agent.
+		 * \param   agentNo  The number of the agent whose count of static obstacle neighbors is to be retrieved.
+		 * \return  The present count of static obstacle triangle neighbors the agent has taken into account.
+		 */
+		RVO_API size_t getAgentNumObstacleNeighbors(size_t agentNo) const;
+
 		/**
 		 * \brief   Returns the count of ORCA constraints used to compute the current velocity for the specified agent.
 		 * \param   agentNo  The number of the agent whose count of ORCA constraints is to be retrieved.
@@ -176,7 +284,7 @@ namespace RVO {
 		 * \return  A plane representing the specified ORCA constraint.
 		 * \note    The halfspace to which the normal of the plane points is the region of permissible velocities with respect to the specified ORCA constraint.
 		 */
-		RVO_API const Plane &getAgentORCAPlane(size_t agentNo, size_t planeNo) const;
+		RVO_API Plane getAgentORCAPlane(size_t agentNo, size_t planeNo) const;
 
 		/**
 		 * \brief   Returns the three-dimensional position of a specified agent.
@@ -225,12 +333,96 @@ namespace RVO {
 		 */
 		RVO_API size_t getNumAgents() const;
 
+		/**
+		 * \brief   Returns the count of static obstacles in the simulation.
+		 * \return  The count of static obstacles in the simulation.
+		 */
+		RVO_API size_t getNumObstacles() const;
+
+		/**
+		 * \brief   Returns the kind of spatial index used to compute the agent neighbors.
+		 * \return  The present kind of spatial index.
+		 */
+		RVO_API SpatialIndexType getSpatialIndex() const;
+
 		/**
 		 * \brief   Returns the time step of the simulation.
 		 * \return  The present time step of the simulation.
 		 */
 		RVO_API float getTimeStep() const;
 
+		/**
+		 * \brief   Processes the static obstacles that have been added so that they are accounted for in the simulation, by building a bounding volume hierarchy over their triangles.
+		 * \note    Obstacles added after this function has been called are not accounted for until it is called again.
+		 */
+		RVO_API void processObstacles();
+
+		/**
+		 * \brief   Computes the agents within an axis-aligned box.
+		 * \param   minCoord   The minimum coordinates of the box.
+		 * \param   maxCoord   The maximum coordinates of the box.
+		 * \param   agentNos   An array of at least maxAgents elements that receives the numbers of the agents within the box in no particular order.
+		 * \param   maxAgents  The maximum number of agent numbers to be stored in agentNos.
+		 * \return  The number of agents within the box, which may exceed maxAgents, in which case only maxAgents of them are stored.
+		 * \note    The spatial index of the simulation is reused, and rebuilt only if the agents have moved since it was last built.
+		 */
+		RVO_API size_t queryAgentsInBox(const Vector3 &minCoord, const Vector3 &maxCoord, size_t *agentNos, size_t maxAgents) const;
+
+		/**
+		 * \brief   Computes the agents within range of a point.
+		 * \param   point      The point.
+		 * \param   range      The range around the point.
+		 * \param   agentNos   An array of at least maxAgents elements that receives the numbers of the agents within range in no particular order.
+		 * \param   maxAgents  The maximum number of agent numbers to be stored in agentNos.
+		 * \return  The number of agents within range, which may exceed maxAgents, in which case only maxAgents of them are stored.
+		 * \note    The spatial index of the simulation is reused, and rebuilt only if the agents have moved since it was last built.
+		 */
+		RVO_API size_t queryAgentsInRange(const Vector3 &point, float range, size_t *agentNos, size_t maxAgents) const;
+
+		/**
+		 * \brief   Computes the agents within range nearest to a point.
+		 * \param   point      The point.
+		 * \param   range      The range around the point.
+		 * \param   agentNos   An array of at least maxAgents elements that receives the numbers of the nearest agents in order of increasing distance.
+		 * \param   maxAgents  The maximum number of agents to be computed.
+		 * \return  The number of agents computed.
+		 * \note    The spatial index of the simulation is reused, and rebuilt only if the agents have moved since it was last built.
+		 */
+		RVO_API size_t queryNearestAgents(const Vector3 &point, float range, size_t *agentNos, size_t maxAgents) const;
+
+		/**
+		 * \brief   Computes the agents within range nearest to each of several points.
+		 * \param   points        An array of numPoints points.
+		 * \param   ranges        An array of numPoints ranges around the points.
+		 * \param   maxAgents     An array of numPoints maximum numbers of agents to be computed for the points.
+		 * \param   numPoints     The number of points.
+		 * \param   agentOffsets  An array of numPoints + 1 elements that receives the offsets of the agents of each point in agentNos, such that the agents of point i are agentNos[agentOffsets[i]] to agentNos[agentOffsets[i + 1] - 1].
+		 * \param   agentNos      An array of at least as many elements as the sum of maxAgents that receives the numbers of the nearest agents of each point in order of increasing distance.
+		 * \return  The total number of agents computed.
+		 * \note    With OpenMP, the points are queried in parallel.
+		 */
+		RVO_API size_t queryNearestAgents(const Vector3 *points, const float *ranges, const size_t *maxAgents, size_t numPoints, size_t *agentOffsets, size_t *agentNos) const;
+
+		/**
+		 * \brief   Performs a visibility query between the two specified points with respect to the agents in the simulation.
+		 * \param   point1  The first point of the query.
+		 * \param   point2  The second point of the query.
+		 * \param   radius  The minimal distance between the line connecting the two points and the agents in order for the points to be mutually visible (optional). Must be non-negative.
+		 * \return  A boolean specifying whether the two points are mutually visible. Returns true when no agent is within the radius of the segment connecting the points, ignoring agents that contain either point, such as the agents located at them.
+		 */
+		RVO_API bool queryVisibility(const Vector3 &point1, const Vector3 &point2, float radius = 0.0f) const;
+
+		/**
+		 * \brief   Performs visibility queries between several pairs of points with respect to the agents in the simulation.
+		 * \param   points1      An array of numSegments first points of the queries.
+		 * \param   points2      An array of numSegments second points of the queries.
+		 * \param   radii        An array of numSegments radii of the queries, as in queryVisibility().
+		 * \param   numSegments  The number of queries.
+		 * \param   visible      An array of numSegments elements that receives whether the points of each query are mutually visible.
+		 * \note    With OpenMP, the queries are performed in parallel.
+		 */
+		RVO_API void queryVisibility(const Vector3 *points1, const Vector3 *points2, const float *radii, size_t numSegments, bool *visible) const;
+
 		/**
 		 * \brief   Removes an agent from the simulation.
 		 * \param   agentNo  The number of the agent that is to be removed.
@@ -270,6 +462,14 @@ namespace RVO {
 		 */
 		RVO_API void setAgentNeighborDist(size_t agentNo, float neighborDist);
 
+		/**
+		 * \brief   Sets the vertical neighbor distance of a specified agent, which makes its neighbor region an ellipsoid.
+		 * \param   agentNo               The number of the agent whose vertical neighbor distance is to be modified.
+		 * \param   verticalNeighborDist  The replacement vertical neighbor distance. Must be non-negative. Zero, the default, makes the neighbor region a sphere with the maximum neighbor distance as radius.
+		 * \note    The neighbor region is then an ellipsoid that extends the maximum neighbor distance horizontally and the vertical neighbor distance vertically, and the agent neighbors are the nearest agents within it, with the vertical distances scaled by the ratio of the two. A vertical neighbor distance less than the maximum neighbor distance keeps agents in distant altitude layers out of the agent neighbors and the ORCA constraints.
+		 */
+		RVO_API void setAgentVerticalNeighborDist(size_t agentNo, float verticalNeighborDist);
+
 		/**
 		 * \brief   Sets the three-dimensional position of a specified agent.
 		 * \param   agentNo   The number of the agent whose three-dimensional position is to be modified.
@@ -398,6 +598,74 @@ namespace RVO {
 		 */
 		RVO_API void setAgentUseDirectionalSpeedLimits(size_t agentNo, bool use);
 
+		/**
+		 * \brief   Sets the relative error allowed in the distances to the agent neighbors computed with the agent <i>k</i>d-tree.
+		 * \param   epsilon  The replacement relative error. Must be nonnegative. Zero, the default, computes the exact agent neighbors.
+		 * \note    With a positive relative error, the queries prune the nodes of the agent <i>k</i>d-tree farther than the current farthest agent neighbor divided by one plus the relative error. The farthest agent neighbor of each agent is then at most one plus the relative error times as far as the exact one, which saves node visits in dense crowds. The queries of the simulator and the neighbor lists with a positive skin distance remain exact.
+		 */
+		RVO_API void setAgentNeighborApproximation(float epsilon);
+
+		/**
+		 * \brief   Enables or disables culling the agent neighbors whose ORCA planes cannot constrain the new velocities of the agents.
+		 * \param   culling  True to cull the agent neighbors, false, the default, to keep them.
+		 * \note    An agent neighbor is culled while, given the current relative velocity, the agents are too far apart for its ORCA plane to exclude any velocity up to the maximum speed of the agent within the time horizon of the agent. The test is conservative, so the ORCA planes it removes could not have changed the new velocities. Culled agents neither take the place of farther agent neighbors nor add to the linear programs, which pays off when the neighbor distance is large compared with the time horizon times the maximum speed.
+		 */
+		RVO_API void setAgentNeighborCulling(bool culling);
+
+		/**
+		 * \brief   Sets the way of searching the agent <i>k</i>d-tree for the agent neighbors.
+		 * \param   neighborSearch  The replacement way of searching the agent <i>k</i>d-tree.
+		 * \note    All ways compute the same agent neighbors. The dual-tree and bottom-up searches apply only while the spatial index is the agent <i>k</i>d-tree and the skin distance of the neighbor lists is zero.
+		 */
+		RVO_API void setAgentNeighborSearch(AgentNeighborSearch neighborSearch);
+
+		/**
+		 * \brief   Enables or disables searching for the agent neighbors within the volumes swept by the agents over their time horizons.
+		 * \param   sweep  True to measure the distance to each agent as the distance of closest approach within the time horizon of the agent whose neighbors are computed, assuming both keep their current velocities, false, the default, to measure the current distance.
+		 * \note    The swept distance never exceeds the current distance, so the swept search finds the agents within the neighbor distance and also those that will come within it, which lets fast agents see oncoming agents with a smaller neighbor distance. The swept search applies only while the spatial index is the agent <i>k</i>d-tree and the skin distance of the neighbor lists is zero, and takes the place of the dual-tree and bottom-up searches.
+		 */
+		RVO_API void setAgentNeighborSweep(bool sweep);
+
+		/**
+		 * \brief   Sets the method of building the agent <i>k</i>d-tree.
+		 * \param   buildMethod  The replacement method of building the agent <i>k</i>d-tree.
+		 */
+		RVO_API void setAgentTreeBuildMethod(AgentTreeBuildMethod buildMethod);
+
+		/**
+		 * \brief   Sets whether the agent <i>k</i>d-tree of the previous simulation step is refit instead of rebuilt.
+		 * \param   refit             True to refit the agent <i>k</i>d-tree while the set of agents is unchanged, false to rebuild it every simulation step.
+		 * \param   rebuildThreshold  The ratio of the cost of the refit agent <i>k</i>d-tree to its cost when it was last rebuilt above which it is rebuilt. The cost is the sum of the surface areas of the bounding boxes of its nodes. Must be at least one.
+		 * \note    Refitting keeps the partition of the agents into leaves, so it is cheaper but slowly loses query efficiency as the agents move.
+		 */
+		RVO_API void setAgentTreeRefit(bool refit, float rebuildThreshold = 1.5f);
+
+		/**
+		 * \brief   Sets the maximum number of agents in a leaf node of the agent <i>k</i>d-tree.
+		 * \param   leafSize  The replacement maximum number of agents in a leaf node. Must be between 1 and 64. The default is 10.
+		 */
+		RVO_API void setAgentTreeLeafSize(size_t leafSize);
+
+		/**
+		 * \brief   Sets the policy of choosing the split of a node of the agent <i>k</i>d-tree built by RVO_SPLIT_BUILD.
+		 * \param   splitPolicy  The replacement policy of choosing the split of a node.
+		 */
+		RVO_API void setAgentTreeSplitPolicy(AgentTreeSplitPolicy splitPolicy);
+
+		/**
+		 * \brief   Sets the skin distance of the neighbor lists of the agents.
+		 * \param   skin  The replacement skin distance. Must be nonnegative. Zero, the default, queries the spatial index for the neighbors of every agent in every simulation step.
+		 * \note    With a positive skin distance, each agent caches the agents within its neighbor distance plus the skin distance and computes its neighbors from them, until it could have missed an agent. That is when its own displacement since the query plus the sum of the largest displacement of any agent per simulation step exceeds the skin distance. Agents that move slowly thus skip most queries, and the agent neighbors are the same as without a skin.
+		 */
+		RVO_API void setNeighborListSkin(float skin);
+
+		/**
+		 * \brief   Sets the kind of spatial index used to compute the agent neighbors.
+		 * \param   spatialIndex  The replacement kind of spatial index.
+		 * \note    All kinds of spatial index compute the same agent neighbors.
+		 */
+		RVO_API void setSpatialIndex(SpatialIndexType spatialIndex);
+
 		/**
 		 * \brief   Sets the time step of the simulation.
 		 * \param   timeStep  The time step of the simulation. Must be positive.
@@ -405,14 +673,39 @@ namespace RVO {
 		RVO_API void setTimeStep(float timeStep);
 
 	private:
+		/**
+		 * \brief   Builds the spatial index if the agents have changed since it was last built.
+		 */
+		void updateSpatialIndex() const;
+
 		Agent *defaultAgent_;
+		AgentStore *agentStore_;
+		HashGrid *hashGrid_;
 		KdTree *kdTree_;
+		ObstacleTree *obstacleTree_;
+		SpatialIndex *spatialIndex_;
+		SpatialIndexType spatialIndexType_;
+		double neighborDisplacement_;
+		size_t neighborListEpoch_;
+		bool neighborCulling_;
+		mutable bool spatialIndexStale_;
+		Vector3 defaultVelocity_;
+		float defaultMaxSpeed_;
+		float defaultRadius_;
 		float globalTime_;
+		float neighborSkin_;
 		float timeStep_;
 		std::vector<Agent *> agents_;
+		std::vector<Obstacle *> obstacles_;
+		std::vector<PlaneBuffer *> projPlanes_;
+		size_t numObstacles_;
+		mutable std::vector<const Agent *> queryAgents_;
+		mutable std::vector<std::pair<float, const Agent *> > queryNeighbors_;
 
 		friend class Agent;
+		friend class HashGrid;
 		friend class KdTree;
+		friend class ObstacleTree;
 	};
 }
 
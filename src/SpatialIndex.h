@@ -0,0 +1,216 @@
+/*
+ * SpatialIndex.h
+ * RVO2-3D Library
+ *
+ * Copyright 2008 University of North Carolina at Chapel Hill
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Please send all bug reports to <geom@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Jur van den Berg, Stephen J. Guy, Jamie Snape, Ming C. Lin, Dinesh Manocha
+ * Dept. of Computer Science
+ * 201 S. Columbia St.
+ * Frederick P. Brooks, Jr. Computer Science Bldg.
+ * Chapel Hill, N.C. 27599-3175
+ * United States of America
+ *
+ * <http://gamma.cs.unc.edu/RVO2/>
+ */
+/**
+ * \file    SpatialIndex.h
+ * \brief   Contains the SpatialIndex class.
+ */
+#ifndef RVO_SPATIAL_INDEX_H_
+#define RVO_SPATIAL_INDEX_H_
+
+#include "API.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "Vector3.h"
+
+namespace RVO {
+	class Agent;
+
+	/**
+	 * \brief   Collects all agents within range of an agent other than the agent itself, or of a point, in no particular order.
+	 */
+	class AgentRangeCollector {
+	public:
+		/**
+		 * \brief   Constructs a collector instance.
+		 * \param   agent   A pointer to the agent around which agents are collected, or NULL if no agent is excluded.
+		 * \param   agents  A reference to the vector to which the collected agents are appended.
+		 */
+		AgentRangeCollector(const Agent *agent, std::vector<const Agent *> &agents) : agent_(agent), agents_(agents) { }
+
+		/**
+		 * \brief   Inserts an agent into the collected agents if it is within range.
+		 * \param   agent    A pointer to the agent to be inserted.
+		 * \param   distSq   The squared distance between the agents.
+		 * \param   rangeSq  The squared range around the agent, which is left unchanged.
+		 */
+		void insertAgentNeighbor(const Agent *agent, float distSq, float &rangeSq)
+		{
+			if (agent != agent_ && distSq < rangeSq) {
+				agents_.push_back(agent);
+			}
+		}
+
+	private:
+		const Agent *agent_;
+		std::vector<const Agent *> &agents_;
+	};
+
+	/**
+	 * \brief   Collects the agents nearest to a point in order of increasing distance.
+	 */
+	class NearestAgentCollector {
+	public:
+		/**
+		 * \brief   Constructs a collector instance.
+		 * \param   maxNeighbors  The maximum number of agents to be collected.
+		 * \param   neighbors     An array of at least maxNeighbors elements that receives the collected agents.
+		 */
+		NearestAgentCollector(size_t maxNeighbors, std::pair<float, const Agent *> *neighbors) : neighbors(neighbors), maxNeighbors(maxNeighbors), numNeighbors(0) { }
+
+		/**
+		 * \brief   Inserts an agent into the collected agents.
+		 * \param   agent    A pointer to the agent to be inserted.
+		 * \param   distSq   The squared distance between the point and the agent.
+		 * \param   rangeSq  The squared range around the point.
+		 */
+		void insertAgentNeighbor(const Agent *agent, float distSq, float &rangeSq)
+		{
+			if (distSq < rangeSq) {
+				if (numNeighbors < maxNeighbors) {
+					++numNeighbors;
+				}
+
+				size_t i = numNeighbors - 1;
+
+				while (i != 0 && distSq < neighbors[i - 1].first) {
+					neighbors[i] = neighbors[i - 1];
+					--i;
+				}
+
+				neighbors[i] = std::make_pair(distSq, agent);
+
+				if (numNeighbors == maxNeighbors) {
+					rangeSq = neighbors[numNeighbors - 1].first;
+				}
+			}
+		}
+
+		std::pair<float, const Agent *> *neighbors;
+		size_t maxNeighbors;
+		size_t numNeighbors;
+	};
+
+	/**
+	 * \brief   Returns whether an agent blocks the visibility along a segment.
+	 * \param   point1       The first point of the segment.
+	 * \param   point2       The second point of the segment.
+	 * \param   radius       The radius of the sphere swept along the segment.
+	 * \param   position     The position of the agent.
+	 * \param   agentRadius  The radius of the agent.
+	 * \return  True if the agent overlaps the sphere swept along the segment and contains neither point, so that agents located at the points do not block them.
+	 */
+	inline bool blocksVisibility(const Vector3 &point1, const Vector3 &point2, float radius, const Vector3 &position, float agentRadius)
+	{
+		const float agentRadiusSq = agentRadius * agentRadius;
+
+		if (absSq(position - point1) < agentRadiusSq || absSq(position - point2) < agentRadiusSq) {
+			return false;
+		}
+
+		const Vector3 direction = point2 - point1;
+		const float lengthSq = absSq(direction);
+		const float t = lengthSq > 0.0f ? std::max(0.0f, std::min(1.0f, ((position - point1) * direction) / lengthSq)) : 0.0f;
+
+		return absSq(point1 + t * direction - position) < (radius + agentRadius) * (radius + agentRadius);
+	}
+
+	/**
+	 * \brief   Defines the interface of spatial indices over the agents in the simulation.
+	 */
+	class SpatialIndex {
+	public:
+		/**
+		 * \brief   Destroys this spatial index instance.
+		 */
+		virtual ~SpatialIndex() { }
+
+		/**
+		 * \brief   Builds the spatial index from the present positions of the agents.
+		 */
+		virtual void build() = 0;
+
+		/**
+		 * \brief   Computes the agent neighbors of the specified agent.
+		 * \param   agent    A pointer to the agent for which agent neighbors are to be computed.
+		 * \param   rangeSq  The squared range around the agent, in the neighbor metric of the agent, which scales vertical distances as by its vertical neighbor distance.
+		 */
+		virtual void computeAgentNeighbors(Agent *agent, float rangeSq) const = 0;
+
+		/**
+		 * \brief   Computes all agents within range of the specified agent as the candidates for its agent neighbors.
+		 * \param   agent    A pointer to the agent for which the candidates are to be computed.
+		 * \param   rangeSq  The squared range around the agent.
+		 */
+		virtual void computeAgentNeighborCandidates(Agent *agent, float rangeSq) const = 0;
+
+		/**
+		 * \brief   Computes all agents within range of a point.
+		 * \param   point    The point.
+		 * \param   rangeSq  The squared range around the point.
+		 * \param   agents   A reference to the vector to which the agents within range are appended in no particular order.
+		 */
+		virtual void computeAgentsInRange(const Vector3 &point, float rangeSq, std::vector<const Agent *> &agents) const = 0;
+
+		/**
+		 * \brief   Computes all agents within an axis-aligned box.
+		 * \param   minCoord  The minimum coordinates of the box.
+		 * \param   maxCoord  The maximum coordinates of the box.
+		 * \param   agents    A reference to the vector to which the agents within the box are appended in no particular order.
+		 */
+		virtual void computeAgentsInBox(const Vector3 &minCoord, const Vector3 &maxCoord, std::vector<const Agent *> &agents) const = 0;
+
+		/**
+		 * \brief   Computes the agents nearest to a point.
+		 * \param   point      The point.
+		 * \param   rangeSq    The squared range around the point.
+		 * \param   maxAgents  The maximum number of agents to be computed.
+		 * \param   neighbors  An array of at least maxAgents elements that receives the squared distances to and pointers to the nearest agents in order of increasing distance.
+		 * \return  The number of agents computed.
+		 */
+		virtual size_t computeNearestAgents(const Vector3 &point, float rangeSq, size_t maxAgents, std::pair<float, const Agent *> *neighbors) const = 0;
+
+		/**
+		 * \brief   Returns whether a sphere swept along a segment is clear of agents.
+		 * \param   point1  The first point of the segment.
+		 * \param   point2  The second point of the segment.
+		 * \param   radius  The radius of the sphere swept along the segment.
+		 * \return  True if no agent blocks the visibility along the segment, as defined by blocksVisibility().
+		 */
+		virtual bool queryVisibility(const Vector3 &point1, const Vector3 &point2, float radius) const = 0;
+	};
+}
+
+#endif /* RVO_SPATIAL_INDEX_H_ */
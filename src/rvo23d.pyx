@@ -1,6 +1,7 @@
 # distutils: language = c++
 from libcpp.vector cimport vector
 from libcpp cimport bool
+from libc.stdlib cimport malloc, free
 
 
 cdef extern from "Vector3.h" namespace "RVO":
@@ -16,6 +17,42 @@ cdef extern from "RVOSimulator.h" namespace "RVO":
     cdef const size_t RVO_ERROR
 
 
+cdef extern from "RVOSimulator.h" namespace "RVO":
+    cdef enum SpatialIndexType:
+        RVO_KD_TREE
+        RVO_HASH_GRID
+
+
+KD_TREE = RVO_KD_TREE
+HASH_GRID = RVO_HASH_GRID
+
+
+cdef extern from "RVOSimulator.h" namespace "RVO":
+    cdef enum AgentTreeBuildMethod:
+        RVO_SPLIT_BUILD
+        RVO_MORTON_BUILD
+
+    cdef enum AgentTreeSplitPolicy:
+        RVO_MIDPOINT_SPLIT
+        RVO_MEDIAN_SPLIT
+        RVO_SAH_SPLIT
+
+    cdef enum AgentNeighborSearch:
+        RVO_PER_AGENT_SEARCH
+        RVO_DUAL_TREE_SEARCH
+        RVO_BOTTOM_UP_SEARCH
+
+
+SPLIT_BUILD = RVO_SPLIT_BUILD
+MORTON_BUILD = RVO_MORTON_BUILD
+MIDPOINT_SPLIT = RVO_MIDPOINT_SPLIT
+MEDIAN_SPLIT = RVO_MEDIAN_SPLIT
+SAH_SPLIT = RVO_SAH_SPLIT
+PER_AGENT_SEARCH = RVO_PER_AGENT_SEARCH
+DUAL_TREE_SEARCH = RVO_DUAL_TREE_SEARCH
+BOTTOM_UP_SEARCH = RVO_BOTTOM_UP_SEARCH
+
+
 cdef extern from "RVOSimulator.h" namespace "RVO":
     cdef cppclass Line:
         Vector3 point
@@ -33,12 +70,17 @@ cdef extern from "RVOSimulator.h" namespace "RVO":
                         size_t maxNeighbors, float timeHorizon,
                         float radius, float maxSpeed,
                         const Vector3 & velocity)
+        size_t addObstacle(const vector[Vector3] & vertices,
+                           const vector[size_t] & indices)
         void doStep() nogil
         size_t getAgentAgentNeighbor(size_t agentNo, size_t neighborNo) const
         size_t getAgentMaxNeighbors(size_t agentNo) const
         float getAgentMaxSpeed(size_t agentNo) const
         float getAgentNeighborDist(size_t agentNo) const
+        float getAgentVerticalNeighborDist(size_t agentNo) const
         size_t getAgentNumAgentNeighbors(size_t agentNo) const
+        size_t getAgentNumObstacleNeighbors(size_t agentNo) const
+        size_t getAgentObstacleNeighbor(size_t agentNo, size_t neighborNo) const
         const Vector3 & getAgentPosition(size_t agentNo) const
         const Vector3 & getAgentPrefVelocity(size_t agentNo) const
         float getAgentRadius(size_t agentNo) const
@@ -46,10 +88,25 @@ cdef extern from "RVOSimulator.h" namespace "RVO":
         const Vector3 & getAgentVelocity(size_t agentNo) const
         float getGlobalTime() const
         size_t getNumAgents() const
+        size_t getNumObstacles() const
+        SpatialIndexType getSpatialIndex() const
         float getTimeStep() const
 
+        size_t queryAgentsInBox(const Vector3 & minCoord, const Vector3 & maxCoord,
+                                size_t * agentNos, size_t maxAgents) const
+        size_t queryAgentsInRange(const Vector3 & point, float range,
+                                  size_t * agentNos, size_t maxAgents) const
+        size_t queryNearestAgents(const Vector3 & point, float range,
+                                  size_t * agentNos, size_t maxAgents) const
+        size_t queryNearestAgents(const Vector3 * points, const float * ranges,
+                                  const size_t * maxAgents, size_t numPoints,
+                                  size_t * agentOffsets, size_t * agentNos) nogil const
         bool queryVisibility(const Vector3 & point1, const Vector3 & point2,
                              float radius) nogil const
+        void queryVisibility(const Vector3 * points1, const Vector3 * points2,
+                             const float * radii, size_t numSegments,
+                             bool * visible) nogil const
+        void processObstacles() nogil
         void setAgentDefaults(float neighborDist, size_t maxNeighbors,
                               float timeHorizon,
                               float radius, float maxSpeed,
@@ -57,6 +114,7 @@ cdef extern from "RVOSimulator.h" namespace "RVO":
         void setAgentMaxNeighbors(size_t agentNo, size_t maxNeighbors)
         void setAgentMaxSpeed(size_t agentNo, float maxSpeed)
         void setAgentNeighborDist(size_t agentNo, float neighborDist)
+        void setAgentVerticalNeighborDist(size_t agentNo, float verticalNeighborDist)
         void setAgentPosition(size_t agentNo, const Vector3 & position)
         void setAgentPrefVelocity(size_t agentNo, const Vector3 & prefVelocity)
         void setAgentRadius(size_t agentNo, float radius)
@@ -64,6 +122,16 @@ cdef extern from "RVOSimulator.h" namespace "RVO":
 
         void setAgentVelocity(size_t agentNo, const Vector3 & velocity)
         void setTimeStep(float timeStep)
+        void setAgentNeighborApproximation(float epsilon)
+        void setAgentNeighborCulling(bool culling)
+        void setAgentNeighborSearch(AgentNeighborSearch neighborSearch)
+        void setAgentNeighborSweep(bool sweep)
+        void setAgentTreeBuildMethod(AgentTreeBuildMethod buildMethod)
+        void setAgentTreeRefit(bool refit, float rebuildThreshold)
+        void setAgentTreeLeafSize(size_t leafSize)
+        void setAgentTreeSplitPolicy(AgentTreeSplitPolicy splitPolicy)
+        void setNeighborListSkin(float skin)
+        void setSpatialIndex(SpatialIndexType spatialIndex)
         
         # 加速度制限機能
         float getAgentMaxAcceleration(size_t agentNo) const
@@ -119,6 +187,26 @@ cdef class PyRVOSimulator:
 
         return agent_nr
 
+    def addObstacle(self, vertices, triangles):
+        cdef vector[Vector3] c_vertices
+        cdef vector[size_t] c_indices
+
+        for vertex in vertices:
+            c_vertices.push_back(Vector3(vertex[0], vertex[1], vertex[2]))
+
+        for triangle in triangles:
+            if len(triangle) != 3:
+                raise ValueError('Each obstacle triangle must have three vertex indices')
+            for index in triangle:
+                c_indices.push_back(index)
+
+        obstacle_nr = self.thisptr.addObstacle(c_vertices, c_indices)
+
+        if obstacle_nr == RVO_ERROR:
+            raise RuntimeError('Error adding obstacle to RVO simulation')
+
+        return obstacle_nr
+
     def doStep(self):
         with nogil:
             self.thisptr.doStep()
@@ -131,8 +219,14 @@ cdef class PyRVOSimulator:
         return self.thisptr.getAgentMaxSpeed(agent_no)
     def getAgentNeighborDist(self, size_t agent_no):
         return self.thisptr.getAgentNeighborDist(agent_no)
+    def getAgentVerticalNeighborDist(self, size_t agent_no):
+        return self.thisptr.getAgentVerticalNeighborDist(agent_no)
     def getAgentNumAgentNeighbors(self, size_t agent_no):
         return self.thisptr.getAgentNumAgentNeighbors(agent_no)
+    def getAgentNumObstacleNeighbors(self, size_t agent_no):
+        return self.thisptr.getAgentNumObstacleNeighbors(agent_no)
+    def getAgentObstacleNeighbor(self, size_t agent_no, size_t neighbor_no):
+        return self.thisptr.getAgentObstacleNeighbor(agent_no, neighbor_no)
     def getAgentPosition(self, size_t agent_no):
         cdef Vector3 pos = self.thisptr.getAgentPosition(agent_no)
         return pos.x(), pos.y(), pos.z()
@@ -150,9 +244,109 @@ cdef class PyRVOSimulator:
         return self.thisptr.getGlobalTime()
     def getNumAgents(self):
         return self.thisptr.getNumAgents()
+    def getNumObstacles(self):
+        return self.thisptr.getNumObstacles()
+    def getSpatialIndex(self):
+        return self.thisptr.getSpatialIndex()
     def getTimeStep(self):
         return self.thisptr.getTimeStep()
 
+    def processObstacles(self):
+        with nogil:
+            self.thisptr.processObstacles()
+
+    def queryAgentsInBox(self, tuple min_coord, tuple max_coord):
+        cdef Vector3 c_min_coord = Vector3(min_coord[0], min_coord[1], min_coord[2])
+        cdef Vector3 c_max_coord = Vector3(max_coord[0], max_coord[1], max_coord[2])
+        cdef vector[size_t] agent_nos = vector[size_t](64)
+        cdef size_t num_agents = self.thisptr.queryAgentsInBox(c_min_coord, c_max_coord, agent_nos.data(), agent_nos.size())
+
+        if num_agents > agent_nos.size():
+            agent_nos.resize(num_agents)
+            num_agents = self.thisptr.queryAgentsInBox(c_min_coord, c_max_coord, agent_nos.data(), agent_nos.size())
+
+        return [agent_nos[i] for i in range(num_agents)]
+    def queryAgentsInRange(self, tuple point, float radius):
+        cdef Vector3 c_point = Vector3(point[0], point[1], point[2])
+        cdef vector[size_t] agent_nos = vector[size_t](64)
+        cdef size_t num_agents = self.thisptr.queryAgentsInRange(c_point, radius, agent_nos.data(), agent_nos.size())
+
+        if num_agents > agent_nos.size():
+            agent_nos.resize(num_agents)
+            num_agents = self.thisptr.queryAgentsInRange(c_point, radius, agent_nos.data(), agent_nos.size())
+
+        return [agent_nos[i] for i in range(num_agents)]
+    def queryNearestAgents(self, tuple point, size_t num_agents, float radius=float('inf')):
+        cdef Vector3 c_point = Vector3(point[0], point[1], point[2])
+        cdef vector[size_t] agent_nos = vector[size_t](max(num_agents, 1))
+        cdef size_t num_found = self.thisptr.queryNearestAgents(c_point, radius, agent_nos.data(), num_agents)
+
+        return [agent_nos[i] for i in range(num_found)]
+    def queryNearestAgentsBatch(self, points, num_agents, radius=float('inf')):
+        cdef size_t num_points = len(points)
+        cdef vector[Vector3] c_points
+        cdef vector[float] c_ranges
+        cdef vector[size_t] c_max_agents
+        cdef vector[size_t] agent_offsets = vector[size_t](num_points + 1)
+        cdef vector[size_t] agent_nos
+        cdef size_t num_found
+
+        c_points.reserve(num_points)
+        c_ranges.reserve(num_points)
+        c_max_agents.reserve(num_points)
+
+        for i, point in enumerate(points):
+            c_points.push_back(Vector3(point[0], point[1], point[2]))
+            c_ranges.push_back(radius[i] if isinstance(radius, (list, tuple)) else radius)
+            c_max_agents.push_back(num_agents[i] if isinstance(num_agents, (list, tuple)) else num_agents)
+
+        agent_nos.resize(max(sum(c_max_agents), 1))
+
+        with nogil:
+            num_found = self.thisptr.queryNearestAgents(c_points.data(), c_ranges.data(), c_max_agents.data(),
+                                                        num_points, agent_offsets.data(), agent_nos.data())
+
+        return ([agent_offsets[i] for i in range(num_points + 1)],
+                [agent_nos[i] for i in range(num_found)])
+    def queryVisibility(self, tuple point1, tuple point2, float radius=0.0):
+        cdef Vector3 c_point1 = Vector3(point1[0], point1[1], point1[2])
+        cdef Vector3 c_point2 = Vector3(point2[0], point2[1], point2[2])
+        cdef bool visible
+
+        with nogil:
+            visible = self.thisptr.queryVisibility(c_point1, c_point2, radius)
+
+        return visible
+    def queryVisibilityBatch(self, points1, points2, radius=0.0):
+        cdef size_t num_segments = len(points1)
+        cdef vector[Vector3] c_points1
+        cdef vector[Vector3] c_points2
+        cdef vector[float] c_radii
+        cdef bool *visible = <bool *> malloc(max(num_segments, 1) * sizeof(bool))
+
+        if visible == NULL:
+            raise MemoryError()
+
+        c_points1.reserve(num_segments)
+        c_points2.reserve(num_segments)
+        c_radii.reserve(num_segments)
+
+        for i, (point1, point2) in enumerate(zip(points1, points2)):
+            c_points1.push_back(Vector3(point1[0], point1[1], point1[2]))
+            c_points2.push_back(Vector3(point2[0], point2[1], point2[2]))
+            c_radii.push_back(radius[i] if isinstance(radius, (list, tuple)) else radius)
+
+        num_segments = c_points1.size()
+
+        try:
+            with nogil:
+                self.thisptr.queryVisibility(c_points1.data(), c_points2.data(), c_radii.data(),
+                                             num_segments, visible)
+
+            return [visible[i] for i in range(num_segments)]
+        finally:
+            free(visible)
+
     def setAgentDefaults(self, float neighbor_dist, size_t max_neighbors, float time_horizon,
                          float radius, float max_speed,
                          tuple velocity=(0, 0)):
@@ -168,6 +362,8 @@ cdef class PyRVOSimulator:
         self.thisptr.setAgentNeighborDist(agent_no, neighbor_dist)
     def setAgentNeighborDist(self, size_t agent_no, float neighbor_dist):
         self.thisptr.setAgentNeighborDist(agent_no, neighbor_dist)
+    def setAgentVerticalNeighborDist(self, size_t agent_no, float vertical_neighbor_dist):
+        self.thisptr.setAgentVerticalNeighborDist(agent_no, vertical_neighbor_dist)
     def setAgentPosition(self, size_t agent_no, tuple position):
         cdef Vector3 c_pos = Vector3(position[0], position[1], position[2])
         self.thisptr.setAgentPosition(agent_no, c_pos)
@@ -183,6 +379,26 @@ cdef class PyRVOSimulator:
         self.thisptr.setAgentVelocity(agent_no, c_velocity)
     def setTimeStep(self, float time_step):
         self.thisptr.setTimeStep(time_step)
+    def setAgentNeighborApproximation(self, float epsilon):
+        self.thisptr.setAgentNeighborApproximation(epsilon)
+    def setAgentNeighborCulling(self, bool culling):
+        self.thisptr.setAgentNeighborCulling(culling)
+    def setAgentNeighborSearch(self, AgentNeighborSearch neighbor_search):
+        self.thisptr.setAgentNeighborSearch(neighbor_search)
+    def setAgentNeighborSweep(self, bool sweep):
+        self.thisptr.setAgentNeighborSweep(sweep)
+    def setAgentTreeBuildMethod(self, AgentTreeBuildMethod build_method):
+        self.thisptr.setAgentTreeBuildMethod(build_method)
+    def setAgentTreeRefit(self, bool refit, float rebuild_threshold=1.5):
+        self.thisptr.setAgentTreeRefit(refit, rebuild_threshold)
+    def setAgentTreeLeafSize(self, size_t leaf_size):
+        self.thisptr.setAgentTreeLeafSize(leaf_size)
+    def setAgentTreeSplitPolicy(self, AgentTreeSplitPolicy split_policy):
+        self.thisptr.setAgentTreeSplitPolicy(split_policy)
+    def setNeighborListSkin(self, float skin):
+        self.thisptr.setNeighborListSkin(skin)
+    def setSpatialIndex(self, SpatialIndexType spatial_index):
+        self.thisptr.setSpatialIndex(spatial_index)
     
     # 加速度制限機能のメソッド
     def getAgentMaxAcceleration(self, size_t agent_no):
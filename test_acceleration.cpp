@@ -7,6 +7,10 @@
 #include <vector>
 #include <cmath>
 #include <cassert>
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <utility>
 #include "RVO.h"
 
 using namespace RVO;
@@ -45,6 +49,86 @@ bool isFloatNear(float a, float b, float tolerance = 0.001f) {
     return std::abs(a - b) < tolerance;
 }
 
+// [0, 1] の乱数
+float random01() {
+    return static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX);
+}
+
+// 一辺 size の立方体に一様に配置した群衆を作成
+RVOSimulator* createCrowd(SpatialIndexType spatialIndex, size_t numAgents, float size, unsigned int seed) {
+    RVOSimulator* sim = new RVOSimulator();
+    sim->setTimeStep(0.125f);
+    sim->setSpatialIndex(spatialIndex);
+    sim->setAgentDefaults(3.0f, 10, 2.0f, 0.3f, 1.0f, Vector3());
+    
+    std::srand(seed);
+    
+    for (size_t i = 0; i < numAgents; i++) {
+        sim->addAgent(Vector3(size * random01(), size * random01(), size * random01()));
+        sim->setAgentPrefVelocity(i, Vector3(random01() - 0.5f, random01() - 0.5f, random01() - 0.5f));
+    }
+    
+    return sim;
+}
+
+// 全エージェントを調べて点から range 未満のエージェントを求める
+std::vector<size_t> bruteForceInRange(const RVOSimulator* sim, const Vector3& point, float range) {
+    std::vector<size_t> agentNos;
+    
+    for (size_t i = 0; i < sim->getNumAgents(); i++) {
+        if (absSq(sim->getAgentPosition(i) - point) < range * range) {
+            agentNos.push_back(i);
+        }
+    }
+    
+    return agentNos;
+}
+
+// 全エージェントを調べて箱（境界を含む）の中のエージェントを求める
+std::vector<size_t> bruteForceInBox(const RVOSimulator* sim, const Vector3& minCoord, const Vector3& maxCoord) {
+    std::vector<size_t> agentNos;
+    
+    for (size_t i = 0; i < sim->getNumAgents(); i++) {
+        const Vector3& p = sim->getAgentPosition(i);
+        
+        if (p.x() >= minCoord.x() && p.x() <= maxCoord.x() && p.y() >= minCoord.y() && p.y() <= maxCoord.y() && p.z() >= minCoord.z() && p.z() <= maxCoord.z()) {
+            agentNos.push_back(i);
+        }
+    }
+    
+    return agentNos;
+}
+
+// 全エージェントを調べて点に近い順に最大 maxAgents 個のエージェントを求める
+std::vector<size_t> bruteForceNearest(const RVOSimulator* sim, const Vector3& point, float range, size_t maxAgents) {
+    std::vector<std::pair<float, size_t> > candidates;
+    
+    for (size_t i = 0; i < sim->getNumAgents(); i++) {
+        const float distSq = absSq(sim->getAgentPosition(i) - point);
+        
+        if (distSq < range * range) {
+            candidates.push_back(std::make_pair(distSq, i));
+        }
+    }
+    
+    std::sort(candidates.begin(), candidates.end());
+    
+    std::vector<size_t> agentNos;
+    
+    for (size_t i = 0; i < candidates.size() && i < maxAgents; i++) {
+        agentNos.push_back(candidates[i].second);
+    }
+    
+    return agentNos;
+}
+
+// 保存されたエージェント番号が重複なく期待集合に含まれるか
+bool isDistinctSubset(std::vector<size_t> agentNos, const std::vector<size_t>& expected) {
+    std::sort(agentNos.begin(), agentNos.end());
+    
+    return std::adjacent_find(agentNos.begin(), agentNos.end()) == agentNos.end() && std::includes(expected.begin(), expected.end(), agentNos.begin(), agentNos.end());
+}
+
 // テスト1: API動作確認
 void testAPI(TestStats& stats) {
     std::cout << "\n=== API動作テスト ===" << std::endl;
@@ -304,6 +388,637 @@ void testRealWorldScenario(TestStats& stats) {
     delete sim;
 }
 
+// テスト7: 空間問い合わせと総当たりの比較
+void testSpatialQueries(TestStats& stats) {
+    std::cout << "\n=== 空間問い合わせテスト ===" << std::endl;
+    
+    const SpatialIndexType spatialIndices[2] = { RVO_KD_TREE, RVO_HASH_GRID };
+    const char* const names[2] = { "kd-tree", "ハッシュグリッド" };
+    
+    for (int index = 0; index < 2; index++) {
+        RVOSimulator* sim = createCrowd(spatialIndices[index], 500, 20.0f, 7);
+        
+        // 移動後の問い合わせで空間インデックスが再構築される
+        sim->doStep();
+        sim->doStep();
+        
+        const size_t numAgents = sim->getNumAgents();
+        std::vector<size_t> agentNos(numAgents);
+        bool rangeMatches = true;
+        bool rangeTruncates = true;
+        bool boxMatches = true;
+        bool boxTruncates = true;
+        bool nearestMatches = true;
+        bool nearestTruncates = true;
+        
+        std::srand(11);
+        
+        for (int query = 0; query < 20; query++) {
+            const Vector3 point(20.0f * random01(), 20.0f * random01(), 20.0f * random01());
+            const float range = 2.0f + 3.0f * random01();
+            
+            // 範囲内のエージェント
+            const std::vector<size_t> inRange = bruteForceInRange(sim, point, range);
+            size_t count = sim->queryAgentsInRange(point, range, &agentNos[0], numAgents);
+            std::vector<size_t> found(agentNos.begin(), agentNos.begin() + std::min(count, numAgents));
+            std::sort(found.begin(), found.end());
+            rangeMatches = rangeMatches && count == inRange.size() && found == inRange;
+            
+            // maxAgents を超える場合も総数を返し、maxAgents 個だけ保存する
+            const size_t rangeLimit = inRange.size() / 2;
+            std::fill(agentNos.begin(), agentNos.end(), RVO_ERROR);
+            count = sim->queryAgentsInRange(point, range, &agentNos[0], rangeLimit);
+            rangeTruncates = rangeTruncates && count == inRange.size() && isDistinctSubset(std::vector<size_t>(agentNos.begin(), agentNos.begin() + rangeLimit), inRange) && agentNos[rangeLimit] == RVO_ERROR;
+            
+            // 箱の中のエージェント
+            const Vector3 minCoord = point - Vector3(range, 0.5f * range, range);
+            const Vector3 maxCoord = point + Vector3(0.5f * range, range, range);
+            const std::vector<size_t> inBox = bruteForceInBox(sim, minCoord, maxCoord);
+            count = sim->queryAgentsInBox(minCoord, maxCoord, &agentNos[0], numAgents);
+            found.assign(agentNos.begin(), agentNos.begin() + std::min(count, numAgents));
+            std::sort(found.begin(), found.end());
+            boxMatches = boxMatches && count == inBox.size() && found == inBox;
+            
+            const size_t boxLimit = inBox.size() / 2;
+            std::fill(agentNos.begin(), agentNos.end(), RVO_ERROR);
+            count = sim->queryAgentsInBox(minCoord, maxCoord, &agentNos[0], boxLimit);
+            boxTruncates = boxTruncates && count == inBox.size() && isDistinctSubset(std::vector<size_t>(agentNos.begin(), agentNos.begin() + boxLimit), inBox) && agentNos[boxLimit] == RVO_ERROR;
+            
+            // 最近傍のエージェントは距離の昇順
+            const std::vector<size_t> nearest = bruteForceNearest(sim, point, range, numAgents);
+            count = sim->queryNearestAgents(point, range, &agentNos[0], numAgents);
+            nearestMatches = nearestMatches && count == nearest.size() && std::equal(nearest.begin(), nearest.end(), agentNos.begin());
+            
+            // maxAgents 個に打ち切られる
+            const std::vector<size_t> nearestFive = bruteForceNearest(sim, point, range, 5);
+            count = sim->queryNearestAgents(point, range, &agentNos[0], 5);
+            nearestTruncates = nearestTruncates && count == nearestFive.size() && std::equal(nearestFive.begin(), nearestFive.end(), agentNos.begin());
+            nearestTruncates = nearestTruncates && sim->queryNearestAgents(point, range, &agentNos[0], 0) == 0;
+        }
+        
+        stats.recordTest(rangeMatches, std::string("範囲問い合わせと総当たりの一致 (") + names[index] + ")");
+        stats.recordTest(rangeTruncates, std::string("範囲問い合わせの maxAgents 打ち切り (") + names[index] + ")");
+        stats.recordTest(boxMatches, std::string("箱問い合わせと総当たりの一致 (") + names[index] + ")");
+        stats.recordTest(boxTruncates, std::string("箱問い合わせの maxAgents 打ち切り (") + names[index] + ")");
+        stats.recordTest(nearestMatches, std::string("最近傍問い合わせと総当たりの一致 (") + names[index] + ")");
+        stats.recordTest(nearestTruncates, std::string("最近傍問い合わせの maxAgents 打ち切り (") + names[index] + ")");
+        
+        delete sim;
+    }
+}
+
+// テスト8: 複数点の最近傍問い合わせと単一点の問い合わせの比較
+void testBatchNearestQueries(TestStats& stats) {
+    std::cout << "\n=== 複数点の最近傍問い合わせテスト ===" << std::endl;
+    
+    const SpatialIndexType spatialIndices[2] = { RVO_KD_TREE, RVO_HASH_GRID };
+    const char* const names[2] = { "kd-tree", "ハッシュグリッド" };
+    
+    for (int index = 0; index < 2; index++) {
+        RVOSimulator* sim = createCrowd(spatialIndices[index], 500, 20.0f, 13);
+        sim->doStep();
+        
+        const size_t numPoints = 40;
+        std::vector<Vector3> points(numPoints);
+        std::vector<float> ranges(numPoints);
+        std::vector<size_t> maxAgents(numPoints);
+        size_t sumMaxAgents = 0;
+        
+        std::srand(17);
+        
+        for (size_t i = 0; i < numPoints; i++) {
+            points[i] = Vector3(20.0f * random01(), 20.0f * random01(), 20.0f * random01());
+            ranges[i] = 1.0f + 4.0f * random01();
+            // 4 点に 1 点は maxAgents が 0
+            maxAgents[i] = i % 4 == 0 ? 0 : 1 + i % 12;
+            sumMaxAgents += maxAgents[i];
+        }
+        
+        std::vector<size_t> agentOffsets(numPoints + 1, RVO_ERROR);
+        std::vector<size_t> agentNos(sumMaxAgents, RVO_ERROR);
+        const size_t total = sim->queryNearestAgents(&points[0], &ranges[0], &maxAgents[0], numPoints, &agentOffsets[0], &agentNos[0]);
+        
+        bool offsetsMatch = agentOffsets[0] == 0 && agentOffsets[numPoints] == total;
+        bool agentsMatch = true;
+        bool emptyPoints = true;
+        std::vector<size_t> single(sumMaxAgents + 1);
+        
+        for (size_t i = 0; i < numPoints; i++) {
+            const size_t count = sim->queryNearestAgents(points[i], ranges[i], &single[0], maxAgents[i]);
+            
+            offsetsMatch = offsetsMatch && agentOffsets[i] <= agentOffsets[i + 1] && agentOffsets[i + 1] - agentOffsets[i] == count;
+            agentsMatch = agentsMatch && std::equal(single.begin(), single.begin() + count, agentNos.begin() + agentOffsets[i]);
+            
+            if (maxAgents[i] == 0) {
+                emptyPoints = emptyPoints && agentOffsets[i + 1] == agentOffsets[i];
+            }
+        }
+        
+        stats.recordTest(offsetsMatch, std::string("複数点問い合わせのオフセット (") + names[index] + ")");
+        stats.recordTest(agentsMatch, std::string("複数点問い合わせと単一点問い合わせの一致 (") + names[index] + ")");
+        stats.recordTest(emptyPoints, std::string("maxAgents が 0 の点は空 (") + names[index] + ")");
+        
+        delete sim;
+    }
+}
+
+// 全エージェントを調べて可視性を求める（端点を含むエージェントは無視する）
+bool bruteForceVisibility(const RVOSimulator* sim, const Vector3& point1, const Vector3& point2, float radius) {
+    const Vector3 direction = point2 - point1;
+    const float lengthSq = absSq(direction);
+    
+    for (size_t i = 0; i < sim->getNumAgents(); i++) {
+        const Vector3& position = sim->getAgentPosition(i);
+        const float agentRadius = sim->getAgentRadius(i);
+        
+        if (absSq(position - point1) < agentRadius * agentRadius || absSq(position - point2) < agentRadius * agentRadius) {
+            continue;
+        }
+        
+        const float t = lengthSq > 0.0f ? std::max(0.0f, std::min(1.0f, ((position - point1) * direction) / lengthSq)) : 0.0f;
+        
+        if (absSq(point1 + t * direction - position) < (radius + agentRadius) * (radius + agentRadius)) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+// テスト9: 可視性問い合わせ
+void testVisibilityQueries(TestStats& stats) {
+    std::cout << "\n=== 可視性問い合わせテスト ===" << std::endl;
+    
+    const SpatialIndexType spatialIndices[2] = { RVO_KD_TREE, RVO_HASH_GRID };
+    const char* const names[2] = { "kd-tree", "ハッシュグリッド" };
+    
+    for (int index = 0; index < 2; index++) {
+        const std::string name = std::string(" (") + names[index] + ")";
+        
+        RVOSimulator* sim = new RVOSimulator();
+        sim->setTimeStep(0.1f);
+        sim->setSpatialIndex(spatialIndices[index]);
+        sim->setAgentDefaults(15.0f, 10, 10.0f, 1.0f, 2.0f, Vector3());
+        sim->addAgent(Vector3(0, 0, 0));
+        sim->addAgent(Vector3(10, 0, 0));
+        
+        // 線分上のエージェントが視線を遮る
+        stats.recordTest(!sim->queryVisibility(Vector3(-5, 0, 0), Vector3(5, 0, 0)), "遮られた線分" + name);
+        
+        // エージェントから離れた線分は見通せる
+        stats.recordTest(sim->queryVisibility(Vector3(-5, 3, 0), Vector3(5, 3, 0)), "遮られない線分" + name);
+        
+        // 半径を広げると近くのエージェントが遮る
+        stats.recordTest(sim->queryVisibility(Vector3(-5, 1.5f, 0), Vector3(5, 1.5f, 0), 0.0f) && !sim->queryVisibility(Vector3(-5, 1.5f, 0), Vector3(5, 1.5f, 0), 1.0f), "問い合わせ半径による遮蔽" + name);
+        
+        // 端点にいるエージェントは無視される
+        stats.recordTest(sim->queryVisibility(Vector3(0, 0, 0), Vector3(10, 0, 0)), "端点のエージェントは遮らない" + name);
+        
+        // 端点のエージェントを無視しても、その先のエージェントは遮る
+        stats.recordTest(!sim->queryVisibility(Vector3(0, 0, 0), Vector3(20, 0, 0)), "端点の先のエージェントは遮る" + name);
+        
+        // 複数線分の問い合わせは単一の問い合わせと一致する
+        const Vector3 points1[5] = { Vector3(-5, 0, 0), Vector3(-5, 3, 0), Vector3(-5, 1.5f, 0), Vector3(0, 0, 0), Vector3(0, 0, 0) };
+        const Vector3 points2[5] = { Vector3(5, 0, 0), Vector3(5, 3, 0), Vector3(5, 1.5f, 0), Vector3(10, 0, 0), Vector3(20, 0, 0) };
+        const float radii[5] = { 0.0f, 0.0f, 1.0f, 0.0f, 0.0f };
+        bool visible[5];
+        sim->queryVisibility(points1, points2, radii, 5, visible);
+        
+        bool batchMatches = true;
+        
+        for (int i = 0; i < 5; i++) {
+            batchMatches = batchMatches && visible[i] == sim->queryVisibility(points1[i], points2[i], radii[i]);
+        }
+        
+        stats.recordTest(batchMatches, "複数線分の可視性問い合わせ" + name);
+        
+        delete sim;
+    }
+    
+    // 乱数で配置した群衆で kd-tree、ハッシュグリッド、総当たりが一致する
+    RVOSimulator* kdTreeSim = createCrowd(RVO_KD_TREE, 400, 20.0f, 19);
+    RVOSimulator* hashGridSim = createCrowd(RVO_HASH_GRID, 400, 20.0f, 19);
+    kdTreeSim->doStep();
+    hashGridSim->doStep();
+    
+    const size_t numSegments = 100;
+    std::vector<Vector3> points1(numSegments);
+    std::vector<Vector3> points2(numSegments);
+    std::vector<float> radii(numSegments);
+    
+    std::srand(23);
+    
+    for (size_t i = 0; i < numSegments; i++) {
+        // 半数の線分はエージェントの位置から始まる
+        points1[i] = i % 2 == 0 ? kdTreeSim->getAgentPosition(i) : Vector3(20.0f * random01(), 20.0f * random01(), 20.0f * random01());
+        points2[i] = points1[i] + Vector3(8.0f * random01() - 4.0f, 8.0f * random01() - 4.0f, 8.0f * random01() - 4.0f);
+        radii[i] = i % 3 == 0 ? 0.0f : 0.5f * random01();
+    }
+    
+    bool* const kdTreeResults = new bool[numSegments];
+    bool* const hashGridResults = new bool[numSegments];
+    kdTreeSim->queryVisibility(&points1[0], &points2[0], &radii[0], numSegments, kdTreeResults);
+    hashGridSim->queryVisibility(&points1[0], &points2[0], &radii[0], numSegments, hashGridResults);
+    
+    bool backendsAgree = true;
+    bool bruteForceAgrees = true;
+    size_t numVisible = 0;
+    
+    for (size_t i = 0; i < numSegments; i++) {
+        backendsAgree = backendsAgree && kdTreeResults[i] == hashGridResults[i];
+        bruteForceAgrees = bruteForceAgrees && kdTreeResults[i] == bruteForceVisibility(kdTreeSim, points1[i], points2[i], radii[i]);
+        numVisible += kdTreeResults[i] ? 1 : 0;
+    }
+    
+    stats.recordTest(backendsAgree, "kd-tree とハッシュグリッドの可視性の一致");
+    stats.recordTest(bruteForceAgrees && numVisible > 0 && numVisible < numSegments, "可視性と総当たりの一致");
+    
+    delete[] kdTreeResults;
+    delete[] hashGridResults;
+    delete kdTreeSim;
+    delete hashGridSim;
+}
+
+// x = 2 の平面上の正方形の壁（2 つの三角形）
+void addWall(RVOSimulator* sim) {
+    std::vector<Vector3> vertices;
+    vertices.push_back(Vector3(2, -5, -5));
+    vertices.push_back(Vector3(2, 5, -5));
+    vertices.push_back(Vector3(2, 5, 5));
+    vertices.push_back(Vector3(2, -5, 5));
+    
+    std::vector<size_t> indices;
+    const size_t wall[6] = { 0, 1, 2, 0, 2, 3 };
+    indices.assign(wall, wall + 6);
+    
+    sim->addObstacle(vertices, indices);
+    sim->processObstacles();
+}
+
+// テスト10: 静的障害物
+void testObstacles(TestStats& stats) {
+    std::cout << "\n=== 静的障害物テスト ===" << std::endl;
+    
+    RVOSimulator* sim = new RVOSimulator();
+    sim->setTimeStep(0.1f);
+    sim->setAgentDefaults(5.0f, 10, 2.0f, 0.5f, 1.0f, Vector3());
+    
+    // 不正なインデックスは RVO_ERROR を返し、障害物を追加しない
+    std::vector<Vector3> vertices;
+    vertices.push_back(Vector3(0, 0, 0));
+    vertices.push_back(Vector3(1, 0, 0));
+    vertices.push_back(Vector3(0, 1, 0));
+    
+    const size_t notTriangles[4] = { 0, 1, 2, 0 };
+    const size_t outOfRange[3] = { 0, 1, 3 };
+    stats.recordTest(sim->addObstacle(vertices, std::vector<size_t>(notTriangles, notTriangles + 4)) == RVO_ERROR, "3 の倍数でないインデックス数はエラー");
+    stats.recordTest(sim->addObstacle(vertices, std::vector<size_t>(outOfRange, outOfRange + 3)) == RVO_ERROR, "範囲外のインデックスはエラー");
+    stats.recordTest(sim->getNumObstacles() == 0, "エラー時は障害物を追加しない");
+    
+    // 退化した三角形だけの障害物は番号を得るが、エージェントを遮らない
+    std::vector<Vector3> collinear;
+    collinear.push_back(Vector3(2, -5, 0));
+    collinear.push_back(Vector3(2, 0, 0));
+    collinear.push_back(Vector3(2, 5, 0));
+    const size_t degenerate[3] = { 0, 1, 2 };
+    stats.recordTest(sim->addObstacle(collinear, std::vector<size_t>(degenerate, degenerate + 3)) == 0 && sim->getNumObstacles() == 1, "退化した三角形の障害物の番号");
+    sim->processObstacles();
+    
+    size_t agentNo = sim->addAgent(Vector3(0, 0, 0));
+    sim->setAgentPrefVelocity(agentNo, Vector3(1, 0, 0));
+    bool noNeighbors = true;
+    
+    for (int step = 0; step < 40; step++) {
+        sim->doStep();
+        noNeighbors = noNeighbors && sim->getAgentNumObstacleNeighbors(agentNo) == 0;
+    }
+    
+    stats.recordTest(noNeighbors && sim->getAgentPosition(agentNo).x() > 3.0f, "退化した三角形は無視される");
+    delete sim;
+    
+    // 壁に向かうエージェントは壁の手前で止まる
+    sim = new RVOSimulator();
+    sim->setTimeStep(0.1f);
+    sim->setAgentDefaults(5.0f, 10, 2.0f, 0.5f, 1.0f, Vector3());
+    addWall(sim);
+    agentNo = sim->addAgent(Vector3(0, 0, 0));
+    sim->setAgentPrefVelocity(agentNo, Vector3(1, 0, 0));
+    
+    size_t maxObstacleNeighbors = 0;
+    bool neighborIsWall = true;
+    float maxX = 0.0f;
+    
+    for (int step = 0; step < 60; step++) {
+        sim->doStep();
+        maxObstacleNeighbors = std::max(maxObstacleNeighbors, sim->getAgentNumObstacleNeighbors(agentNo));
+        
+        for (size_t i = 0; i < sim->getAgentNumObstacleNeighbors(agentNo); i++) {
+            neighborIsWall = neighborIsWall && sim->getAgentObstacleNeighbor(agentNo, i) == 0;
+        }
+        
+        maxX = std::max(maxX, sim->getAgentPosition(agentNo).x());
+    }
+    
+    stats.recordTest(maxObstacleNeighbors > 0 && neighborIsWall, "壁が障害物の近傍になる");
+    stats.recordTest(maxX <= 2.0f - 0.5f + 0.01f, "エージェントは壁を通り抜けない");
+    
+    std::cout << "壁に最も近づいた位置: x = " << maxX << std::endl;
+    
+    delete sim;
+    
+    // 中心がちょうど三角形の上にある静止したエージェントは三角形から離れる
+    sim = new RVOSimulator();
+    sim->setTimeStep(0.1f);
+    sim->setAgentDefaults(5.0f, 10, 2.0f, 0.5f, 1.0f, Vector3());
+    
+    std::vector<Vector3> floor;
+    floor.push_back(Vector3(0, 0, 0));
+    floor.push_back(Vector3(4, 0, 0));
+    floor.push_back(Vector3(0, 4, 0));
+    sim->addObstacle(floor, std::vector<size_t>(degenerate, degenerate + 3));
+    sim->processObstacles();
+    
+    agentNo = sim->addAgent(Vector3(1, 1, 0));
+    sim->setAgentPrefVelocity(agentNo, Vector3(0.5f, 0, 0));
+    sim->doStep();
+    
+    const Vector3 position = sim->getAgentPosition(agentNo);
+    stats.recordTest(sim->getAgentNumObstacleNeighbors(agentNo) == 1 && position == position && std::abs(position.z()) > 0.05f, "三角形の上のエージェントは三角形から離れる");
+    
+    delete sim;
+}
+
+// 2 つのシミュレーションで各エージェントの近傍の集合が一致するか
+bool haveSameAgentNeighbors(const RVOSimulator* sim1, const RVOSimulator* sim2) {
+    if (sim1->getNumAgents() != sim2->getNumAgents()) {
+        return false;
+    }
+    
+    for (size_t i = 0; i < sim1->getNumAgents(); i++) {
+        std::vector<size_t> neighbors1;
+        std::vector<size_t> neighbors2;
+        
+        for (size_t j = 0; j < sim1->getAgentNumAgentNeighbors(i); j++) {
+            neighbors1.push_back(sim1->getAgentAgentNeighbor(i, j));
+        }
+        
+        for (size_t j = 0; j < sim2->getAgentNumAgentNeighbors(i); j++) {
+            neighbors2.push_back(sim2->getAgentAgentNeighbor(i, j));
+        }
+        
+        std::sort(neighbors1.begin(), neighbors1.end());
+        std::sort(neighbors2.begin(), neighbors2.end());
+        
+        if (neighbors1 != neighbors2) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+// テスト11: デュアルツリー探索とエージェントごとの探索の比較
+void testDualTreeSearch(TestStats& stats) {
+    std::cout << "\n=== デュアルツリー探索テスト ===" << std::endl;
+    
+    // 近傍距離内のエージェント数が maxNeighbors を超える密度
+    RVOSimulator* perAgentSim = createCrowd(RVO_KD_TREE, 1000, 15.0f, 29);
+    RVOSimulator* dualTreeSim = createCrowd(RVO_KD_TREE, 1000, 15.0f, 29);
+    dualTreeSim->setAgentNeighborSearch(RVO_DUAL_TREE_SEARCH);
+    
+    bool sameNeighbors = true;
+    size_t numNeighbors = 0;
+    
+    for (int step = 0; step < 10; step++) {
+        perAgentSim->doStep();
+        dualTreeSim->doStep();
+        sameNeighbors = sameNeighbors && haveSameAgentNeighbors(perAgentSim, dualTreeSim);
+    }
+    
+    for (size_t i = 0; i < perAgentSim->getNumAgents(); i++) {
+        numNeighbors += perAgentSim->getAgentNumAgentNeighbors(i);
+    }
+    
+    stats.recordTest(sameNeighbors && numNeighbors > 0, "デュアルツリー探索の近傍の一致");
+    
+    std::cout << "エージェントあたりの近傍数: " << static_cast<float>(numNeighbors) / perAgentSim->getNumAgents() << std::endl;
+    
+    delete perAgentSim;
+    delete dualTreeSim;
+}
+
+// テスト12: ボトムアップ探索とエージェントごとの探索の比較
+void testBottomUpSearch(TestStats& stats) {
+    std::cout << "\n=== ボトムアップ探索テスト ===" << std::endl;
+    
+    RVOSimulator* perAgentSim = createCrowd(RVO_KD_TREE, 1000, 15.0f, 31);
+    RVOSimulator* bottomUpSim = createCrowd(RVO_KD_TREE, 1000, 15.0f, 31);
+    RVOSimulator* refitSim = createCrowd(RVO_KD_TREE, 1000, 15.0f, 31);
+    bottomUpSim->setAgentNeighborSearch(RVO_BOTTOM_UP_SEARCH);
+    refitSim->setAgentNeighborSearch(RVO_BOTTOM_UP_SEARCH);
+    
+    // しきい値が大きいので、最初のステップの後は再構築せずに refit する
+    refitSim->setAgentTreeRefit(true, 1000.0f);
+    
+    bool sameNeighbors = true;
+    bool sameNeighborsRefit = true;
+    
+    for (int step = 0; step < 15; step++) {
+        perAgentSim->doStep();
+        bottomUpSim->doStep();
+        refitSim->doStep();
+        sameNeighbors = sameNeighbors && haveSameAgentNeighbors(perAgentSim, bottomUpSim);
+        sameNeighborsRefit = sameNeighborsRefit && haveSameAgentNeighbors(perAgentSim, refitSim);
+    }
+    
+    stats.recordTest(sameNeighbors, "ボトムアップ探索の近傍の一致");
+    stats.recordTest(sameNeighborsRefit, "refit した木でのボトムアップ探索の近傍の一致");
+    
+    delete perAgentSim;
+    delete bottomUpSim;
+    delete refitSim;
+}
+
+// エージェントの近傍の番号を昇順で返す
+std::vector<size_t> getSortedAgentNeighbors(const RVOSimulator* sim, size_t agentNo) {
+    std::vector<size_t> neighbors;
+    
+    for (size_t i = 0; i < sim->getAgentNumAgentNeighbors(agentNo); i++) {
+        neighbors.push_back(sim->getAgentAgentNeighbor(agentNo, i));
+    }
+    
+    std::sort(neighbors.begin(), neighbors.end());
+    
+    return neighbors;
+}
+
+// テスト13: 垂直方向の近傍距離
+void testVerticalNeighborDist(TestStats& stats) {
+    std::cout << "\n=== 垂直方向の近傍距離テスト ===" << std::endl;
+    
+    const SpatialIndexType spatialIndices[3] = { RVO_KD_TREE, RVO_KD_TREE, RVO_HASH_GRID };
+    const AgentNeighborSearch searches[3] = { RVO_PER_AGENT_SEARCH, RVO_DUAL_TREE_SEARCH, RVO_PER_AGENT_SEARCH };
+    const char* const names[3] = { "kd-tree", "デュアルツリー", "ハッシュグリッド" };
+    
+    for (int index = 0; index < 3; index++) {
+        const std::string name = std::string(" (") + names[index] + ")";
+        
+        RVOSimulator* sim = new RVOSimulator();
+        sim->setTimeStep(0.1f);
+        sim->setSpatialIndex(spatialIndices[index]);
+        sim->setAgentNeighborSearch(searches[index]);
+        sim->setAgentDefaults(5.0f, 10, 2.0f, 0.3f, 1.0f, Vector3());
+        
+        sim->addAgent(Vector3(0, 0, 0));
+        // 水平方向の近傍（2 番はわずかに高さが違う）
+        sim->addAgent(Vector3(3, 0, 0));
+        sim->addAgent(Vector3(0, -2.5f, 0.5f));
+        // 離れた高度の層にいるエージェント
+        sim->addAgent(Vector3(0, 0, 3));
+        sim->addAgent(Vector3(1, 1, 3.5f));
+        // 近傍距離の外
+        sim->addAgent(Vector3(7, 0, 0));
+        
+        sim->doStep();
+        
+        const size_t sphere[4] = { 1, 2, 3, 4 };
+        stats.recordTest(getSortedAgentNeighbors(sim, 0) == std::vector<size_t>(sphere, sphere + 4), "垂直近傍距離なしでは球内の全エージェントが近傍" + name);
+        
+        sim->setAgentVerticalNeighborDist(0, 1.0f);
+        sim->doStep();
+        
+        const size_t layer[2] = { 1, 2 };
+        stats.recordTest(getSortedAgentNeighbors(sim, 0) == std::vector<size_t>(layer, layer + 2), "離れた高度の層は近傍から除かれる" + name);
+        
+        delete sim;
+    }
+}
+
+// テスト14: 近傍のカリング
+void testNeighborCulling(TestStats& stats) {
+    std::cout << "\n=== 近傍カリングテスト ===" << std::endl;
+    
+    RVOSimulator* sims[2];
+    
+    for (int culling = 0; culling < 2; culling++) {
+        // 近傍距離が時間範囲と最大速度の積より十分大きく、maxNeighbors が近傍を打ち切らない
+        sims[culling] = new RVOSimulator();
+        sims[culling]->setTimeStep(0.125f);
+        sims[culling]->setAgentDefaults(8.0f, 300, 1.0f, 0.4f, 1.0f, Vector3());
+        sims[culling]->setAgentNeighborCulling(culling == 1);
+        
+        std::srand(37);
+        
+        for (size_t i = 0; i < 300; i++) {
+            sims[culling]->addAgent(Vector3(12.0f * random01(), 12.0f * random01(), 12.0f * random01()));
+            sims[culling]->setAgentPrefVelocity(i, Vector3(2.0f * random01() - 1.0f, 2.0f * random01() - 1.0f, 2.0f * random01() - 1.0f));
+        }
+    }
+    
+    bool sameVelocities = true;
+    size_t numNeighbors[2] = { 0, 0 };
+    
+    for (int step = 0; step < 20; step++) {
+        sims[0]->doStep();
+        sims[1]->doStep();
+        
+        for (size_t i = 0; i < sims[0]->getNumAgents(); i++) {
+            sameVelocities = sameVelocities && sims[0]->getAgentVelocity(i) == sims[1]->getAgentVelocity(i) && sims[0]->getAgentPosition(i) == sims[1]->getAgentPosition(i);
+            numNeighbors[0] += sims[0]->getAgentNumAgentNeighbors(i);
+            numNeighbors[1] += sims[1]->getAgentNumAgentNeighbors(i);
+        }
+    }
+    
+    stats.recordTest(numNeighbors[1] < numNeighbors[0], "カリングで近傍が減る");
+    stats.recordTest(sameVelocities, "カリングは新しい速度を変えない");
+    
+    std::cout << "近傍数: カリングなし " << numNeighbors[0] << ", カリングあり " << numNeighbors[1] << std::endl;
+    
+    delete sims[0];
+    delete sims[1];
+}
+
+// テスト15: 掃引体積による近傍探索
+void testNeighborSweep(TestStats& stats) {
+    std::cout << "\n=== 掃引近傍探索テスト ===" << std::endl;
+    
+    RVOSimulator* sim = new RVOSimulator();
+    sim->setTimeStep(0.1f);
+    // refit する木で、途中から掃引探索に切り替える
+    sim->setAgentTreeRefit(true);
+    sim->setAgentDefaults(3.0f, 10, 5.0f, 0.5f, 2.0f, Vector3());
+    
+    // 正面から近づくエージェントと、遠ざかるエージェント
+    sim->addAgent(Vector3(0, 0, 0), 3.0f, 10, 5.0f, 0.5f, 2.0f, Vector3(2, 0, 0));
+    sim->addAgent(Vector3(12, 0, 0), 3.0f, 10, 5.0f, 0.5f, 2.0f, Vector3(-2, 0, 0));
+    sim->addAgent(Vector3(-12, 0, 0), 3.0f, 10, 5.0f, 0.5f, 2.0f, Vector3(-2, 0, 0));
+    
+    for (size_t i = 0; i < sim->getNumAgents(); i++) {
+        sim->setAgentPrefVelocity(i, sim->getAgentVelocity(i));
+    }
+    
+    sim->doStep();
+    stats.recordTest(sim->getAgentNumAgentNeighbors(0) == 0, "掃引なしでは近傍距離の外のエージェントは近傍でない");
+    
+    sim->setAgentNeighborSweep(true);
+    sim->doStep();
+    
+    const size_t oncoming[1] = { 1 };
+    stats.recordTest(getSortedAgentNeighbors(sim, 0) == std::vector<size_t>(oncoming, oncoming + 1), "掃引探索は近づくエージェントを見つける");
+    stats.recordTest(abs(sim->getAgentPosition(0) - sim->getAgentPosition(1)) > 3.0f, "近づくエージェントは近傍距離の外");
+    
+    delete sim;
+}
+
+// テスト16: エージェント削除後の近傍
+void testRemoveAgentNeighbors(TestStats& stats) {
+    std::cout << "\n=== エージェント削除後の近傍テスト ===" << std::endl;
+    
+    RVOSimulator* sim = createCrowd(RVO_KD_TREE, 300, 10.0f, 37);
+    sim->doStep();
+    
+    const size_t removedNo = 10;
+    const size_t lastNo = sim->getNumAgents() - 1;
+    std::vector<std::vector<size_t> > oldNeighbors(sim->getNumAgents());
+    
+    for (size_t i = 0; i < sim->getNumAgents(); i++) {
+        oldNeighbors[i] = getSortedAgentNeighbors(sim, i);
+    }
+    
+    // 最後のエージェントが削除されたエージェントの番号を引き継ぐ
+    sim->removeAgent(removedNo);
+    
+    bool validNeighbors = true;
+    bool sameNeighbors = true;
+    
+    for (size_t i = 0; i < sim->getNumAgents(); i++) {
+        std::vector<size_t> expected;
+        const std::vector<size_t>& neighbors = oldNeighbors[i == removedNo ? lastNo : i];
+        
+        for (size_t j = 0; j < neighbors.size(); j++) {
+            if (neighbors[j] != removedNo) {
+                expected.push_back(neighbors[j] == lastNo ? removedNo : neighbors[j]);
+            }
+        }
+        
+        std::sort(expected.begin(), expected.end());
+        
+        for (size_t j = 0; j < sim->getAgentNumAgentNeighbors(i); j++) {
+            validNeighbors = validNeighbors && sim->getAgentAgentNeighbor(i, j) < sim->getNumAgents();
+        }
+        
+        sameNeighbors = sameNeighbors && getSortedAgentNeighbors(sim, i) == expected;
+    }
+    
+    stats.recordTest(validNeighbors, "削除後の近傍の番号が範囲内");
+    stats.recordTest(sameNeighbors, "削除後の近傍が削除前の近傍と一致");
+    
+    sim->doStep();
+    stats.recordTest(sim->getNumAgents() == lastNo, "削除後のシミュレーションステップ");
+    
+    delete sim;
+}
+
 int main() {
     std::cout << "=== RVO2-3D 加速度制限機能テスト ===" << std::endl;
     
@@ -316,6 +1031,16 @@ int main() {
         testWithinLimits(stats);
         testMultiAgentScenario(stats);
         testRealWorldScenario(stats);
+        testSpatialQueries(stats);
+        testBatchNearestQueries(stats);
+        testVisibilityQueries(stats);
+        testObstacles(stats);
+        testDualTreeSearch(stats);
+        testBottomUpSearch(stats);
+        testVerticalNeighborDist(stats);
+        testNeighborCulling(stats);
+        testNeighborSweep(stats);
+        testRemoveAgentNeighbors(stats);
     } catch (const std::exception& e) {
         std::cout << "テスト実行中にエラーが発生しました: " << e.what() << std::endl;
         return 1;